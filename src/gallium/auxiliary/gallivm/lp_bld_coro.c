@@ -30,6 +30,7 @@
 #include "lp_bld_const.h"
 #include "lp_bld_intr.h"
 #include "lp_bld_flow.h"
+#include "lp_bld_misc.h"
 
 #if LLVM_VERSION_MAJOR < 6
 /* not a wrapper, just lets it compile */
@@ -156,12 +157,20 @@ coro_free(char *ptr)
 
 void lp_build_coro_add_malloc_hooks(struct gallivm_state *gallivm)
 {
-   assert(gallivm->engine);
+   assert(gallivm->compiled);
 
    assert(gallivm->coro_malloc_hook);
    assert(gallivm->coro_free_hook);
-   LLVMAddGlobalMapping(gallivm->engine, gallivm->coro_malloc_hook, coro_malloc);
-   LLVMAddGlobalMapping(gallivm->engine, gallivm->coro_free_hook, coro_free);
+   gallivm_add_global_mapping(gallivm, gallivm->coro_malloc_hook, coro_malloc);
+   gallivm_add_global_mapping(gallivm, gallivm->coro_free_hook, coro_free);
+}
+
+void lp_build_coro_get_malloc_hook_mappings(struct lp_symbol_mapping *mappings)
+{
+   mappings[0].name = "coro_malloc";
+   mappings[0].addr = (void *)coro_malloc;
+   mappings[1].name = "coro_free";
+   mappings[1].addr = (void *)coro_free;
 }
 
 void lp_build_coro_declare_malloc_hooks(struct gallivm_state *gallivm)
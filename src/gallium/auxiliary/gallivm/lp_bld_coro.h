@@ -68,5 +68,7 @@ void lp_build_coro_suspend_switch(struct gallivm_state *gallivm,
                                   bool final_suspend);
 
 void lp_build_coro_add_malloc_hooks(struct gallivm_state *gallivm);
+struct lp_symbol_mapping;
+void lp_build_coro_get_malloc_hook_mappings(struct lp_symbol_mapping *mappings);
 void lp_build_coro_declare_malloc_hooks(struct gallivm_state *gallivm);
 #endif
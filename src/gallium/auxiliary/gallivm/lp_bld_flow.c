@@ -31,6 +31,7 @@
  * @author Jose Fonseca <jfonseca@vmware.com>
  */
 
+#include "util/u_cpu_detect.h"
 #include "util/u_debug.h"
 #include "util/u_memory.h"
 
@@ -140,12 +141,33 @@ lp_build_mask_check(struct lp_build_mask_context *mask)
     * Not sure if llvm could figure that out on its own.
     */
 
-   /* cond = (mask == 0) */
-   cond = LLVMBuildICmp(builder,
-                        LLVMIntEQ,
-                        LLVMBuildBitCast(builder, value, mask->reg_type, ""),
-                        LLVMConstNull(mask->reg_type),
-                        "");
+   if (util_get_cpu_caps()->has_avx512f &&
+       LLVMGetIntTypeWidth(mask->reg_type) == 512) {
+      /*
+       * Mask elements are either all ones or all zeros, so the sign bits
+       * are enough. Comparing them as an i1 vector puts them into a mask
+       * register (vpmovd2m + kortest) rather than OR-reducing 512 bits.
+       */
+      LLVMTypeRef bits_type =
+         LLVMIntTypeInContext(mask->skip.gallivm->context,
+                              LLVMGetVectorSize(LLVMTypeOf(value)));
+
+      value = LLVMBuildICmp(builder, LLVMIntSLT, value,
+                            LLVMConstNull(LLVMTypeOf(value)), "");
+      cond = LLVMBuildICmp(builder,
+                           LLVMIntEQ,
+                           LLVMBuildBitCast(builder, value, bits_type, ""),
+                           LLVMConstNull(bits_type),
+                           "");
+   }
+   else {
+      /* cond = (mask == 0) */
+      cond = LLVMBuildICmp(builder,
+                           LLVMIntEQ,
+                           LLVMBuildBitCast(builder, value, mask->reg_type, ""),
+                           LLVMConstNull(mask->reg_type),
+                           "");
+   }
 
    /* if cond, goto end of block */
    lp_build_flow_skip_cond_break(&mask->skip, cond);
@@ -189,6 +189,25 @@ lp_build_fetch_s3tc_rgba_aos(struct gallivm_state *gallivm,
                              LLVMValueRef j,
                              LLVMValueRef cache);
 
+LLVMValueRef
+lp_build_fetch_cached_texels(struct gallivm_state *gallivm,
+                             const struct util_format_description *format_desc,
+                             unsigned n,
+                             LLVMValueRef base_ptr,
+                             LLVMValueRef offset,
+                             LLVMValueRef i,
+                             LLVMValueRef j,
+                             LLVMValueRef cache);
+
+/*
+ * ETC
+ */
+
+void
+lp_build_etc1_decode_block(struct gallivm_state *gallivm,
+                           LLVMValueRef ptr,
+                           LLVMValueRef *col);
+
 /*
  * RGTC
  */
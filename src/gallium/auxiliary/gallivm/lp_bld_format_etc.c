@@ -0,0 +1,237 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The Mesa Authors.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+
+/**
+ * @file
+ * etc pixel format manipulation.
+ *
+ * Blocks are decoded as a whole, with one vector lane per texel, so the
+ * result can be put directly into the block cache used for s3tc.
+ */
+
+
+#include "util/format/u_format.h"
+
+#include "lp_bld_arit.h"
+#include "lp_bld_type.h"
+#include "lp_bld_const.h"
+#include "lp_bld_format.h"
+#include "lp_bld_logic.h"
+#include "lp_bld_pack.h"
+#include "lp_bld_init.h"
+#include "lp_bld_intr.h"
+#include "lp_bld_swizzle.h"
+
+
+/*
+ * Intensity modifiers per table, the remaining two table entries are the
+ * negated values.
+ */
+static const int etc1_modifier_small[8] = { 2, 5, 9, 13, 18, 24, 33, 47 };
+static const int etc1_modifier_large[8] = { 8, 17, 29, 42, 60, 80, 106, 183 };
+
+
+/**
+ * Expand the two base colors of an etc1 block.
+ * @param in  <4 x i32> vector with the first 3 block bytes (r, g, b)
+ * @param diff  i1 scalar, true for differential mode
+ */
+static void
+etc1_base_colors(struct gallivm_state *gallivm,
+                 LLVMValueRef in,
+                 LLVMValueRef diff,
+                 LLVMValueRef *base0,
+                 LLVMValueRef *base1)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_type type32 = lp_type_int_vec(32, 128);
+   LLVMValueRef diff_hi, diff_lo, ind_hi, ind_lo, delta, tmp;
+
+#define C(v) lp_build_const_int_vec(gallivm, type32, v)
+
+   /* differential mode: 5 bit base color plus 3 bit signed delta */
+   diff_hi = LLVMBuildOr(builder, LLVMBuildAnd(builder, in, C(0xf8), ""),
+                         LLVMBuildLShr(builder, in, C(5), ""), "");
+   delta = LLVMBuildXor(builder, LLVMBuildAnd(builder, in, C(0x7), ""),
+                        C(0x4), "");
+   delta = LLVMBuildSub(builder, delta, C(0x4), "");
+   tmp = LLVMBuildAdd(builder, LLVMBuildLShr(builder, in, C(3), ""), delta, "");
+   tmp = LLVMBuildAnd(builder, tmp, C(0xff), "");
+   diff_lo = LLVMBuildOr(builder, LLVMBuildShl(builder, tmp, C(3), ""),
+                         LLVMBuildLShr(builder, tmp, C(2), ""), "");
+   diff_lo = LLVMBuildAnd(builder, diff_lo, C(0xff), "");
+
+   /* individual mode: two 4 bit base colors */
+   ind_hi = LLVMBuildOr(builder, LLVMBuildAnd(builder, in, C(0xf0), ""),
+                        LLVMBuildLShr(builder, in, C(4), ""), "");
+   tmp = LLVMBuildAnd(builder, in, C(0xf), "");
+   ind_lo = LLVMBuildOr(builder, LLVMBuildShl(builder, tmp, C(4), ""), tmp, "");
+
+#undef C
+
+   *base0 = LLVMBuildSelect(builder, diff, diff_hi, ind_hi, "");
+   *base1 = LLVMBuildSelect(builder, diff, diff_lo, ind_lo, "");
+}
+
+
+/**
+ * Decode one etc1 block.
+ *
+ * All 16 texels are decoded at once. Texel (x, y) ends up in lane y of
+ * col[x], which is both the order of the etc1 pixel index bits and the
+ * layout of the block cache.
+ *
+ * @param ptr  i8 pointer to the 64bit block
+ * @param col  returns 4 <4 x i32> vectors with the rgba8 texels
+ */
+void
+lp_build_etc1_decode_block(struct gallivm_state *gallivm,
+                           LLVMValueRef ptr,
+                           LLVMValueRef *col)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef i32t = LLVMInt32TypeInContext(gallivm->context);
+   LLVMTypeRef i8t = LLVMInt8TypeInContext(gallivm->context);
+   struct lp_type type32 = lp_type_int_vec(32, 128);
+   struct lp_type type16x32 = lp_type_int_vec(32, 512);
+   struct lp_build_context bld;
+   LLVMValueRef words, word0, indices, control, diff, flip, tbl0, tbl1;
+   LLVMValueRef bytes, base0, base1, blk, blk_flip, blk_noflip;
+   LLVMValueRef small, large, mag, modifier, idx, rgba, tmp;
+   LLVMValueRef elems[16];
+   unsigned k, chan;
+
+   lp_build_context_init(&bld, gallivm, type16x32);
+
+   ptr = LLVMBuildBitCast(builder, ptr,
+                          LLVMPointerType(LLVMVectorType(i32t, 2), 0), "");
+   words = LLVMBuildLoad(builder, ptr, "");
+   LLVMSetAlignment(words, 4);
+   word0 = LLVMBuildExtractElement(builder, words,
+                                   lp_build_const_int32(gallivm, 0), "");
+   indices = LLVMBuildExtractElement(builder, words,
+                                     lp_build_const_int32(gallivm, 1), "");
+   /* pixel indices are stored big endian */
+   indices = lp_build_intrinsic_unary(builder, "llvm.bswap.i32", i32t, indices);
+
+   control = LLVMBuildLShr(builder, word0, lp_build_const_int32(gallivm, 24), "");
+   diff = LLVMBuildTrunc(builder,
+                         LLVMBuildLShr(builder, control,
+                                       lp_build_const_int32(gallivm, 1), ""),
+                         LLVMInt1TypeInContext(gallivm->context), "diff");
+   flip = LLVMBuildTrunc(builder, control,
+                         LLVMInt1TypeInContext(gallivm->context), "flip");
+   tbl0 = LLVMBuildLShr(builder, control, lp_build_const_int32(gallivm, 5), "");
+   tbl0 = LLVMBuildAnd(builder, tbl0, lp_build_const_int32(gallivm, 7), "");
+   tbl1 = LLVMBuildLShr(builder, control, lp_build_const_int32(gallivm, 2), "");
+   tbl1 = LLVMBuildAnd(builder, tbl1, lp_build_const_int32(gallivm, 7), "");
+
+   /* r, g, b bytes (and the control byte, which is ignored) */
+   bytes = LLVMBuildBitCast(builder, word0, LLVMVectorType(i8t, 4), "");
+   bytes = LLVMBuildZExt(builder, bytes, lp_build_vec_type(gallivm, type32), "");
+   etc1_base_colors(gallivm, bytes, diff, &base0, &base1);
+
+   /*
+    * Per texel (lane k = x * 4 + y):
+    *   idx = bit (16 + k) << 1 | bit k of the pixel indices
+    *   subblock = flip ? y >= 2 : x >= 2
+    */
+   for (k = 0; k < 16; k++) {
+      elems[k] = lp_build_const_int32(gallivm, k);
+   }
+   tmp = LLVMConstVector(elems, 16);
+   indices = lp_build_broadcast_scalar(&bld, indices);
+   idx = LLVMBuildLShr(builder, indices, tmp, "");
+   idx = LLVMBuildAnd(builder, idx, bld.one, "");
+   tmp = LLVMBuildAdd(builder, tmp, lp_build_const_int_vec(gallivm, type16x32, 15), "");
+   tmp = LLVMBuildLShr(builder, indices, tmp, "");
+   tmp = LLVMBuildAnd(builder, tmp, lp_build_const_int_vec(gallivm, type16x32, 2), "");
+   idx = LLVMBuildOr(builder, idx, tmp, "");
+
+   for (k = 0; k < 16; k++) {
+      elems[k] = LLVMConstInt(LLVMInt1TypeInContext(gallivm->context),
+                              (k & 3) >= 2, 0);
+   }
+   blk_flip = LLVMConstVector(elems, 16);
+   for (k = 0; k < 16; k++) {
+      elems[k] = LLVMConstInt(LLVMInt1TypeInContext(gallivm->context),
+                              k >= 8, 0);
+   }
+   blk_noflip = LLVMConstVector(elems, 16);
+   blk = LLVMBuildSelect(builder, flip, blk_flip, blk_noflip, "subblock");
+
+   /* modifier = +-small or +-large of the subblock's table */
+   for (k = 0; k < 8; k++) {
+      elems[k] = lp_build_const_int32(gallivm, etc1_modifier_small[k]);
+   }
+   tmp = LLVMConstVector(elems, 8);
+   small = LLVMBuildSelect(builder, blk,
+                           lp_build_broadcast_scalar(&bld,
+                              LLVMBuildExtractElement(builder, tmp, tbl1, "")),
+                           lp_build_broadcast_scalar(&bld,
+                              LLVMBuildExtractElement(builder, tmp, tbl0, "")),
+                           "");
+   for (k = 0; k < 8; k++) {
+      elems[k] = lp_build_const_int32(gallivm, etc1_modifier_large[k]);
+   }
+   tmp = LLVMConstVector(elems, 8);
+   large = LLVMBuildSelect(builder, blk,
+                           lp_build_broadcast_scalar(&bld,
+                              LLVMBuildExtractElement(builder, tmp, tbl1, "")),
+                           lp_build_broadcast_scalar(&bld,
+                              LLVMBuildExtractElement(builder, tmp, tbl0, "")),
+                           "");
+   tmp = LLVMBuildAnd(builder, idx, bld.one, "");
+   tmp = LLVMBuildICmp(builder, LLVMIntNE, tmp, bld.zero, "");
+   mag = LLVMBuildSelect(builder, tmp, large, small, "");
+   tmp = LLVMBuildAnd(builder, idx, lp_build_const_int_vec(gallivm, type16x32, 2), "");
+   tmp = LLVMBuildICmp(builder, LLVMIntNE, tmp, bld.zero, "");
+   modifier = LLVMBuildSelect(builder, tmp, LLVMBuildNeg(builder, mag, ""), mag, "");
+
+   rgba = lp_build_const_int_vec(gallivm, type16x32, 0xff000000);
+   for (chan = 0; chan < 3; chan++) {
+      LLVMValueRef index = lp_build_const_int32(gallivm, chan);
+      LLVMValueRef c0 = LLVMBuildExtractElement(builder, base0, index, "");
+      LLVMValueRef c1 = LLVMBuildExtractElement(builder, base1, index, "");
+      LLVMValueRef c;
+
+      c = LLVMBuildSelect(builder, blk,
+                          lp_build_broadcast_scalar(&bld, c1),
+                          lp_build_broadcast_scalar(&bld, c0), "");
+      c = LLVMBuildAdd(builder, c, modifier, "");
+      c = lp_build_clamp(&bld, c, bld.zero,
+                         lp_build_const_int_vec(gallivm, type16x32, 255));
+      c = LLVMBuildShl(builder, c,
+                       lp_build_const_int_vec(gallivm, type16x32, chan * 8), "");
+      rgba = LLVMBuildOr(builder, rgba, c, "");
+   }
+
+   for (k = 0; k < 4; k++) {
+      col[k] = lp_build_extract_range(gallivm, rgba, k * 4, 4);
+   }
+}
@@ -38,6 +38,7 @@
 
 #include "util/format/u_format.h"
 #include "util/u_math.h"
+#include "util/u_pointer.h"
 #include "util/u_string.h"
 #include "util/u_cpu_detect.h"
 #include "util/u_debug.h"
@@ -57,6 +58,7 @@
 #include "lp_bld_init.h"
 #include "lp_bld_debug.h"
 #include "lp_bld_intr.h"
+#include "lp_bld_misc.h"
 
 
 /**
@@ -1908,6 +1910,74 @@ s3tc_decode_block_dxt5(struct gallivm_state *gallivm,
 }
 
 
+/*
+ * decode one block of a format without a jit decoder, by calling the
+ * util_format unpack function once for the whole block.
+ */
+static void
+decode_block_unpack_8unorm(struct gallivm_state *gallivm,
+                           const struct util_format_description *format_desc,
+                           LLVMValueRef ptr_addr,
+                           LLVMValueRef *col)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   const struct util_format_unpack_description *unpack =
+      util_format_unpack_description(format_desc->format);
+   LLVMTypeRef i8t = LLVMInt8TypeInContext(gallivm->context);
+   LLVMTypeRef pi8t = LLVMPointerType(i8t, 0);
+   LLVMTypeRef i32t = LLVMInt32TypeInContext(gallivm->context);
+   LLVMTypeRef type32_4 = LLVMVectorType(i32t, 4);
+   LLVMTypeRef arg_types[6];
+   LLVMTypeRef function_type;
+   LLVMValueRef function, tmp_ptr, args[6], rows[4];
+   unsigned count;
+
+   assert(unpack->unpack_rgba_8unorm);
+   assert(format_desc->block.width == 4 && format_desc->block.height == 4);
+
+   /*
+    * Function to call looks like:
+    *   unpack(uint8_t *dst, unsigned dst_stride,
+    *          const uint8_t *src, unsigned src_stride,
+    *          unsigned width, unsigned height)
+    */
+   arg_types[0] = pi8t;
+   arg_types[1] = i32t;
+   arg_types[2] = pi8t;
+   arg_types[3] = i32t;
+   arg_types[4] = i32t;
+   arg_types[5] = i32t;
+   function_type = LLVMFunctionType(LLVMVoidTypeInContext(gallivm->context),
+                                    arg_types, ARRAY_SIZE(arg_types), 0);
+
+   if (gallivm->cache)
+      gallivm->cache->dont_cache = true;
+   function = lp_build_const_int_pointer(gallivm,
+      func_to_pointer((func_pointer) unpack->unpack_rgba_8unorm));
+   function = LLVMBuildBitCast(builder, function,
+                               LLVMPointerType(function_type, 0), "");
+
+   tmp_ptr = lp_build_array_alloca(gallivm, type32_4,
+                                   lp_build_const_int32(gallivm, 4), "");
+
+   args[0] = LLVMBuildBitCast(builder, tmp_ptr, pi8t, "");
+   args[1] = lp_build_const_int32(gallivm, 4 * 4);
+   args[2] = ptr_addr;
+   args[3] = lp_build_const_int32(gallivm, format_desc->block.bits / 8);
+   args[4] = lp_build_const_int32(gallivm, 4);
+   args[5] = lp_build_const_int32(gallivm, 4);
+   LLVMBuildCall(builder, function, args, ARRAY_SIZE(args), "");
+
+   /* unpack gives us rows, the cache wants columns */
+   for (count = 0; count < 4; count++) {
+      LLVMValueRef index = lp_build_const_int32(gallivm, count);
+      LLVMValueRef row_ptr = LLVMBuildGEP(builder, tmp_ptr, &index, 1, "");
+      rows[count] = LLVMBuildLoad(builder, row_ptr, "");
+   }
+   lp_build_transpose_aos(gallivm, lp_type_int_vec(32, 128), rows, col);
+}
+
+
 static void
 generate_update_cache_one_block(struct gallivm_state *gallivm,
                                 LLVMValueRef function,
@@ -1938,28 +2008,37 @@ generate_update_cache_one_block(struct gallivm_state *gallivm,
    gallivm->builder = LLVMCreateBuilderInContext(gallivm->context);
    LLVMPositionBuilderAtEnd(gallivm->builder, block);
 
-   lp_build_gather_s3tc_simple_scalar(gallivm, format_desc, &dxt_block,
-                                      ptr_addr);
-
-   switch (format_desc->format) {
-   case PIPE_FORMAT_DXT1_RGB:
-   case PIPE_FORMAT_DXT1_RGBA:
-   case PIPE_FORMAT_DXT1_SRGB:
-   case PIPE_FORMAT_DXT1_SRGBA:
-      s3tc_decode_block_dxt1(gallivm, format_desc->format, dxt_block, col);
-      break;
-   case PIPE_FORMAT_DXT3_RGBA:
-   case PIPE_FORMAT_DXT3_SRGBA:
-      s3tc_decode_block_dxt3(gallivm, format_desc->format, dxt_block, col);
-      break;
-   case PIPE_FORMAT_DXT5_RGBA:
-   case PIPE_FORMAT_DXT5_SRGBA:
-      s3tc_decode_block_dxt5(gallivm, format_desc->format, dxt_block, col);
-      break;
-   default:
-      assert(0);
-      s3tc_decode_block_dxt1(gallivm, format_desc->format, dxt_block, col);
-      break;
+   if (format_desc->layout == UTIL_FORMAT_LAYOUT_ETC) {
+      assert(format_desc->format == PIPE_FORMAT_ETC1_RGB8);
+      lp_build_etc1_decode_block(gallivm, ptr_addr, col);
+   }
+   else if (format_desc->layout != UTIL_FORMAT_LAYOUT_S3TC) {
+      decode_block_unpack_8unorm(gallivm, format_desc, ptr_addr, col);
+   }
+   else {
+      lp_build_gather_s3tc_simple_scalar(gallivm, format_desc, &dxt_block,
+                                         ptr_addr);
+
+      switch (format_desc->format) {
+      case PIPE_FORMAT_DXT1_RGB:
+      case PIPE_FORMAT_DXT1_RGBA:
+      case PIPE_FORMAT_DXT1_SRGB:
+      case PIPE_FORMAT_DXT1_SRGBA:
+         s3tc_decode_block_dxt1(gallivm, format_desc->format, dxt_block, col);
+         break;
+      case PIPE_FORMAT_DXT3_RGBA:
+      case PIPE_FORMAT_DXT3_SRGBA:
+         s3tc_decode_block_dxt3(gallivm, format_desc->format, dxt_block, col);
+         break;
+      case PIPE_FORMAT_DXT5_RGBA:
+      case PIPE_FORMAT_DXT5_SRGBA:
+         s3tc_decode_block_dxt5(gallivm, format_desc->format, dxt_block, col);
+         break;
+      default:
+         assert(0);
+         s3tc_decode_block_dxt1(gallivm, format_desc->format, dxt_block, col);
+         break;
+      }
    }
 
    tag_value = LLVMBuildPtrToInt(gallivm->builder, ptr_addr,
@@ -2032,18 +2111,29 @@ update_cached_block(struct gallivm_state *gallivm,
    LLVMSetInstructionCallConv(inst, LLVMFastCallConv);
 }
 
-/*
- * cached lookup
+/**
+ * Fetch texels of a 4x4 compressed format through the block cache.
+ *
+ * On a miss the whole block is decoded once and put into the cache, so
+ * the remaining texels of that block are plain loads. s3tc and etc1 blocks
+ * are decoded with jit code, other formats (bptc) fall back to the
+ * util_format unpack function for the whole block.
+ *
+ * @param n  number of pixels processed
+ * @param offset <n x i32> vector with the relative offsets of the blocks
+ * @param i  is a <n x i32> vector with the x subpixel coordinate (0..3)
+ * @param j  is a <n x i32> vector with the y subpixel coordinate (0..3)
+ * @return  a <4*n x i8> vector with the pixel RGBA values in AoS
  */
-static LLVMValueRef
-compressed_fetch_cached(struct gallivm_state *gallivm,
-                        const struct util_format_description *format_desc,
-                        unsigned n,
-                        LLVMValueRef base_ptr,
-                        LLVMValueRef offset,
-                        LLVMValueRef i,
-                        LLVMValueRef j,
-                        LLVMValueRef cache)
+LLVMValueRef
+lp_build_fetch_cached_texels(struct gallivm_state *gallivm,
+                             const struct util_format_description *format_desc,
+                             unsigned n,
+                             LLVMValueRef base_ptr,
+                             LLVMValueRef offset,
+                             LLVMValueRef i,
+                             LLVMValueRef j,
+                             LLVMValueRef cache)
 
 {
    LLVMBuilderRef builder = gallivm->builder;
@@ -2210,8 +2300,8 @@ lp_build_fetch_s3tc_rgba_aos(struct gallivm_state *gallivm,
 
 /*   debug_printf("format = %d\n", format_desc->format);*/
    if (cache) {
-      rgba = compressed_fetch_cached(gallivm, format_desc, n,
-                                     base_ptr, offset, i, j, cache);
+      rgba = lp_build_fetch_cached_texels(gallivm, format_desc, n,
+                                          base_ptr, offset, i, j, cache);
       return rgba;
    }
 
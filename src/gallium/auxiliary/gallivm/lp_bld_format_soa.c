@@ -741,7 +741,7 @@ lp_build_fetch_rgba_soa(struct gallivm_state *gallivm,
    /*
     * Try calling lp_build_fetch_rgba_aos for all pixels.
     * Should only really hit subsampled, compressed
-    * (for s3tc srgb and rgtc too).
+    * (for s3tc/bptc srgb and rgtc too).
     * (This is invalid for plain 8unorm formats because we're lazy with
     * the swizzle since some results would arrive swizzled, some not.)
     */
@@ -749,7 +749,8 @@ lp_build_fetch_rgba_soa(struct gallivm_state *gallivm,
    if ((format_desc->layout != UTIL_FORMAT_LAYOUT_PLAIN) &&
        (util_format_fits_8unorm(format_desc) ||
         format_desc->layout == UTIL_FORMAT_LAYOUT_RGTC ||
-        format_desc->layout == UTIL_FORMAT_LAYOUT_S3TC) &&
+        format_desc->layout == UTIL_FORMAT_LAYOUT_S3TC ||
+        format_desc->format == PIPE_FORMAT_BPTC_SRGBA) &&
        type.floating && type.width == 32 &&
        (type.length == 1 || (type.length % 4 == 0))) {
       struct lp_type tmp_type;
@@ -786,7 +787,8 @@ lp_build_fetch_rgba_soa(struct gallivm_state *gallivm,
        */
       frgba8_desc = util_format_description(is_signed ? PIPE_FORMAT_R8G8B8A8_SNORM : PIPE_FORMAT_R8G8B8A8_UNORM);
       if (format_desc->colorspace == UTIL_FORMAT_COLORSPACE_SRGB) {
-         assert(format_desc->layout == UTIL_FORMAT_LAYOUT_S3TC);
+         assert(format_desc->layout == UTIL_FORMAT_LAYOUT_S3TC ||
+                format_desc->layout == UTIL_FORMAT_LAYOUT_BPTC);
          frgba8_desc = util_format_description(PIPE_FORMAT_R8G8B8A8_SRGB);
       }
       lp_build_unpack_rgba_soa(gallivm,
@@ -821,7 +823,7 @@ lp_build_fetch_rgba_soa(struct gallivm_state *gallivm,
     * in particular if the formats have less than 4 channels.
     *
     * Right now, this should only be hit for:
-    * - ETC formats
+    * - ETC2, ASTC and float BPTC formats
     *   (those miss fast fetch functions hence they are terrible anyway)
     */
 
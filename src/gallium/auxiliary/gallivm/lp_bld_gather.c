@@ -29,6 +29,7 @@
 #include "util/u_debug.h"
 #include "util/u_cpu_detect.h"
 #include "util/u_math.h"
+#include <llvm/Config/llvm-config.h>
 #include "lp_bld_debug.h"
 #include "lp_bld_const.h"
 #include "lp_bld_format.h"
@@ -382,6 +383,50 @@ lp_build_gather_avx2(struct gallivm_state *gallivm,
 }
 
 
+#if LLVM_VERSION_MAJOR >= 7
+/**
+ * 16 x 32bit gather with the avx512 intrinsics.
+ * Unlike avx2, the mask is a <16 x i1> vector (a k register).
+ */
+static LLVMValueRef
+lp_build_gather_avx512(struct gallivm_state *gallivm,
+                       struct lp_type dst_type,
+                       LLVMValueRef base_ptr,
+                       LLVMValueRef offsets)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef i1_type = LLVMInt1TypeInContext(gallivm->context);
+   LLVMTypeRef i32_type = LLVMInt32TypeInContext(gallivm->context);
+   LLVMTypeRef src_vec_type;
+   LLVMValueRef res;
+   const char *intrinsic;
+   struct lp_type res_type = dst_type;
+   res_type.length *= 16;
+
+   assert(LLVMTypeOf(base_ptr) == LLVMPointerType(LLVMInt8TypeInContext(gallivm->context), 0));
+
+   if (dst_type.floating) {
+      src_vec_type = LLVMVectorType(LLVMFloatTypeInContext(gallivm->context), 16);
+      intrinsic = "llvm.x86.avx512.mask.gather.dps.512";
+   } else {
+      src_vec_type = LLVMVectorType(i32_type, 16);
+      intrinsic = "llvm.x86.avx512.mask.gather.dpi.512";
+   }
+
+   LLVMValueRef passthru = LLVMGetUndef(src_vec_type);
+   LLVMValueRef mask = LLVMConstAllOnes(LLVMVectorType(i1_type, 16));
+   LLVMValueRef scale = LLVMConstInt(i32_type, 1, 0);
+
+   LLVMValueRef args[] = { passthru, base_ptr, offsets, mask, scale };
+
+   res = lp_build_intrinsic(builder, intrinsic, src_vec_type, args, 5, 0);
+   res = LLVMBuildBitCast(builder, res, lp_build_vec_type(gallivm, res_type), "");
+
+   return res;
+}
+#endif
+
+
 /**
  * Gather elements from scatter positions in memory into a single vector.
  * Use for fetching texels from a texture.
@@ -492,6 +537,11 @@ lp_build_gather(struct gallivm_state *gallivm,
               src_width == 32 && (length == 4 || length == 8)) {
       return lp_build_gather_avx2(gallivm, length, src_width, dst_type,
                                   base_ptr, offsets);
+#if LLVM_VERSION_MAJOR >= 7
+   } else if (util_get_cpu_caps()->has_avx512f && !need_expansion &&
+              src_width == 32 && length == 16) {
+      return lp_build_gather_avx512(gallivm, dst_type, base_ptr, offsets);
+#endif
    /*
     * This looks bad on paper wrt throughtput/latency on Haswell.
     * Even on Broadwell it doesn't look stellar.
@@ -37,6 +37,7 @@
 #include "lp_bld_debug.h"
 #include "lp_bld_misc.h"
 #include "lp_bld_init.h"
+#include "lp_bld_coro.h"
 
 #include <llvm/Config/llvm-config.h>
 #include <llvm-c/Analysis.h>
@@ -62,6 +63,7 @@ static const struct debug_named_value lp_bld_perf_flags[] = {
    { "nopt",   GALLIVM_PERF_NO_OPT, "disable optimization passes to speed up shader compilation" },
    { "no_filter_hacks", GALLIVM_PERF_NO_BRILINEAR | GALLIVM_PERF_NO_RHO_APPROX |
      GALLIVM_PERF_NO_QUAD_LOD, "disable filter optimization hacks" },
+   { "no_orc", GALLIVM_PERF_NO_ORC, "link each module with its own MCJIT engine instead of the shared orc session" },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -87,6 +89,21 @@ static boolean gallivm_initialized = FALSE;
 unsigned lp_native_vector_width;
 
 
+/**
+ * Whether modules are linked into the shared orc session rather than an
+ * MCJIT engine each.  Only valid once lp_build_init() was called.
+ */
+static inline boolean
+gallivm_use_orc(void)
+{
+#if GALLIVM_USE_ORC
+   return !(gallivm_perf & GALLIVM_PERF_NO_ORC);
+#else
+   return FALSE;
+#endif
+}
+
+
 /*
  * Optimization values are:
  * - 0: None (-O0)
@@ -146,7 +163,7 @@ create_pass_manager(struct gallivm_state *gallivm)
    LLVMAddCoroElidePass(gallivm->cgpassmgr);
 #endif
 
-   if ((gallivm_perf & GALLIVM_PERF_NO_OPT) == 0) {
+   if ((gallivm_perf & GALLIVM_PERF_NO_OPT) == 0 && !gallivm->fast_compile) {
       /*
        * TODO: Evaluate passes some more - keeping in mind
        * both quality of generated code and compile times.
@@ -250,6 +267,10 @@ gallivm_free_code(struct gallivm_state *gallivm)
 {
    assert(!gallivm->module);
    assert(!gallivm->engine);
+#if GALLIVM_USE_ORC
+   lp_build_orc_free_lib(gallivm->orc_lib);
+   gallivm->orc_lib = NULL;
+#endif
    lp_free_generated_code(gallivm->code);
    gallivm->code = NULL;
    lp_free_memory_manager(gallivm->memorymgr);
@@ -265,13 +286,26 @@ init_gallivm_engine(struct gallivm_state *gallivm)
       char *error = NULL;
       int ret;
 
-      if (gallivm_perf & GALLIVM_PERF_NO_OPT) {
+      if ((gallivm_perf & GALLIVM_PERF_NO_OPT) || gallivm->fast_compile) {
+         /* -O0 also makes llvm select instructions with FastISel */
          optlevel = None;
       }
       else {
          optlevel = Default;
       }
 
+#if GALLIVM_USE_ORC
+      if (gallivm_use_orc()) {
+         gallivm->orc_lib = lp_build_orc_create_lib(gallivm->module_name);
+         if (!gallivm->orc_lib)
+            goto fail;
+         if (!lp_build_orc_add_module(gallivm->orc_lib, gallivm->module,
+                                      (unsigned) optlevel, gallivm->cache))
+            goto fail;
+         return TRUE;
+      }
+#endif
+
       ret = lp_build_create_jit_compiler_for_module(&gallivm->engine,
                                                     &gallivm->code,
                                                     gallivm->cache,
@@ -351,9 +385,11 @@ init_gallivm_state(struct gallivm_state *gallivm, const char *name,
    if (!gallivm->builder)
       goto fail;
 
-   gallivm->memorymgr = lp_get_default_memory_manager();
-   if (!gallivm->memorymgr)
-      goto fail;
+   if (!gallivm_use_orc()) {
+      gallivm->memorymgr = lp_get_default_memory_manager();
+      if (!gallivm->memorymgr)
+         goto fail;
+   }
 
    /* FIXME: MC-JIT only allows compiling one module at a time, and it must be
     * complete when MC-JIT is created. So defer the MC-JIT engine creation for
@@ -446,6 +482,10 @@ lp_build_init(void)
    }
 #endif
 
+   /*
+    * avx512 is not picked by default, since 16 wide shaders only pay off
+    * on some cpus. LP_NATIVE_VECTOR_WIDTH=512 opts into it.
+    */
    if (util_get_cpu_caps()->has_avx2 || util_get_cpu_caps()->has_avx) {
       lp_native_vector_width = 256;
    } else {
@@ -525,6 +565,110 @@ gallivm_create(const char *name, LLVMContextRef context,
 }
 
 
+/**
+ * Create a gallivm_state object whose module is compiled as quickly as
+ * possible, skipping the IR optimizations and generating code at -O0.
+ * Meant for code which may be replaced by an optimized build later.
+ */
+struct gallivm_state *
+gallivm_create_fast(const char *name, LLVMContextRef context)
+{
+   struct gallivm_state *gallivm;
+
+   gallivm = CALLOC_STRUCT(gallivm_state);
+   if (gallivm) {
+      gallivm->fast_compile = TRUE;
+      if (!init_gallivm_state(gallivm, name, context, NULL)) {
+         FREE(gallivm);
+         gallivm = NULL;
+      }
+   }
+
+   assert(gallivm != NULL);
+   return gallivm;
+}
+
+
+/**
+ * Create a gallivm_state object holding only the functions of a cached
+ * object, linked directly instead of going through IR generation and an
+ * execution engine.  Nothing can be added to it afterwards.
+ * \return  NULL if the object couldn't be loaded, in which case the
+ *          caller should fall back to gallivm_create().
+ */
+struct gallivm_state *
+gallivm_load_cached(const char *name, const struct lp_cached_code *cache,
+                    unsigned count, const char **names, func_pointer *funcs)
+{
+   struct gallivm_state *gallivm;
+   struct lp_symbol_mapping mappings[3];
+   void *code[4];
+   int64_t time_begin = 0;
+
+   assert(count <= ARRAY_SIZE(code));
+
+   if (!cache->data_size || !lp_build_init())
+      return NULL;
+
+   if (gallivm_debug & GALLIVM_DEBUG_PERF)
+      time_begin = os_time_get();
+
+   gallivm = CALLOC_STRUCT(gallivm_state);
+   if (!gallivm)
+      return NULL;
+
+   lp_build_coro_get_malloc_hook_mappings(mappings);
+   mappings[2].name = "debug_printf";
+   mappings[2].addr = (void *)debug_printf;
+
+#if GALLIVM_USE_ORC
+   if (gallivm_use_orc()) {
+      gallivm->orc_lib = lp_build_orc_create_lib(name);
+      if (!gallivm->orc_lib ||
+          !lp_build_orc_add_object(gallivm->orc_lib, cache))
+         goto fail;
+
+      for (unsigned i = 0; i < ARRAY_SIZE(mappings); i++)
+         lp_build_orc_add_symbol(gallivm->orc_lib, mappings[i].name,
+                                 mappings[i].addr);
+
+      for (unsigned i = 0; i < count; i++) {
+         code[i] = lp_build_orc_lookup(gallivm->orc_lib, names[i]);
+         if (!code[i])
+            goto fail;
+      }
+   } else
+#endif
+   {
+      gallivm->memorymgr = lp_get_default_memory_manager();
+      if (!gallivm->memorymgr)
+         goto fail;
+
+      if (!lp_build_load_cached_object(cache, gallivm->memorymgr,
+                                       mappings, ARRAY_SIZE(mappings),
+                                       names, code, count))
+         goto fail;
+   }
+
+   for (unsigned i = 0; i < count; i++)
+      funcs[i] = pointer_to_func(code[i]);
+   ++gallivm->compiled;
+
+   if (gallivm_debug & GALLIVM_DEBUG_PERF) {
+      int64_t time_end = os_time_get();
+      debug_printf("loading cached module %s took %d usec\n",
+                   name, (int)(time_end - time_begin));
+   }
+
+   return gallivm;
+
+fail:
+   gallivm_free_code(gallivm);
+   FREE(gallivm);
+   return NULL;
+}
+
+
 /**
  * Destroy a gallivm_state object.
  */
@@ -656,12 +800,16 @@ gallivm_compile_module(struct gallivm_state *gallivm)
    if (!init_gallivm_engine(gallivm)) {
       assert(0);
    }
-   assert(gallivm->engine);
+   assert(gallivm->orc_lib || gallivm->engine);
 
    ++gallivm->compiled;
 
    if (gallivm->debug_printf_hook)
-      LLVMAddGlobalMapping(gallivm->engine, gallivm->debug_printf_hook, debug_printf);
+      gallivm_add_global_mapping(gallivm, gallivm->debug_printf_hook, debug_printf);
+
+   /* With orc, this is done per function in gallivm_jit_function(). */
+   if (!gallivm->engine)
+      return;
 
    if (gallivm_debug & GALLIVM_DEBUG_ASM) {
       LLVMValueRef llvm_func = LLVMGetFirstFunction(gallivm->module);
@@ -706,13 +854,30 @@ gallivm_jit_function(struct gallivm_state *gallivm,
    int64_t time_begin = 0;
 
    assert(gallivm->compiled);
-   assert(gallivm->engine);
 
    if (gallivm_debug & GALLIVM_DEBUG_PERF)
       time_begin = os_time_get();
 
-   code = LLVMGetPointerToGlobal(gallivm->engine, func);
-   assert(code);
+#if GALLIVM_USE_ORC
+   if (gallivm->orc_lib) {
+      /*
+       * Objects are linked on the first lookup, after any mappings were
+       * added, so the code can only be looked at from here.
+       */
+      code = lp_build_orc_lookup(gallivm->orc_lib, LLVMGetValueName(func));
+      assert(code);
+      if (gallivm_debug & GALLIVM_DEBUG_ASM)
+         lp_disassemble(func, code);
+#if defined(PROFILE)
+      lp_profile(func, code);
+#endif
+   } else
+#endif
+   {
+      assert(gallivm->engine);
+      code = LLVMGetPointerToGlobal(gallivm->engine, func);
+      assert(code);
+   }
    jit_func = pointer_to_func(code);
 
    if (gallivm_debug & GALLIVM_DEBUG_PERF) {
@@ -725,6 +890,24 @@ gallivm_jit_function(struct gallivm_state *gallivm,
    return jit_func;
 }
 
+/**
+ * Resolve a function the module declares but doesn't define to addr.
+ * Must be called after gallivm_compile_module() and before the first
+ * gallivm_jit_function().
+ */
+void
+gallivm_add_global_mapping(struct gallivm_state *gallivm,
+                           LLVMValueRef sym, void *addr)
+{
+#if GALLIVM_USE_ORC
+   if (gallivm->orc_lib) {
+      lp_build_orc_add_symbol(gallivm->orc_lib, LLVMGetValueName(sym), addr);
+      return;
+   }
+#endif
+   LLVMAddGlobalMapping(gallivm->engine, sym, addr);
+}
+
 unsigned gallivm_get_perf_flags(void)
 {
    return gallivm_perf;
@@ -40,6 +40,7 @@ extern "C" {
 #endif
 
 struct lp_cached_code;
+struct lp_orc_lib;
 struct gallivm_state
 {
    char *module_name;
@@ -52,8 +53,10 @@ struct gallivm_state
    LLVMBuilderRef builder;
    LLVMMCJITMemoryManagerRef memorymgr;
    struct lp_generated_code *code;
+   struct lp_orc_lib *orc_lib;
    struct lp_cached_code *cache;
    unsigned compiled;
+   boolean fast_compile;
    LLVMValueRef coro_malloc_hook;
    LLVMValueRef coro_free_hook;
    LLVMValueRef debug_printf_hook;
@@ -68,6 +71,13 @@ struct gallivm_state *
 gallivm_create(const char *name, LLVMContextRef context,
                struct lp_cached_code *cache);
 
+struct gallivm_state *
+gallivm_create_fast(const char *name, LLVMContextRef context);
+
+struct gallivm_state *
+gallivm_load_cached(const char *name, const struct lp_cached_code *cache,
+                    unsigned count, const char **names, func_pointer *funcs);
+
 void
 gallivm_destroy(struct gallivm_state *gallivm);
 
@@ -85,6 +95,10 @@ func_pointer
 gallivm_jit_function(struct gallivm_state *gallivm,
                      LLVMValueRef func);
 
+void
+gallivm_add_global_mapping(struct gallivm_state *gallivm,
+                           LLVMValueRef sym, void *addr);
+
 unsigned gallivm_get_perf_flags(void);
 
 #ifdef __cplusplus
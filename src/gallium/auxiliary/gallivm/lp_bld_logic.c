@@ -498,6 +498,28 @@ lp_build_any_true_range(struct lp_build_context *bld,
 
    assert(real_length <= bld->type.length);
 
+   if (util_get_cpu_caps()->has_avx512f &&
+       bld->type.width * bld->type.length == 512) {
+      /*
+       * Compare per element into an i1 vector instead, which maps to
+       * vptestm + kortest rather than a 512 bit integer compare.
+       */
+      LLVMValueRef bits;
+
+      true_type = LLVMIntTypeInContext(bld->gallivm->context, real_length);
+      scalar_type = LLVMIntTypeInContext(bld->gallivm->context,
+                                         bld->type.length);
+      bits = LLVMBuildICmp(builder, LLVMIntNE,
+                           LLVMBuildBitCast(builder, val, bld->int_vec_type, ""),
+                           LLVMConstNull(bld->int_vec_type), "");
+      bits = LLVMBuildBitCast(builder, bits, scalar_type, "");
+      if (real_length < bld->type.length) {
+         bits = LLVMBuildTrunc(builder, bits, true_type, "");
+      }
+      return LLVMBuildICmp(builder, LLVMIntNE,
+                           bits, LLVMConstNull(true_type), "");
+   }
+
    true_type = LLVMIntTypeInContext(bld->gallivm->context,
                                     bld->type.width * real_length);
    scalar_type = LLVMIntTypeInContext(bld->gallivm->context,
@@ -63,6 +63,8 @@
 #include <llvm/Support/Host.h>
 #include <llvm/Support/PrettyStackTrace.h>
 #include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/ExecutionEngine/RuntimeDyld.h>
+#include <llvm/Object/ObjectFile.h>
 #include <llvm/Support/TargetSelect.h>
 
 #if LLVM_VERSION_MAJOR < 11
@@ -90,6 +92,18 @@
 
 #include "lp_bld_misc.h"
 #include "lp_bld_debug.h"
+#include "lp_bld_type.h"
+
+#if GALLIVM_USE_ORC
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h>
+#include <llvm/Support/Memory.h>
+#include <llvm/Support/Process.h>
+#include <atomic>
+#endif
 
 namespace {
 
@@ -321,60 +335,18 @@ public:
 };
 
 /**
- * Same as LLVMCreateJITCompilerForModule, but:
- * - allows using MCJIT and enabling AVX feature where available.
- * - set target options
- *
- * See also:
- * - llvm/lib/ExecutionEngine/ExecutionEngineBindings.cpp
- * - llvm/tools/lli/lli.cpp
- * - http://markmail.org/message/ttkuhvgj4cxxy2on#query:+page:1+mid:aju2dggerju3ivd3+state:results
+ * Work out the cpu and target features to generate code for.
+ * Shared by the MCJIT and orc paths, so both generate the same code.
  */
-extern "C"
-LLVMBool
-lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
-                                        lp_generated_code **OutCode,
-                                        struct lp_cached_code *cache_out,
-                                        LLVMModuleRef M,
-                                        LLVMMCJITMemoryManagerRef CMM,
-                                        unsigned OptLevel,
-                                        char **OutError)
+static void
+get_target_options(llvm::SmallVector<std::string, 16> &MAttrs,
+                   llvm::StringRef &MCPU,
+                   bool *large_code_model)
 {
    using namespace llvm;
 
-   std::string Error;
-   EngineBuilder builder(std::unique_ptr<Module>(unwrap(M)));
-
-   /**
-    * LLVM 3.1+ haven't more "extern unsigned llvm::StackAlignmentOverride" and
-    * friends for configuring code generation options, like stack alignment.
-    */
-   TargetOptions options;
-#if defined(PIPE_ARCH_X86)
-   options.StackAlignmentOverride = 4;
-#endif
-
-   builder.setEngineKind(EngineKind::JIT)
-          .setErrorStr(&Error)
-          .setTargetOptions(options)
-          .setOptLevel((CodeGenOpt::Level)OptLevel);
-
-#ifdef _WIN32
-    /*
-     * MCJIT works on Windows, but currently only through ELF object format.
-     *
-     * XXX: We could use `LLVM_HOST_TRIPLE "-elf"` but LLVM_HOST_TRIPLE has
-     * different strings for MinGW/MSVC, so better play it safe and be
-     * explicit.
-     */
-#  ifdef _WIN64
-    LLVMSetTarget(M, "x86_64-pc-win32-elf");
-#  else
-    LLVMSetTarget(M, "i686-pc-win32-elf");
-#  endif
-#endif
+   *large_code_model = false;
 
-   llvm::SmallVector<std::string, 16> MAttrs;
 
 #if LLVM_VERSION_MAJOR >= 4 && (defined(PIPE_ARCH_X86) || defined(PIPE_ARCH_X86_64) || defined(PIPE_ARCH_ARM))
    /* llvm-3.3+ implements sys::getHostCPUFeatures for Arm
@@ -390,6 +362,16 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
         ++f) {
       MAttrs.push_back(((*f).second ? "+" : "-") + (*f).first().str());
    }
+#if LLVM_VERSION_MAJOR >= 7 && (defined(PIPE_ARCH_X86) || defined(PIPE_ARCH_X86_64))
+   /*
+    * LLVM splits 512bit vectors into 256bit halves on most avx512 cpus,
+    * to avoid the clock penalty of zmm registers. If 512bit vectors were
+    * asked for (LP_NATIVE_VECTOR_WIDTH=512), really use them.
+    */
+   if (lp_native_vector_width >= 512 && util_get_cpu_caps()->has_avx512f) {
+      MAttrs.push_back("-prefer-256-bit");
+   }
+#endif
 #elif defined(PIPE_ARCH_X86) || defined(PIPE_ARCH_X86_64)
    /*
     * We need to unset attributes because sometimes LLVM mistakenly assumes
@@ -464,7 +446,6 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
 #endif
 #endif
 
-   builder.setMAttrs(MAttrs);
 
    if (gallivm_debug & (GALLIVM_DEBUG_IR | GALLIVM_DEBUG_ASM | GALLIVM_DEBUG_DUMP_BC)) {
       int n = MAttrs.size();
@@ -476,7 +457,7 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
       }
    }
 
-   StringRef MCPU = llvm::sys::getHostCPUName();
+   MCPU = llvm::sys::getHostCPUName();
    /*
     * The cpu bits are no longer set automatically, so need to set mcpu manually.
     * Note that the MAttrs set above will be sort of ignored (since we should
@@ -500,7 +481,7 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
     * - an additional 8-byte pointer stored immediately before the shader entrypoint;
     * - change an add-immediate (addis) instruction to a load (ld).
     */
-   builder.setCodeModel(CodeModel::Large);
+   *large_code_model = true;
 
 #if UTIL_ARCH_LITTLE_ENDIAN
    /*
@@ -516,10 +497,74 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
       MCPU = "pwr8";
 #endif
 #endif
-   builder.setMCPU(MCPU);
    if (gallivm_debug & (GALLIVM_DEBUG_IR | GALLIVM_DEBUG_ASM | GALLIVM_DEBUG_DUMP_BC)) {
       debug_printf("llc -mcpu option: %s\n", MCPU.str().c_str());
    }
+}
+
+/**
+ * Same as LLVMCreateJITCompilerForModule, but:
+ * - allows using MCJIT and enabling AVX feature where available.
+ * - set target options
+ *
+ * See also:
+ * - llvm/lib/ExecutionEngine/ExecutionEngineBindings.cpp
+ * - llvm/tools/lli/lli.cpp
+ * - http://markmail.org/message/ttkuhvgj4cxxy2on#query:+page:1+mid:aju2dggerju3ivd3+state:results
+ */
+extern "C"
+LLVMBool
+lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
+                                        lp_generated_code **OutCode,
+                                        struct lp_cached_code *cache_out,
+                                        LLVMModuleRef M,
+                                        LLVMMCJITMemoryManagerRef CMM,
+                                        unsigned OptLevel,
+                                        char **OutError)
+{
+   using namespace llvm;
+
+   std::string Error;
+   EngineBuilder builder(std::unique_ptr<Module>(unwrap(M)));
+
+   /**
+    * LLVM 3.1+ haven't more "extern unsigned llvm::StackAlignmentOverride" and
+    * friends for configuring code generation options, like stack alignment.
+    */
+   TargetOptions options;
+#if defined(PIPE_ARCH_X86)
+   options.StackAlignmentOverride = 4;
+#endif
+
+   builder.setEngineKind(EngineKind::JIT)
+          .setErrorStr(&Error)
+          .setTargetOptions(options)
+          .setOptLevel((CodeGenOpt::Level)OptLevel);
+
+#ifdef _WIN32
+    /*
+     * MCJIT works on Windows, but currently only through ELF object format.
+     *
+     * XXX: We could use `LLVM_HOST_TRIPLE "-elf"` but LLVM_HOST_TRIPLE has
+     * different strings for MinGW/MSVC, so better play it safe and be
+     * explicit.
+     */
+#  ifdef _WIN64
+    LLVMSetTarget(M, "x86_64-pc-win32-elf");
+#  else
+    LLVMSetTarget(M, "i686-pc-win32-elf");
+#  endif
+#endif
+
+   llvm::SmallVector<std::string, 16> MAttrs;
+   StringRef MCPU;
+   bool large_code_model;
+
+   get_target_options(MAttrs, MCPU, &large_code_model);
+   builder.setMAttrs(MAttrs);
+   builder.setMCPU(MCPU);
+   if (large_code_model)
+      builder.setCodeModel(CodeModel::Large);
 
    ShaderMemoryManager *MM = NULL;
    BaseMemoryManager* JMM = reinterpret_cast<BaseMemoryManager*>(CMM);
@@ -555,6 +600,505 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
 }
 
 
+#if LLVM_VERSION_MAJOR >= 7
+/*
+ * Resolves the external symbols of a cached object: first the mappings
+ * MCJIT would have been given through LLVMAddGlobalMapping, then the
+ * process' own symbols.
+ */
+class LPCachedSymbolResolver : public llvm::LegacyJITSymbolResolver {
+   const struct lp_symbol_mapping *mappings;
+   unsigned num_mappings;
+
+   public:
+      LPCachedSymbolResolver(const struct lp_symbol_mapping *mappings,
+                             unsigned num_mappings) :
+         mappings(mappings), num_mappings(num_mappings) {
+      }
+
+      llvm::JITSymbol findSymbol(const std::string &Name) override {
+         const char *name = Name.c_str();
+#ifdef __APPLE__
+         if (name[0] == '_')
+            name++;
+#endif
+         for (unsigned i = 0; i < num_mappings; i++) {
+            if (!strcmp(mappings[i].name, name))
+               return llvm::JITSymbol((uint64_t)(uintptr_t)mappings[i].addr,
+                                      llvm::JITSymbolFlags::Exported);
+         }
+         uint64_t addr = llvm::RTDyldMemoryManager::getSymbolAddressInProcess(Name);
+         if (addr)
+            return llvm::JITSymbol(addr, llvm::JITSymbolFlags::Exported);
+         return nullptr;
+      }
+
+      llvm::JITSymbol findSymbolInLogicalDylib(const std::string &Name) override {
+         return nullptr;
+      }
+};
+#endif
+
+/**
+ * Link a cached object straight into the memory manager with RuntimeDyld
+ * and look up the given functions, without creating an execution engine
+ * or any IR.  The code stays alive until the memory manager is freed.
+ *
+ * Returns false if the object can't be loaded or a function is missing;
+ * the caller then has to compile the module the normal way.
+ */
+extern "C" bool
+lp_build_load_cached_object(const struct lp_cached_code *cache,
+                            LLVMMCJITMemoryManagerRef CMM,
+                            const struct lp_symbol_mapping *mappings,
+                            unsigned num_mappings,
+                            const char **names,
+                            void **code,
+                            unsigned count)
+{
+#if LLVM_VERSION_MAJOR >= 7
+   using namespace llvm;
+
+   if (!cache->data_size)
+      return false;
+
+   MemoryBufferRef buffer(StringRef((const char *)cache->data, cache->data_size), "");
+   Expected<std::unique_ptr<object::ObjectFile>> obj =
+      object::ObjectFile::createObjectFile(buffer);
+   if (!obj) {
+      consumeError(obj.takeError());
+      return false;
+   }
+
+   RTDyldMemoryManager *MM = reinterpret_cast<RTDyldMemoryManager *>(CMM);
+   LPCachedSymbolResolver resolver(mappings, num_mappings);
+   RuntimeDyld dyld(*MM, resolver);
+
+   dyld.loadObject(**obj);
+   if (dyld.hasError())
+      return false;
+
+   /* Shaders don't unwind, so unlike MCJIT the EH frames aren't registered. */
+   dyld.resolveRelocations();
+   if (dyld.hasError())
+      return false;
+
+   for (unsigned i = 0; i < count; i++) {
+#ifdef __APPLE__
+      std::string name = std::string("_") + names[i];
+#else
+      std::string name = names[i];
+#endif
+      code[i] = (void *)(uintptr_t)dyld.getSymbol(name).getAddress();
+      if (!code[i])
+         return false;
+   }
+
+   if (MM->finalizeMemory())
+      return false;
+
+   return true;
+#else
+   return false;
+#endif
+}
+
+#if GALLIVM_USE_ORC
+/*
+ * Memory manager for the objects linked into the orc session.
+ *
+ * SectionMemoryManager maps separate pages for the code, read-only data
+ * and read-write data of every object, which adds up with thousands of
+ * small shader variants.  Since RuntimeDyld tells us the total sizes
+ * upfront, put everything in one mapping instead: the code, then the
+ * constants and then the writable data, each starting on a page of its own
+ * so that only the code is executable.
+ */
+class LPCodeMemoryManager : public llvm::RTDyldMemoryManager {
+   llvm::sys::MemoryBlock block;
+   uint8_t *code_next, *code_end;
+   uint8_t *ro_next, *ro_end;
+   uint8_t *rw_next, *rw_end;
+   size_t exec_size, ro_pages_size;
+
+   /* sections which didn't fit the reservation */
+   struct Extra {
+      llvm::sys::MemoryBlock block;
+      unsigned flags;
+   };
+   std::vector<Extra> extras;
+
+   static uint8_t *
+   bump(uint8_t *&next, uint8_t *end, uintptr_t size, unsigned alignment)
+   {
+      uintptr_t p = llvm::alignTo((uintptr_t)next, std::max(alignment, 1u));
+      if (!next || p + size > (uintptr_t)end)
+         return NULL;
+      next = (uint8_t *)(p + size);
+      return (uint8_t *)p;
+   }
+
+   uint8_t *
+   allocate(uint8_t *&next, uint8_t *end, uintptr_t size,
+            unsigned alignment, unsigned flags)
+   {
+      uint8_t *ptr = bump(next, end, size, alignment);
+      if (ptr)
+         return ptr;
+
+      std::error_code ec;
+      Extra extra;
+      extra.block = llvm::sys::Memory::allocateMappedMemory(
+         size + alignment, block.base() ? &block : NULL,
+         llvm::sys::Memory::MF_READ | llvm::sys::Memory::MF_WRITE, ec);
+      if (ec)
+         return NULL;
+      extra.flags = flags;
+      extras.push_back(extra);
+      return (uint8_t *)llvm::alignTo((uintptr_t)extra.block.base(),
+                                      std::max(alignment, 1u));
+   }
+
+   public:
+      LPCodeMemoryManager() :
+         code_next(NULL), code_end(NULL), ro_next(NULL), ro_end(NULL),
+         rw_next(NULL), rw_end(NULL), exec_size(0), ro_pages_size(0) {
+      }
+
+      ~LPCodeMemoryManager() {
+         for (auto &extra : extras)
+            llvm::sys::Memory::releaseMappedMemory(extra.block);
+         if (block.base())
+            llvm::sys::Memory::releaseMappedMemory(block);
+      }
+
+      bool needsToReserveAllocationSpace() override {
+         return true;
+      }
+
+      void reserveAllocationSpace(uintptr_t CodeSize, uint32_t CodeAlign,
+                                  uintptr_t RODataSize, uint32_t RODataAlign,
+                                  uintptr_t RWDataSize, uint32_t RWDataAlign) override {
+         size_t page_size = llvm::sys::Process::getPageSizeEstimate();
+         /* the sizes don't include aligning the start of each region */
+         size_t code_size = CodeSize + CodeAlign;
+         size_t ro_size = RODataSize + RODataAlign;
+         size_t rw_size = RWDataSize + RWDataAlign;
+         std::error_code ec;
+
+         exec_size = llvm::alignTo(code_size, page_size);
+         ro_pages_size = llvm::alignTo(ro_size, page_size);
+         if (!exec_size && !ro_pages_size && !rw_size)
+            return;
+
+         block = llvm::sys::Memory::allocateMappedMemory(
+            exec_size + ro_pages_size + llvm::alignTo(rw_size, page_size), NULL,
+            llvm::sys::Memory::MF_READ | llvm::sys::Memory::MF_WRITE, ec);
+         if (ec) {
+            block = llvm::sys::MemoryBlock();
+            exec_size = ro_pages_size = 0;
+            return;
+         }
+
+         code_next = (uint8_t *)block.base();
+         code_end = code_next + code_size;
+         ro_next = (uint8_t *)block.base() + exec_size;
+         ro_end = ro_next + ro_size;
+         rw_next = ro_next + ro_pages_size;
+         rw_end = rw_next + rw_size;
+      }
+
+      uint8_t *allocateCodeSection(uintptr_t Size, unsigned Alignment,
+                                   unsigned SectionID,
+                                   llvm::StringRef SectionName) override {
+         return allocate(code_next, code_end, Size, Alignment,
+                         llvm::sys::Memory::MF_READ | llvm::sys::Memory::MF_EXEC);
+      }
+
+      uint8_t *allocateDataSection(uintptr_t Size, unsigned Alignment,
+                                   unsigned SectionID,
+                                   llvm::StringRef SectionName,
+                                   bool IsReadOnly) override {
+         if (IsReadOnly)
+            return allocate(ro_next, ro_end, Size, Alignment,
+                            llvm::sys::Memory::MF_READ);
+         return allocate(rw_next, rw_end, Size, Alignment,
+                         llvm::sys::Memory::MF_READ | llvm::sys::Memory::MF_WRITE);
+      }
+
+      bool finalizeMemory(std::string *ErrMsg) override {
+         std::error_code ec;
+
+         if (exec_size) {
+            llvm::sys::MemoryBlock exec(block.base(), exec_size);
+            ec = llvm::sys::Memory::protectMappedMemory(exec,
+               llvm::sys::Memory::MF_READ | llvm::sys::Memory::MF_EXEC);
+            if (ec)
+               goto fail;
+            llvm::sys::Memory::InvalidateInstructionCache(exec.base(),
+                                                          exec.allocatedSize());
+         }
+
+         if (ro_pages_size) {
+            llvm::sys::MemoryBlock ro((uint8_t *)block.base() + exec_size,
+                                      ro_pages_size);
+            ec = llvm::sys::Memory::protectMappedMemory(ro,
+               llvm::sys::Memory::MF_READ);
+            if (ec)
+               goto fail;
+         }
+
+         for (auto &extra : extras) {
+            ec = llvm::sys::Memory::protectMappedMemory(extra.block, extra.flags);
+            if (ec)
+               goto fail;
+            if (extra.flags & llvm::sys::Memory::MF_EXEC)
+               llvm::sys::Memory::InvalidateInstructionCache(extra.block.base(),
+                                                             extra.block.allocatedSize());
+         }
+         return false;
+
+      fail:
+         if (ErrMsg)
+            *ErrMsg = ec.message();
+         return true;
+      }
+};
+
+
+/*
+ * The orc session shared by all modules.  Each gallivm module gets its own
+ * JITDylib, which links against the main one for the process' symbols.
+ */
+static llvm::orc::LLJIT *lp_orc_jit;
+static llvm::orc::JITTargetMachineBuilder *lp_orc_jtmb;
+static once_flag lp_orc_init_once_flag = ONCE_FLAG_INIT;
+
+struct lp_orc_lib {
+   llvm::orc::JITDylib *jd;
+};
+
+static void
+lp_orc_init(void)
+{
+   using namespace llvm;
+
+   auto JTMB = orc::JITTargetMachineBuilder::detectHost();
+   if (!JTMB) {
+      debug_printf("gallivm: %s\n", toString(JTMB.takeError()).c_str());
+      return;
+   }
+
+   llvm::SmallVector<std::string, 16> MAttrs;
+   StringRef MCPU;
+   bool large_code_model;
+
+   get_target_options(MAttrs, MCPU, &large_code_model);
+   JTMB->setCPU(MCPU.str());
+   JTMB->addFeatures(std::vector<std::string>(MAttrs.begin(), MAttrs.end()));
+   if (large_code_model)
+      JTMB->setCodeModel(CodeModel::Large);
+#if defined(PIPE_ARCH_X86)
+   JTMB->getOptions().StackAlignmentOverride = 4;
+#endif
+
+   auto J = orc::LLJITBuilder()
+      .setJITTargetMachineBuilder(*JTMB)
+      .setObjectLinkingLayerCreator(
+         [](orc::ExecutionSession &ES, const Triple &TT) {
+            return std::make_unique<orc::RTDyldObjectLinkingLayer>(
+               ES, []() { return std::make_unique<LPCodeMemoryManager>(); });
+         })
+      .create();
+   if (!J) {
+      debug_printf("gallivm: %s\n", toString(J.takeError()).c_str());
+      return;
+   }
+
+   auto process = orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+      (*J)->getDataLayout().getGlobalPrefix());
+   if (!process) {
+      debug_printf("gallivm: %s\n", toString(process.takeError()).c_str());
+      return;
+   }
+   (*J)->getMainJITDylib().addGenerator(std::move(*process));
+
+   /* Never freed, shaders may be destroyed during process exit. */
+   lp_orc_jtmb = new orc::JITTargetMachineBuilder(std::move(*JTMB));
+   lp_orc_jit = J->release();
+}
+
+/*
+ * Target machines are expensive to set up but not thread safe, so keep one
+ * per compiling thread instead of creating one per module like MCJIT.
+ */
+static llvm::TargetMachine *
+lp_orc_get_target_machine(unsigned OptLevel)
+{
+   static thread_local std::unique_ptr<llvm::TargetMachine> TM;
+
+   if (!TM) {
+      llvm::orc::JITTargetMachineBuilder JTMB(*lp_orc_jtmb);
+      auto NewTM = JTMB.createTargetMachine();
+      if (!NewTM) {
+         debug_printf("gallivm: %s\n",
+                      llvm::toString(NewTM.takeError()).c_str());
+         return NULL;
+      }
+      TM = std::move(*NewTM);
+   }
+   TM->setOptLevel((llvm::CodeGenOpt::Level)OptLevel);
+   return TM.get();
+}
+
+/**
+ * Create an empty JITDylib in the shared session for one gallivm module.
+ */
+extern "C" struct lp_orc_lib *
+lp_build_orc_create_lib(const char *name)
+{
+   static std::atomic<unsigned> lib_id;
+
+   call_once(&lp_orc_init_once_flag, lp_orc_init);
+   if (!lp_orc_jit)
+      return NULL;
+
+   /* JITDylib names must be unique within the session */
+   std::string lib_name = std::string(name ? name : "gallivm") + "." +
+                          std::to_string(lib_id++);
+   auto JD = lp_orc_jit->createJITDylib(lib_name);
+   if (!JD) {
+      debug_printf("gallivm: %s\n", llvm::toString(JD.takeError()).c_str());
+      return NULL;
+   }
+   JD->addToLinkOrder(lp_orc_jit->getMainJITDylib());
+
+   struct lp_orc_lib *lib = new lp_orc_lib;
+   lib->jd = &*JD;
+   return lib;
+}
+
+/**
+ * Compile a module to an object and add it to the lib.  The object is only
+ * linked when the first of its functions is looked up, so symbols may still
+ * be added until then.  If cache_out already holds an object, that is used
+ * instead, otherwise the compiled object is copied into it.
+ */
+extern "C" bool
+lp_build_orc_add_module(struct lp_orc_lib *lib,
+                        LLVMModuleRef M,
+                        unsigned OptLevel,
+                        struct lp_cached_code *cache_out)
+{
+   using namespace llvm;
+
+   if (cache_out && cache_out->data_size)
+      return lp_build_orc_add_object(lib, cache_out);
+
+   TargetMachine *TM = lp_orc_get_target_machine(OptLevel);
+   if (!TM)
+      return false;
+
+   Module *mod = unwrap(M);
+   mod->setDataLayout(TM->createDataLayout());
+   mod->setTargetTriple(TM->getTargetTriple().str());
+
+   orc::SimpleCompiler compiler(*TM);
+   auto obj = compiler(*mod);
+   if (!obj) {
+      debug_printf("gallivm: %s\n", toString(obj.takeError()).c_str());
+      return false;
+   }
+
+   if (cache_out) {
+      cache_out->data_size = (*obj)->getBufferSize();
+      cache_out->data = malloc(cache_out->data_size);
+      memcpy(cache_out->data, (*obj)->getBufferStart(), cache_out->data_size);
+   }
+
+   Error err = lp_orc_jit->addObjectFile(*lib->jd, std::move(*obj));
+   if (err) {
+      debug_printf("gallivm: %s\n", toString(std::move(err)).c_str());
+      return false;
+   }
+   return true;
+}
+
+/**
+ * Add a previously compiled object to the lib.
+ */
+extern "C" bool
+lp_build_orc_add_object(struct lp_orc_lib *lib,
+                        const struct lp_cached_code *cache)
+{
+   using namespace llvm;
+
+   std::unique_ptr<MemoryBuffer> obj = MemoryBuffer::getMemBufferCopy(
+      StringRef((const char *)cache->data, cache->data_size));
+
+   Error err = lp_orc_jit->addObjectFile(*lib->jd, std::move(obj));
+   if (err) {
+      debug_printf("gallivm: %s\n", toString(std::move(err)).c_str());
+      return false;
+   }
+   return true;
+}
+
+/**
+ * Resolve an external symbol of the lib's objects to the given address,
+ * the orc equivalent of LLVMAddGlobalMapping.
+ */
+extern "C" void
+lp_build_orc_add_symbol(struct lp_orc_lib *lib,
+                        const char *name,
+                        void *addr)
+{
+   using namespace llvm;
+
+   orc::SymbolMap symbols;
+   symbols[lp_orc_jit->mangleAndIntern(name)] =
+      JITEvaluatedSymbol(pointerToJITTargetAddress(addr),
+                         JITSymbolFlags::Exported | JITSymbolFlags::Callable);
+
+   Error err = lib->jd->define(orc::absoluteSymbols(std::move(symbols)));
+   if (err)
+      debug_printf("gallivm: %s\n", toString(std::move(err)).c_str());
+}
+
+/**
+ * Look up a function by its IR name, linking the lib on first use.
+ */
+extern "C" void *
+lp_build_orc_lookup(struct lp_orc_lib *lib, const char *name)
+{
+   auto sym = lp_orc_jit->lookup(*lib->jd, name);
+   if (!sym) {
+      debug_printf("gallivm: %s\n", llvm::toString(sym.takeError()).c_str());
+      return NULL;
+   }
+#if LLVM_VERSION_MAJOR >= 15
+   return sym->toPtr<void *>();
+#else
+   return llvm::jitTargetAddressToPointer<void *>(sym->getAddress());
+#endif
+}
+
+/**
+ * Remove the lib from the session, freeing its code.
+ */
+extern "C" void
+lp_build_orc_free_lib(struct lp_orc_lib *lib)
+{
+   if (!lib)
+      return;
+
+   llvm::Error err = lp_orc_jit->getExecutionSession().removeJITDylib(*lib->jd);
+   if (err)
+      debug_printf("gallivm: %s\n", llvm::toString(std::move(err)).c_str());
+   delete lib;
+}
+#endif
+
 extern "C"
 void
 lp_free_generated_code(struct lp_generated_code *code)
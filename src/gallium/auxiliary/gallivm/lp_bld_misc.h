@@ -36,6 +36,19 @@
 #include <llvm-c/Target.h>
 
 
+/*
+ * Link all modules into one shared orc session rather than creating an
+ * MCJIT engine per module.  Needs the orc v2 interfaces of LLVM 14.
+ * Windows stays on MCJIT, which is told to emit ELF objects there.
+ * GALLIVM_PERF=no_orc goes back to MCJIT at runtime.
+ */
+#if LLVM_VERSION_MAJOR >= 14 && !defined(_WIN32)
+#define GALLIVM_USE_ORC 1
+#else
+#define GALLIVM_USE_ORC 0
+#endif
+
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -51,10 +64,18 @@ struct lp_cached_code {
    size_t data_size;
    bool dont_cache;
    void *jit_obj_cache;
+   /* IR instruction count the code was built from, stored along with it */
+   unsigned nr_instrs;
 };
 
 struct lp_generated_code;
 
+/* An external symbol resolved to a known address when loading code. */
+struct lp_symbol_mapping {
+   const char *name;
+   void *addr;
+};
+
 extern LLVMTargetLibraryInfoRef
 gallivm_create_target_library_info(const char *triple);
 
@@ -74,9 +95,46 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
                                         unsigned OptLevel,
                                         char **OutError);
 
+extern bool
+lp_build_load_cached_object(const struct lp_cached_code *cache,
+                            LLVMMCJITMemoryManagerRef MM,
+                            const struct lp_symbol_mapping *mappings,
+                            unsigned num_mappings,
+                            const char **names,
+                            void **code,
+                            unsigned count);
+
 extern void
 lp_free_generated_code(struct lp_generated_code *code);
 
+#if GALLIVM_USE_ORC
+struct lp_orc_lib;
+
+extern struct lp_orc_lib *
+lp_build_orc_create_lib(const char *name);
+
+extern bool
+lp_build_orc_add_module(struct lp_orc_lib *lib,
+                        LLVMModuleRef M,
+                        unsigned OptLevel,
+                        struct lp_cached_code *cache_out);
+
+extern bool
+lp_build_orc_add_object(struct lp_orc_lib *lib,
+                        const struct lp_cached_code *cache);
+
+extern void
+lp_build_orc_add_symbol(struct lp_orc_lib *lib,
+                        const char *name,
+                        void *addr);
+
+extern void *
+lp_build_orc_lookup(struct lp_orc_lib *lib, const char *name);
+
+extern void
+lp_build_orc_free_lib(struct lp_orc_lib *lib);
+#endif
+
 extern LLVMMCJITMemoryManagerRef
 lp_get_default_memory_manager();
 
@@ -2060,16 +2060,58 @@ lp_build_sample_partial_offset(struct lp_build_context *bld,
 }
 
 
+/**
+ * Compute the partial offset of a texel along an arbitrary axis of a
+ * tiled texture.
+ *
+ * Tiled textures store LP_SAMPLER_TILE_SIZE x LP_SAMPLER_TILE_SIZE texel
+ * tiles contiguously, row by row, with the tiles themselves laid out like
+ * the texels of a linear texture. Thus the offset is still separable:
+ *
+ *   offset = (coord & ~(TILE_SIZE - 1)) * stride + (coord & (TILE_SIZE - 1)) * step
+ *
+ * Only used for formats with 1x1 pixel blocks.
+ *
+ * @param coord   coordinate in pixels
+ * @param stride  number of bytes between successive tiles along the axis,
+ *                divided by LP_SAMPLER_TILE_SIZE
+ * @param step    number of bytes between successive pixels along the axis
+ *                within a tile
+ * @param out_offset    resulting relative offset of the pixel in bytes
+ */
+void
+lp_build_sample_tiled_partial_offset(struct lp_build_context *bld,
+                                     LLVMValueRef coord,
+                                     LLVMValueRef stride,
+                                     LLVMValueRef step,
+                                     LLVMValueRef *out_offset)
+{
+   LLVMBuilderRef builder = bld->gallivm->builder;
+   LLVMValueRef tile_mask = lp_build_const_int_vec(bld->gallivm, bld->type,
+                                                   LP_SAMPLER_TILE_SIZE - 1);
+   LLVMValueRef tile_coord, sub_coord;
+
+   sub_coord = LLVMBuildAnd(builder, coord, tile_mask, "");
+   tile_coord = LLVMBuildAnd(builder, coord, LLVMBuildNot(builder, tile_mask, ""), "");
+
+   *out_offset = lp_build_add(bld, lp_build_mul(bld, tile_coord, stride),
+                              lp_build_mul(bld, sub_coord, step));
+}
+
+
 /**
  * Compute the offset of a pixel block.
  *
  * x, y, z, y_stride, z_stride are vectors, and they refer to pixels.
+ * If tiled is set the texture uses the layout described in
+ * lp_build_sample_tiled_partial_offset().
  *
  * Returns the relative offset and i,j sub-block coordinates
  */
 void
 lp_build_sample_offset(struct lp_build_context *bld,
                        const struct util_format_description *format_desc,
+                       boolean tiled,
                        LLVMValueRef x,
                        LLVMValueRef y,
                        LLVMValueRef z,
@@ -2085,21 +2127,45 @@ lp_build_sample_offset(struct lp_build_context *bld,
    x_stride = lp_build_const_vec(bld->gallivm, bld->type,
                                  format_desc->block.bits/8);
 
-   lp_build_sample_partial_offset(bld,
-                                  format_desc->block.width,
-                                  x, x_stride,
-                                  &offset, out_i);
+   if (tiled) {
+      LLVMValueRef tile_row;
 
-   if (y && y_stride) {
-      LLVMValueRef y_offset;
-      lp_build_sample_partial_offset(bld,
-                                     format_desc->block.height,
-                                     y, y_stride,
-                                     &y_offset, out_j);
-      offset = lp_build_add(bld, offset, y_offset);
+      assert(format_desc->block.width == 1 && format_desc->block.height == 1);
+
+      /* bytes of one row of texels within a tile */
+      tile_row = lp_build_const_int_vec(bld->gallivm, bld->type,
+                                        LP_SAMPLER_TILE_SIZE *
+                                        format_desc->block.bits/8);
+
+      lp_build_sample_tiled_partial_offset(bld, x, tile_row, x_stride,
+                                           &offset);
+      *out_i = bld->zero;
+      *out_j = bld->zero;
+
+      if (y && y_stride) {
+         LLVMValueRef y_offset;
+         lp_build_sample_tiled_partial_offset(bld, y, y_stride, tile_row,
+                                              &y_offset);
+         offset = lp_build_add(bld, offset, y_offset);
+      }
    }
    else {
-      *out_j = bld->zero;
+      lp_build_sample_partial_offset(bld,
+                                     format_desc->block.width,
+                                     x, x_stride,
+                                     &offset, out_i);
+
+      if (y && y_stride) {
+         LLVMValueRef y_offset;
+         lp_build_sample_partial_offset(bld,
+                                        format_desc->block.height,
+                                        y, y_stride,
+                                        &y_offset, out_j);
+         offset = lp_build_add(bld, offset, y_offset);
+      }
+      else {
+         *out_j = bld->zero;
+      }
    }
 
    if (z && z_stride) {
@@ -100,6 +100,9 @@ enum lp_sampler_op_type {
 #define LP_SAMPLER_GATHER_COMP_MASK   (3 << 8)
 #define LP_SAMPLER_FETCH_MS          (1 << 10)
 
+/* Width and height in texels of the tiles of tiled textures */
+#define LP_SAMPLER_TILE_SIZE 4
+
 struct lp_sampler_params
 {
    struct lp_type type;
@@ -174,6 +177,11 @@ struct lp_static_texture_state
    unsigned pot_height:1;
    unsigned pot_depth:1;
    unsigned level_zero_only:1;
+
+   /* Texels are stored in LP_SAMPLER_TILE_SIZE x LP_SAMPLER_TILE_SIZE tiles
+    * instead of rows, see lp_build_sample_tiled_partial_offset().
+    */
+   unsigned tiled:1;
 };
 
 
@@ -664,9 +672,18 @@ lp_build_sample_partial_offset(struct lp_build_context *bld,
                                LLVMValueRef *out_i);
 
 
+void
+lp_build_sample_tiled_partial_offset(struct lp_build_context *bld,
+                                     LLVMValueRef coord,
+                                     LLVMValueRef stride,
+                                     LLVMValueRef step,
+                                     LLVMValueRef *out_offset);
+
+
 void
 lp_build_sample_offset(struct lp_build_context *bld,
                        const struct util_format_description *format_desc,
+                       boolean tiled,
                        LLVMValueRef x,
                        LLVMValueRef y,
                        LLVMValueRef z,
@@ -40,6 +40,42 @@
 #include "lp_bld_sample.h"
 
 
+/*
+ * Texture coord wrapping of the AoS paths, only exported for
+ * lp_test_tiling.
+ */
+void
+lp_build_sample_wrap_nearest_int(struct lp_build_sample_context *bld,
+                                 unsigned block_length,
+                                 LLVMValueRef coord,
+                                 LLVMValueRef coord_f,
+                                 LLVMValueRef length,
+                                 LLVMValueRef stride,
+                                 LLVMValueRef tile_step,
+                                 LLVMValueRef offset,
+                                 boolean is_pot,
+                                 unsigned wrap_mode,
+                                 LLVMValueRef *out_offset,
+                                 LLVMValueRef *out_i);
+
+void
+lp_build_sample_wrap_linear_int(struct lp_build_sample_context *bld,
+                                unsigned block_length,
+                                LLVMValueRef coord0,
+                                LLVMValueRef *weight_i,
+                                LLVMValueRef coord_f,
+                                LLVMValueRef length,
+                                LLVMValueRef stride,
+                                LLVMValueRef tile_step,
+                                LLVMValueRef offset,
+                                boolean is_pot,
+                                unsigned wrap_mode,
+                                LLVMValueRef *offset0,
+                                LLVMValueRef *offset1,
+                                LLVMValueRef *i0,
+                                LLVMValueRef *i1);
+
+
 void
 lp_build_sample_aos(struct lp_build_sample_context *bld,
                     unsigned sampler_unit,
@@ -141,6 +141,7 @@ lp_build_sample_texel_soa(struct lp_build_sample_context *bld,
    /* convert x,y,z coords to linear offset from start of texture, in bytes */
    lp_build_sample_offset(&bld->int_coord_bld,
                           bld->format_desc,
+                          bld->static_texture_state->tiled,
                           x, y, z, y_stride, z_stride,
                           &offset, &i, &j);
    if (mipoffsets) {
@@ -2719,6 +2720,7 @@ lp_build_fetch_texel(struct lp_build_sample_context *bld,
 
    lp_build_sample_offset(int_coord_bld,
                           bld->format_desc,
+                          bld->static_texture_state->tiled,
                           x, y, z, row_stride_vec, img_stride_vec,
                           &offset, &i, &j);
 
@@ -3471,6 +3473,19 @@ get_target_info(enum pipe_texture_target target,
 }
 
 
+/**
+ * Whether fetches from this format go through the decoded block cache.
+ */
+static boolean
+format_uses_block_cache(const struct util_format_description *format_desc)
+{
+   return format_desc->layout == UTIL_FORMAT_LAYOUT_S3TC ||
+          format_desc->format == PIPE_FORMAT_ETC1_RGB8 ||
+          format_desc->format == PIPE_FORMAT_BPTC_RGBA_UNORM ||
+          format_desc->format == PIPE_FORMAT_BPTC_SRGBA;
+}
+
+
 /**
  * Generate the function body for a texture sampling function.
  */
@@ -3519,7 +3534,7 @@ lp_build_sample_gen_func(struct gallivm_state *gallivm,
    if (dynamic_state->cache_ptr) {
       const struct util_format_description *format_desc;
       format_desc = util_format_description(static_texture_state->format);
-      if (format_desc && format_desc->layout == UTIL_FORMAT_LAYOUT_S3TC) {
+      if (format_desc && format_uses_block_cache(format_desc)) {
          need_cache = TRUE;
       }
    }
@@ -3645,7 +3660,7 @@ lp_build_sample_soa_func(struct gallivm_state *gallivm,
    if (dynamic_state->cache_ptr) {
       const struct util_format_description *format_desc;
       format_desc = util_format_description(static_texture_state->format);
-      if (format_desc && format_desc->layout == UTIL_FORMAT_LAYOUT_S3TC) {
+      if (format_desc && format_uses_block_cache(format_desc)) {
          need_cache = TRUE;
       }
    }
@@ -4217,6 +4232,7 @@ lp_build_img_op_soa(const struct lp_static_texture_state *static_texture_state,
    }
    lp_build_sample_offset(&int_coord_bld,
                           format_desc,
+                          FALSE, /* images are never tiled */
                           x, y, z, row_stride_vec, img_stride_vec,
                           &offset, &i, &j);
 
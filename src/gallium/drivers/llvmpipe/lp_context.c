@@ -60,6 +60,12 @@ static void llvmpipe_destroy( struct pipe_context *pipe )
 
    lp_print_counters();
 
+   /* Pending variant compiles reference the shaders, let them land first. */
+   if (util_queue_is_initialized(&llvmpipe->compile_queue)) {
+      util_queue_finish(&llvmpipe->compile_queue);
+      util_queue_destroy(&llvmpipe->compile_queue);
+   }
+
    if (llvmpipe->csctx) {
       lp_csctx_destroy(llvmpipe->csctx);
    }
@@ -232,6 +238,15 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    if (!llvmpipe->context)
       goto fail;
 
+   /* Tiered compilation rebuilds hot variants on the compile queue too. */
+   if ((llvmpipe_screen(screen)->num_compile_threads ||
+        llvmpipe_screen(screen)->tiered_compile_draws) &&
+       !util_queue_init(&llvmpipe->compile_queue, "lpcomp", 32,
+                        MAX2(llvmpipe_screen(screen)->num_compile_threads, 1),
+                        UTIL_QUEUE_INIT_RESIZE_IF_FULL |
+                        UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY))
+      goto fail;
+
    /*
     * Create drawing context and plug our rendering stage into it.
     */
@@ -35,6 +35,7 @@
 
 #include "draw/draw_vertex.h"
 #include "util/u_blitter.h"
+#include "util/u_queue.h"
 
 #include "lp_tex_sample.h"
 #include "lp_jit.h"
@@ -150,6 +151,7 @@ struct llvmpipe_context {
    struct blitter_context *blitter;
 
    unsigned tex_timestamp;
+   unsigned cs_tex_timestamp;
 
    /** List of all fragment shader variants */
    struct lp_fs_variant_list_item fs_variants_list;
@@ -177,6 +179,12 @@ struct llvmpipe_context {
    /** The LLVMContext to use for LLVM related work */
    LLVMContextRef context;
 
+   /** Background fragment shader variant compiles, if enabled */
+   struct util_queue compile_queue;
+
+   /** Currently bound fragment shader variant, for counting its draws */
+   struct lp_fragment_shader_variant *fs_variant;
+
    int max_global_buffers;
    struct pipe_resource **global_buffers;
 
@@ -30,6 +30,8 @@
 
 #include "util/u_thread.h"
 #include "util/u_memory.h"
+#include "util/u_math.h"
+#include "util/u_atomic.h"
 #include "lp_cs_tpool.h"
 
 static int
@@ -52,16 +54,32 @@ lp_cs_tpool_worker(void *data)
 
       task = list_first_entry(&pool->workqueue, struct lp_cs_tpool_task,
                               list);
-      unsigned this_iter = task->iter_start++;
+      task->active++;
+      mtx_unlock(&pool->m);
 
-      if (task->iter_start == task->iter_total)
-         list_del(&task->list);
+      for (;;) {
+         unsigned start = p_atomic_add_return(&task->iter_start,
+                                              task->iter_per_claim) -
+                          task->iter_per_claim;
+         unsigned end;
 
-      mtx_unlock(&pool->m);
-      task->work(task->data, this_iter, &lmem);
+         if (start >= task->iter_total)
+            break;
+
+         end = MIN2(start + task->iter_per_claim, task->iter_total);
+         for (unsigned i = start; i < end; i++)
+            task->work(task->data, i, &lmem);
+
+         p_atomic_add(&task->iter_finished, end - start);
+      }
+
+      /* Everything is claimed, the last worker out wakes the waiter. */
       mtx_lock(&pool->m);
-      task->iter_finished++;
-      if (task->iter_finished == task->iter_total)
+      if (task->queued) {
+         list_del(&task->list);
+         task->queued = false;
+      }
+      if (--task->active == 0)
          cnd_broadcast(&task->finish);
    }
    mtx_unlock(&pool->m);
@@ -81,7 +99,15 @@ lp_cs_tpool_create(unsigned num_threads)
    cnd_init(&pool->new_work);
 
    list_inithead(&pool->workqueue);
-   assert (num_threads <= LP_MAX_THREADS);
+   if (num_threads) {
+      pool->threads = CALLOC(num_threads, sizeof(*pool->threads));
+      if (!pool->threads) {
+         cnd_destroy(&pool->new_work);
+         mtx_destroy(&pool->m);
+         FREE(pool);
+         return NULL;
+      }
+   }
    pool->num_threads = num_threads;
    for (unsigned i = 0; i < num_threads; i++)
       pool->threads[i] = u_thread_create(lp_cs_tpool_worker, pool);
@@ -105,6 +131,7 @@ lp_cs_tpool_destroy(struct lp_cs_tpool *pool)
 
    cnd_destroy(&pool->new_work);
    mtx_destroy(&pool->m);
+   FREE(pool->threads);
    FREE(pool);
 }
 
@@ -131,11 +158,16 @@ lp_cs_tpool_queue_task(struct lp_cs_tpool *pool,
    task->work = work;
    task->data = data;
    task->iter_total = num_iters;
+   /* A few claims per thread keeps the load balanced without hitting the
+    * counter for every block.
+    */
+   task->iter_per_claim = MAX2(num_iters / (pool->num_threads * 4), 1);
    cnd_init(&task->finish);
 
    mtx_lock(&pool->m);
 
    list_addtail(&task->list, &pool->workqueue);
+   task->queued = true;
 
    cnd_broadcast(&pool->new_work);
    mtx_unlock(&pool->m);
@@ -152,7 +184,8 @@ lp_cs_tpool_wait_for_task(struct lp_cs_tpool *pool,
       return;
 
    mtx_lock(&pool->m);
-   while (task->iter_finished < task->iter_total)
+   while (p_atomic_read(&task->iter_finished) < task->iter_total ||
+          task->active || task->queued)
       cnd_wait(&task->finish, &pool->m);
    mtx_unlock(&pool->m);
 
@@ -28,6 +28,8 @@
  * The item is added to the work queue once, but it must execute
  * number of iterations times. This saves storing a bunch of queue
  * structs with just unique indexes in them.
+ * Workers claim chunks of iterations with an atomic counter, the pool
+ * mutex is only taken to pick up and retire a task.
  * It also supports a local memory support struct to be passed from
  * outside the thread exec function.
  */
@@ -45,7 +47,7 @@ struct lp_cs_tpool {
    mtx_t m;
    cnd_t new_work;
 
-   thrd_t threads[LP_MAX_THREADS];
+   thrd_t *threads;
    unsigned num_threads;
    struct list_head workqueue;
    bool shutdown;
@@ -64,8 +66,11 @@ struct lp_cs_tpool_task {
    struct list_head list;
    cnd_t finish;
    unsigned iter_total;
-   unsigned iter_start;
-   unsigned iter_finished;
+   unsigned iter_per_claim;
+   unsigned iter_start;     /**< next unclaimed iteration, atomic */
+   unsigned iter_finished;  /**< atomic */
+   unsigned active;         /**< workers holding the task, under the mutex */
+   bool queued;             /**< still on the workqueue */
 };
 
 struct lp_cs_tpool *lp_cs_tpool_create(unsigned num_threads);
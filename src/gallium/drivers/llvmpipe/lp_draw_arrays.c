@@ -39,6 +39,7 @@
 #include "lp_context.h"
 #include "lp_state.h"
 #include "lp_query.h"
+#include "lp_flush.h"
 
 #include "draw/draw_context.h"
 
@@ -86,6 +87,8 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info,
    if (lp->dirty)
       llvmpipe_update_derived( lp );
 
+   llvmpipe_count_fs_draw(lp);
+
    /*
     * Map vertex buffers
     */
@@ -97,6 +100,8 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info,
          if (!lp->vertex_buffer[i].buffer.resource) {
             continue;
          }
+         llvmpipe_wait_for_writes(pipe, lp->vertex_buffer[i].buffer.resource,
+                                  "vertex_buffer");
          buf = llvmpipe_resource_data(lp->vertex_buffer[i].buffer.resource);
          size = lp->vertex_buffer[i].buffer.resource->width0;
       }
@@ -108,6 +113,8 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info,
       unsigned available_space = ~0;
       mapped_indices = info->has_user_indices ? info->index.user : NULL;
       if (!mapped_indices) {
+         llvmpipe_wait_for_writes(pipe, info->index.resource,
+                                  "index_buffer");
          mapped_indices = llvmpipe_resource_data(info->index.resource);
          available_space = info->index.resource->width0;
       }
@@ -107,6 +107,10 @@ llvmpipe_flush_resource(struct pipe_context *pipe,
 {
    unsigned referenced;
 
+   /* Writes other than draws leave hierarchical Z stale */
+   if (!read_only)
+      llvmpipe_resource_invalidate_hiz(resource);
+
    referenced = llvmpipe_is_resource_referenced(pipe, resource, level);
 
    if ((referenced & LP_REFERENCED_FOR_WRITE) ||
@@ -131,3 +135,23 @@ llvmpipe_flush_resource(struct pipe_context *pipe,
 
    return TRUE;
 }
+
+
+/**
+ * Wait for the scenes that write a resource, query results as well as
+ * SSBO and image stores, before it is read without going through
+ * llvmpipe_flush_resource(): vertex, index and constant buffers are read
+ * directly by the draw module and setup.
+ */
+void
+llvmpipe_wait_for_writes(struct pipe_context *pipe,
+                         struct pipe_resource *resource,
+                         const char *reason)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+
+   if (resource &&
+       (lp_setup_is_resource_referenced(llvmpipe->setup, resource) &
+        LP_REFERENCED_FOR_WRITE))
+      llvmpipe_finish(pipe, reason);
+}
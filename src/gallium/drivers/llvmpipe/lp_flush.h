@@ -52,4 +52,9 @@ llvmpipe_flush_resource(struct pipe_context *pipe,
                         boolean do_not_block,
                         const char *reason);
 
+void
+llvmpipe_wait_for_writes(struct pipe_context *pipe,
+                         struct pipe_resource *resource,
+                         const char *reason);
+
 #endif
@@ -45,6 +45,7 @@ struct lp_counters
    unsigned nr_empty_64;
    unsigned nr_fully_covered_64;
    unsigned nr_partially_covered_64;
+   unsigned nr_hiz_occluded_64;
    unsigned nr_pure_shade_opaque_64;
    unsigned nr_pure_shade_64;
    unsigned nr_shade_64;
@@ -60,8 +61,14 @@ struct lp_counters
    int64_t llvm_compile_time;  /**< total, in microseconds */
 
    unsigned nr_color_tile_clear;
+   unsigned nr_color_tile_clear_elided;
    unsigned nr_color_tile_load;
    unsigned nr_color_tile_store;
+
+   unsigned nr_tiles;
+   unsigned nr_stolen_tiles;
+   int64_t tile_time;      /**< total, in nanoseconds */
+   int64_t tile_time_max;
 };
 
 
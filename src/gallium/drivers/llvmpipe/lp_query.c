@@ -53,13 +53,18 @@ llvmpipe_create_query(struct pipe_context *pipe,
                       unsigned type,
                       unsigned index)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   unsigned num_threads = MAX2(1, screen->num_threads);
    struct llvmpipe_query *pq;
 
    assert(type < PIPE_QUERY_TYPES);
 
-   pq = CALLOC_STRUCT( llvmpipe_query );
+   /* The per-thread counters live right after the query. */
+   pq = CALLOC(1, sizeof(*pq) + 2 * num_threads * sizeof(uint64_t));
 
    if (pq) {
+      pq->start = (uint64_t *)(pq + 1);
+      pq->end = pq->start + num_threads;
       pq->type = type;
       pq->index = index;
    }
@@ -190,50 +195,29 @@ llvmpipe_get_query_result(struct pipe_context *pipe,
    return true;
 }
 
-static void
-llvmpipe_get_query_result_resource(struct pipe_context *pipe,
-                                   struct pipe_query *q,
-                                   bool wait,
-                                   enum pipe_query_value_type result_type,
-                                   int index,
-                                   struct pipe_resource *resource,
-                                   unsigned offset)
+/**
+ * Write a query result to a buffer, as for get_query_result_resource.
+ * Also called by the rasterizer for results resolved at the end of a
+ * scene, see lp_setup_resolve_query().
+ */
+void
+llvmpipe_query_write_result(struct pipe_screen *screen,
+                            struct llvmpipe_query *pq,
+                            boolean available,
+                            enum pipe_query_value_type result_type,
+                            int index,
+                            struct pipe_resource *resource,
+                            unsigned offset)
 {
-   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
-   unsigned num_threads = MAX2(1, screen->num_threads);
-   struct llvmpipe_query *pq = llvmpipe_query(q);
-   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
-   bool unflushed = false;
-   bool unsignalled = false;
-   if (pq->fence) {
-      /* only have a fence if there was a scene */
-      if (!lp_fence_signalled(pq->fence)) {
-         unsignalled = true;
-         if (!lp_fence_issued(pq->fence))
-            unflushed = true;
-      }
-   }
-
-
+   unsigned num_threads = MAX2(1, llvmpipe_screen(screen)->num_threads);
    uint64_t value = 0, value2 = 0;
    unsigned num_values = 1;
-   if (index == -1)
-      if (unsignalled)
-         value = 0;
-      else
-         value = 1;
-   else {
-      unsigned i;
-
-      if (unflushed) {
-         llvmpipe_flush(pipe, NULL, __FUNCTION__);
-
-         if (!wait)
-            return;
-
-         lp_fence_wait(pq->fence);
-      }
+   unsigned i;
 
+   if (index == -1) {
+      value = available;
+   }
+   else {
       switch (pq->type) {
       case PIPE_QUERY_OCCLUSION_COUNTER:
          for (i = 0; i < num_threads; i++) {
@@ -320,7 +304,7 @@ llvmpipe_get_query_result_resource(struct pipe_context *pipe,
       }
    }
 
-   void *dst = (uint8_t *)lpr->data + offset;
+   void *dst = (uint8_t *)llvmpipe_resource(resource)->data + offset;
 
    for (unsigned i = 0; i < num_values; i++) {
 
@@ -360,23 +344,101 @@ llvmpipe_get_query_result_resource(struct pipe_context *pipe,
    }
 }
 
+
+/**
+ * Is the resource bound as a vertex or constant buffer?  Those are read
+ * directly by the draw module and setup, not through
+ * llvmpipe_flush_resource(), so they can't wait for a result written at
+ * the end of a scene.
+ */
+static boolean
+is_bound_for_read(const struct llvmpipe_context *llvmpipe,
+                  const struct pipe_resource *resource)
+{
+   unsigned i, sh;
+
+   for (i = 0; i < llvmpipe->num_vertex_buffers; i++) {
+      if (!llvmpipe->vertex_buffer[i].is_user_buffer &&
+          llvmpipe->vertex_buffer[i].buffer.resource == resource)
+         return TRUE;
+   }
+
+   for (sh = 0; sh < PIPE_SHADER_TYPES; sh++) {
+      for (i = 0; i < ARRAY_SIZE(llvmpipe->constants[sh]); i++) {
+         if (llvmpipe->constants[sh][i].buffer == resource)
+            return TRUE;
+      }
+   }
+
+   return FALSE;
+}
+
+
+static void
+llvmpipe_get_query_result_resource(struct pipe_context *pipe,
+                                   struct pipe_query *q,
+                                   bool wait,
+                                   enum pipe_query_value_type result_type,
+                                   int index,
+                                   struct pipe_resource *resource,
+                                   unsigned offset)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   struct llvmpipe_query *pq = llvmpipe_query(q);
+
+   if (pq->fence && !lp_fence_signalled(pq->fence)) {
+      /* only have a fence if there was a scene */
+      if (index == -1) {
+         llvmpipe_query_write_result(pipe->screen, pq, FALSE, result_type,
+                                     index, resource, offset);
+         return;
+      }
+
+      /* Have the rasterizer write the result once the scenes producing it
+       * are done, rather than waiting for them here.  Buffers bound for
+       * reading get the result right away, and ones bound later wait for
+       * it, see llvmpipe_wait_for_writes().
+       */
+      if (wait && !is_bound_for_read(llvmpipe, resource) &&
+          lp_setup_resolve_query(llvmpipe->setup, pq, result_type, index,
+                                 resource, offset))
+         return;
+
+      if (!lp_fence_issued(pq->fence))
+         llvmpipe_flush(pipe, NULL, __FUNCTION__);
+
+      if (!wait)
+         return;
+
+      lp_fence_wait(pq->fence);
+   }
+
+   llvmpipe_query_write_result(pipe->screen, pq, TRUE, result_type, index,
+                               resource, offset);
+}
+
 static bool
 llvmpipe_begin_query(struct pipe_context *pipe, struct pipe_query *q)
 {
    struct llvmpipe_context *llvmpipe = llvmpipe_context( pipe );
    struct llvmpipe_query *pq = llvmpipe_query(q);
+   unsigned num_threads = MAX2(1, llvmpipe_screen(pipe->screen)->num_threads);
 
    /* Check if the query is already in the scene.  If so, we need to
     * flush the scene now.  Real apps shouldn't re-use a query in a
-    * frame of rendering.
+    * frame of rendering.  Scenes in flight may still accumulate into it
+    * or resolve its result to a buffer, so wait for those too.
     */
    if (pq->fence && !lp_fence_issued(pq->fence)) {
       llvmpipe_finish(pipe, __FUNCTION__);
    }
+   else if (pq->fence && !lp_fence_signalled(pq->fence)) {
+      lp_fence_wait(pq->fence);
+   }
 
 
-   memset(pq->start, 0, sizeof(pq->start));
-   memset(pq->end, 0, sizeof(pq->end));
+   memset(pq->start, 0, num_threads * sizeof(*pq->start));
+   memset(pq->end, 0, num_threads * sizeof(*pq->end));
    lp_setup_begin_query(llvmpipe->setup, pq);
 
    switch (pq->type) {
@@ -510,6 +572,12 @@ llvmpipe_check_render_cond(struct llvmpipe_context *lp)
    uint64_t result;
 
    if (lp->render_cond_buffer) {
+      /* the predicate may be a query result the rasterizer hasn't written */
+      llvmpipe_flush_resource(pipe, &lp->render_cond_buffer->base, 0,
+                              TRUE, /* read_only */
+                              TRUE, /* cpu_access */
+                              FALSE, /* do_not_block */
+                              __FUNCTION__);
       uint32_t data = *(uint32_t *)((char *)lp->render_cond_buffer->data + lp->render_cond_offset);
       return (!data) == lp->render_cond_cond;
    }
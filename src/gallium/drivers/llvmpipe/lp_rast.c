@@ -32,8 +32,10 @@
 #include "util/u_surface.h"
 #include "util/u_pack_color.h"
 #include "util/u_string.h"
+#include "util/u_cpu_detect.h"
 #include "util/u_thread.h"
 #include "util/u_memset.h"
+#include "util/u_atomic.h"
 #include "util/os_time.h"
 
 #include "lp_scene_queue.h"
@@ -74,16 +76,41 @@ lp_rast_begin( struct lp_rasterizer *rast,
    LP_DBG(DEBUG_RAST, "%s\n", __FUNCTION__);
 
    lp_scene_begin_rasterization( scene );
-   lp_scene_bin_iter_begin( scene );
+   lp_scene_bin_iter_begin( scene, rast->num_threads );
 }
 
 
+/**
+ * Finish rasterizing a scene, once all threads are done with it.
+ * The rest of the scene is released by setup when the scene is reused,
+ * which can only happen after its fence has been signalled here.
+ */
 static void
 lp_rast_end( struct lp_rasterizer *rast )
 {
-   lp_scene_end_rasterization( rast->curr_scene );
+   struct lp_scene *scene = rast->curr_scene;
+   struct lp_fence *fence = NULL;
+   const struct lp_query_resolve *resolve;
+
+   lp_scene_unmap_framebuffer( scene );
+
+   /* All threads are done with the scene, query results are final */
+   for (resolve = scene->query_resolves; resolve; resolve = resolve->next) {
+      llvmpipe_query_write_result(scene->pipe->screen, resolve->pq, TRUE,
+                                  resolve->result_type, resolve->index,
+                                  resolve->resource, resolve->offset);
+   }
 
    rast->curr_scene = NULL;
+
+   /* Setup may drop the scene's reference as soon as it sees the fence
+    * signalled, hold our own until we're done signalling.
+    */
+   lp_fence_reference(&fence, scene->fence);
+   if (fence) {
+      lp_fence_signal(fence);
+      lp_fence_reference(&fence, NULL);
+   }
 }
 
 
@@ -112,6 +139,7 @@ lp_rast_tile_begin(struct lp_rasterizer_task *task,
 
    task->thread_data.vis_counter = 0;
    task->thread_data.ps_invocations = 0;
+   task->clear_pending = 0;
 
    for (i = 0; i < task->scene->fb.nr_cbufs; i++) {
       if (task->scene->fb.cbufs[i]) {
@@ -129,25 +157,17 @@ lp_rast_tile_begin(struct lp_rasterizer_task *task,
 
 
 /**
- * Clear the rasterizer's current color tile.
- * This is a bin command called during bin processing.
- * Clear commands always clear all bound layers.
+ * Write a pending color clear to the rasterizer's current tile.
+ * Clears always clear all bound layers.
  */
 static void
-lp_rast_clear_color(struct lp_rasterizer_task *task,
-                    const union lp_rast_cmd_arg arg)
+lp_rast_fill_color(struct lp_rasterizer_task *task,
+                   unsigned cbuf)
 {
    const struct lp_scene *scene = task->scene;
-   unsigned cbuf = arg.clear_rb->cbuf;
-   union util_color uc;
-   enum pipe_format format;
-
-   /* we never bin clear commands for non-existing buffers */
-   assert(cbuf < scene->fb.nr_cbufs);
-   assert(scene->fb.cbufs[cbuf]);
-
-   format = scene->fb.cbufs[cbuf]->format;
-   uc = arg.clear_rb->color_val;
+   const struct lp_rast_clear_rb *clear_rb = task->clear_rb[cbuf];
+   enum pipe_format format = scene->fb.cbufs[cbuf]->format;
+   union util_color uc = clear_rb->color_val;
 
    /*
     * this is pretty rough since we have target format (bunch of bytes...) here.
@@ -176,6 +196,61 @@ lp_rast_clear_color(struct lp_rasterizer_task *task,
 }
 
 
+/**
+ * Write out the color clears still pending on the current tile before
+ * executing a command which may read or partially write it.
+ *
+ * A shade_tile_opaque command overwrites every pixel of its only color
+ * buffer, in which case a pending clear of that buffer is simply dropped.
+ */
+static void
+lp_rast_resolve_clears(struct lp_rasterizer_task *task,
+                       unsigned cmd,
+                       const union lp_rast_cmd_arg arg)
+{
+   if (cmd == LP_RAST_OP_SHADE_TILE_OPAQUE &&
+       task->state &&
+       !arg.shade_tile->disable &&
+       task->scene->fb_max_layer == 0 &&
+       arg.shade_tile->layer + arg.shade_tile->view_index == 0 &&
+       (task->clear_pending & 1)) {
+      task->clear_pending &= ~1;
+      LP_COUNT(nr_color_tile_clear_elided);
+   }
+
+   while (task->clear_pending) {
+      unsigned cbuf = u_bit_scan(&task->clear_pending);
+      lp_rast_fill_color(task, cbuf);
+   }
+}
+
+
+/**
+ * Clear the rasterizer's current color tile.
+ * This is a bin command called during bin processing.
+ *
+ * The clear is only recorded here and written out by
+ * lp_rast_resolve_clears(), so that clears which are overwritten by a
+ * later clear or an opaque whole-tile draw never touch memory.
+ */
+static void
+lp_rast_clear_color(struct lp_rasterizer_task *task,
+                    const union lp_rast_cmd_arg arg)
+{
+   unsigned cbuf = arg.clear_rb->cbuf;
+
+   /* we never bin clear commands for non-existing buffers */
+   assert(cbuf < task->scene->fb.nr_cbufs);
+   assert(task->scene->fb.cbufs[cbuf]);
+
+   if (task->clear_pending & (1 << cbuf))
+      LP_COUNT(nr_color_tile_clear_elided);
+
+   task->clear_rb[cbuf] = arg.clear_rb;
+   task->clear_pending |= 1 << cbuf;
+}
+
+
 /**
  * Clear the rasterizer's current z/stencil tile.
  * This is a bin command called during bin processing.
@@ -367,22 +442,26 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
          task->thread_data.raster_state.viewport_index = inputs->viewport_index;
          task->thread_data.raster_state.view_index = inputs->view_index;
 
-         /* run shader on 4x4 block */
+         /* run shader on 4x4 block, the function may be swapped for an
+          * optimized build of the same variant at any time.
+          */
+         lp_jit_frag_func jit_func =
+            p_atomic_read_acquire(&variant->jit_function[RAST_WHOLE]);
          BEGIN_JIT_CALL(state, task);
-         variant->jit_function[RAST_WHOLE]( &state->jit_context,
-                                            tile_x + x, tile_y + y,
-                                            inputs->frontfacing,
-                                            GET_A0(inputs),
-                                            GET_DADX(inputs),
-                                            GET_DADY(inputs),
-                                            color,
-                                            depth,
-                                            mask,
-                                            &task->thread_data,
-                                            stride,
-                                            depth_stride,
-                                            sample_stride,
-                                            depth_sample_stride);
+         jit_func(&state->jit_context,
+                  tile_x + x, tile_y + y,
+                  inputs->frontfacing,
+                  GET_A0(inputs),
+                  GET_DADX(inputs),
+                  GET_DADY(inputs),
+                  color,
+                  depth,
+                  mask,
+                  &task->thread_data,
+                  stride,
+                  depth_stride,
+                  sample_stride,
+                  depth_sample_stride);
          END_JIT_CALL();
       }
    }
@@ -476,22 +555,26 @@ lp_rast_shade_quads_mask_sample(struct lp_rasterizer_task *task,
       task->thread_data.raster_state.viewport_index = inputs->viewport_index;
       task->thread_data.raster_state.view_index = inputs->view_index;
 
-      /* run shader on 4x4 block */
+      /* run shader on 4x4 block, the function may be swapped for an
+       * optimized build of the same variant at any time.
+       */
+      lp_jit_frag_func jit_func =
+         p_atomic_read_acquire(&variant->jit_function[RAST_EDGE_TEST]);
       BEGIN_JIT_CALL(state, task);
-      variant->jit_function[RAST_EDGE_TEST](&state->jit_context,
-                                            x, y,
-                                            inputs->frontfacing,
-                                            GET_A0(inputs),
-                                            GET_DADX(inputs),
-                                            GET_DADY(inputs),
-                                            color,
-                                            depth,
-                                            mask,
-                                            &task->thread_data,
-                                            stride,
-                                            depth_stride,
-                                            sample_stride,
-                                            depth_sample_stride);
+      jit_func(&state->jit_context,
+               x, y,
+               inputs->frontfacing,
+               GET_A0(inputs),
+               GET_DADX(inputs),
+               GET_DADY(inputs),
+               color,
+               depth,
+               mask,
+               &task->thread_data,
+               stride,
+               depth_stride,
+               sample_stride,
+               depth_sample_stride);
       END_JIT_CALL();
    }
 }
@@ -586,6 +669,10 @@ lp_rast_tile_end(struct lp_rasterizer_task *task)
 {
    unsigned i;
 
+   if (task->clear_pending)
+      lp_rast_resolve_clears(task, LP_RAST_OP_CLEAR_COLOR,
+                             lp_rast_arg_null());
+
    for (i = 0; i < task->scene->num_active_queries; ++i) {
       lp_rast_end_query(task, lp_rast_arg_query(task->scene->active_queries[i]));
    }
@@ -655,7 +742,18 @@ do_rasterize_bin(struct lp_rasterizer_task *task,
 
    for (block = bin->head; block; block = block->next) {
       for (k = 0; k < block->count; k++) {
-         dispatch[block->cmd[k]]( task, block->arg[k] );
+         unsigned cmd = block->cmd[k];
+
+         /* write out pending clears before the color buffers are used */
+         if (task->clear_pending &&
+             cmd != LP_RAST_OP_CLEAR_COLOR &&
+             cmd != LP_RAST_OP_CLEAR_ZSTENCIL &&
+             cmd != LP_RAST_OP_SET_STATE &&
+             cmd != LP_RAST_OP_BEGIN_QUERY &&
+             cmd != LP_RAST_OP_END_QUERY)
+            lp_rast_resolve_clears(task, cmd, block->arg[k]);
+
+         dispatch[cmd]( task, block->arg[k] );
       }
    }
 }
@@ -672,6 +770,13 @@ static void
 rasterize_bin(struct lp_rasterizer_task *task,
               const struct cmd_bin *bin, int x, int y )
 {
+#ifdef DEBUG
+   int64_t start = 0;
+
+   if (LP_DEBUG & DEBUG_COUNTERS)
+      start = os_time_get_nano();
+#endif
+
    lp_rast_tile_begin( task, bin, x, y );
 
    do_rasterize_bin(task, bin, x, y);
@@ -679,6 +784,16 @@ rasterize_bin(struct lp_rasterizer_task *task,
    lp_rast_tile_end(task);
 
 #ifdef DEBUG
+   if (LP_DEBUG & DEBUG_COUNTERS) {
+      int64_t time = os_time_get_nano() - start;
+
+      p_atomic_inc(&lp_count.nr_tiles);
+      p_atomic_add(&lp_count.tile_time, time);
+      /* racy, but good enough to spot outliers */
+      if (time > lp_count.tile_time_max)
+         lp_count.tile_time_max = time;
+   }
+
    /* Debug/Perf flags:
     */
    if (bin->head->count == 1) {
@@ -733,7 +848,8 @@ rasterize_scene(struct lp_rasterizer_task *task,
          int i, j;
 
          assert(scene);
-         while ((bin = lp_scene_bin_iter_next(scene, &i, &j))) {
+         while ((bin = lp_scene_bin_iter_next(scene, task->thread_index,
+                                              &i, &j))) {
             if (!is_empty_bin( bin ))
                rasterize_bin(task, bin, i, j);
          }
@@ -755,10 +871,6 @@ rasterize_scene(struct lp_rasterizer_task *task,
    }
 #endif
 
-   if (scene->fence) {
-      lp_fence_signal(scene->fence);
-   }
-
    task->scene = NULL;
 }
 
@@ -788,8 +900,6 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
       lp_rast_end( rast );
 
       util_fpstate_set(fpstate);
-
-      rast->curr_scene = NULL;
    }
    else {
       /* threaded rendering! */
@@ -807,23 +917,6 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
 }
 
 
-void
-lp_rast_finish( struct lp_rasterizer *rast )
-{
-   if (rast->num_threads == 0) {
-      /* nothing to do */
-   }
-   else {
-      int i;
-
-      /* wait for work to complete */
-      for (i = 0; i < rast->num_threads; i++) {
-         pipe_semaphore_wait(&rast->tasks[i].work_done);
-      }
-   }
-}
-
-
 /**
  * This is the thread's main entrypoint.
  * It's a simple loop:
@@ -882,17 +975,16 @@ thread_function(void *init_data)
       /* wait for all threads to finish with this scene */
       util_barrier_wait( &rast->barrier );
 
-      /* XXX: shouldn't be necessary:
+      /* thread[0]:
+       *  - unmap the framebuffer surfaces
+       *  - signal the scene's fence
        */
       if (task->thread_index == 0) {
          lp_rast_end( rast );
       }
 
-      /* signal done with work */
       if (debug)
          debug_printf("thread %d done working\n", task->thread_index);
-
-      pipe_semaphore_signal(&task->work_done);
    }
 
 #ifdef _WIN32
@@ -903,6 +995,32 @@ thread_function(void *init_data)
 }
 
 
+/**
+ * On CPUs made of several L3 cache domains (multi-die or multi-socket
+ * parts), keep each rasterizer thread within one domain, and give every
+ * domain a contiguous range of threads.  Threads then stop migrating away
+ * from the caches and memory holding the tiles they were working on.
+ */
+static void
+set_rast_thread_affinity(struct lp_rasterizer *rast)
+{
+   const struct util_cpu_caps_t *caps = util_get_cpu_caps();
+   unsigned i;
+
+   if (caps->num_L3_caches <= 1 || !caps->L3_affinity_mask ||
+       !debug_get_bool_option("LP_PIN_THREADS", TRUE))
+      return;
+
+   for (i = 0; i < rast->num_threads; i++) {
+      unsigned L3_index = i * caps->num_L3_caches / rast->num_threads;
+
+      util_set_thread_affinity(rast->threads[i],
+                               caps->L3_affinity_mask[L3_index],
+                               NULL, caps->num_cpu_mask_bits);
+   }
+}
+
+
 /**
  * Initialize semaphores and spawn the threads.
  */
@@ -922,6 +1040,8 @@ create_rast_threads(struct lp_rasterizer *rast)
          break;
       }
    }
+
+   set_rast_thread_affinity(rast);
 }
 
 
@@ -942,6 +1062,12 @@ lp_rast_create( unsigned num_threads )
       goto no_rast;
    }
 
+   rast->tasks = CALLOC(MAX2(1, num_threads), sizeof(*rast->tasks));
+   rast->threads = CALLOC(MAX2(1, num_threads), sizeof(*rast->threads));
+   if (!rast->tasks || !rast->threads) {
+      goto no_tasks;
+   }
+
    rast->full_scenes = lp_scene_queue_create();
    if (!rast->full_scenes) {
       goto no_full_scenes;
@@ -974,7 +1100,7 @@ lp_rast_create( unsigned num_threads )
    return rast;
 
 no_thread_data_cache:
-   for (i = 0; i < MAX2(1, rast->num_threads); i++) {
+   for (i = 0; i < MAX2(1, num_threads); i++) {
       if (rast->tasks[i].thread_data.cache) {
          align_free(rast->tasks[i].thread_data.cache);
       }
@@ -982,6 +1108,9 @@ no_thread_data_cache:
 
    lp_scene_queue_destroy(rast->full_scenes);
 no_full_scenes:
+no_tasks:
+   FREE(rast->tasks);
+   FREE(rast->threads);
    FREE(rast);
 no_rast:
    return NULL;
@@ -1030,6 +1159,8 @@ void lp_rast_destroy( struct lp_rasterizer *rast )
 
    lp_scene_queue_destroy(rast->full_scenes);
 
+   FREE(rast->tasks);
+   FREE(rast->threads);
    FREE(rast);
 }
 
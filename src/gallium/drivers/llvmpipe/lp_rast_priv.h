@@ -91,6 +91,10 @@ struct lp_rasterizer_task
    uint8_t *color_tiles[PIPE_MAX_COLOR_BUFS];
    uint8_t *depth_tile;
 
+   /** Color clears not written to the tile yet, see lp_rast_clear_color() */
+   unsigned clear_pending;
+   const struct lp_rast_clear_rb *clear_rb[PIPE_MAX_COLOR_BUFS];
+
    /** "back" pointer */
    struct lp_rasterizer *rast;
 
@@ -121,11 +125,11 @@ struct lp_rasterizer
    /** The scene currently being rasterized by the threads */
    struct lp_scene *curr_scene;
 
-   /** A task object for each rasterization thread */
-   struct lp_rasterizer_task tasks[LP_MAX_THREADS];
+   /** A task object for each rasterization thread, at least one */
+   struct lp_rasterizer_task *tasks;
 
    unsigned num_threads;
-   thrd_t threads[LP_MAX_THREADS];
+   thrd_t *threads;
 
    /** For synchronizing the rasterization threads */
    util_barrier barrier;
@@ -274,22 +278,26 @@ lp_rast_shade_quads_all( struct lp_rasterizer_task *task,
       task->thread_data.raster_state.viewport_index = inputs->viewport_index;
       task->thread_data.raster_state.view_index = inputs->view_index;
 
-      /* run shader on 4x4 block */
+      /* run shader on 4x4 block, the function may be swapped for an
+       * optimized build of the same variant at any time.
+       */
+      lp_jit_frag_func jit_func =
+         p_atomic_read_acquire(&variant->jit_function[RAST_WHOLE]);
       BEGIN_JIT_CALL(state, task);
-      variant->jit_function[RAST_WHOLE]( &state->jit_context,
-                                         x, y,
-                                         inputs->frontfacing,
-                                         GET_A0(inputs),
-                                         GET_DADX(inputs),
-                                         GET_DADY(inputs),
-                                         color,
-                                         depth,
-                                         mask,
-                                         &task->thread_data,
-                                         stride,
-                                         depth_stride,
-                                         sample_stride,
-                                         depth_sample_stride);
+      jit_func(&state->jit_context,
+               x, y,
+               inputs->frontfacing,
+               GET_A0(inputs),
+               GET_DADX(inputs),
+               GET_DADY(inputs),
+               color,
+               depth,
+               mask,
+               &task->thread_data,
+               stride,
+               depth_stride,
+               sample_stride,
+               depth_sample_stride);
       END_JIT_CALL();
    }
 }
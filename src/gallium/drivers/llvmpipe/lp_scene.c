@@ -29,6 +29,7 @@
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_inlines.h"
+#include "util/u_atomic.h"
 #include "util/simple_list.h"
 #include "util/format/u_format.h"
 #include "lp_scene.h"
@@ -36,6 +37,7 @@
 #include "lp_debug.h"
 #include "lp_context.h"
 #include "lp_state_fs.h"
+#include "lp_perf.h"
 
 
 #define RESOURCE_REF_SZ 32
@@ -51,6 +53,7 @@ struct resource_ref {
 /** List of shader variant references */
 struct shader_ref {
    struct lp_fragment_shader_variant *variant[SHADER_REF_SZ];
+   boolean tier0[SHADER_REF_SZ];     /* counted in variant->tier0_scenes */
    int count;
    struct shader_ref *next;
 };
@@ -101,8 +104,14 @@ lp_scene_destroy(struct lp_scene *scene)
 {
    lp_fence_reference(&scene->fence, NULL);
    mtx_destroy(&scene->mutex);
-   assert(scene->data.head->next == NULL);
-   FREE(scene->data.head);
+   for (unsigned i = 0; i < scene->max_deques; i++)
+      mtx_destroy(&scene->deques[i].mutex);
+   FREE(scene->deques);
+   FREE(scene->bin_refs);
+   if (scene->data.head) {
+      assert(scene->data.head->next == NULL);
+      FREE(scene->data.head);
+   }
    FREE(scene);
 }
 
@@ -221,12 +230,13 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
 
 
 /**
- * Free all the temporary data in a scene.
+ * Unmap the framebuffer surfaces mapped by lp_scene_begin_rasterization().
+ * Done by the rasterizer as soon as all bins have been executed.
  */
 void
-lp_scene_end_rasterization(struct lp_scene *scene )
+lp_scene_unmap_framebuffer(struct lp_scene *scene)
 {
-   int i, j;
+   int i;
 
    /* Unmap color buffers */
    for (i = 0; i < scene->fb.nr_cbufs; i++) {
@@ -249,6 +259,18 @@ lp_scene_end_rasterization(struct lp_scene *scene )
                               zsbuf->u.tex.first_layer);
       scene->zsbuf.map = NULL;
    }
+}
+
+
+/**
+ * Free all the temporary data in a scene.
+ */
+void
+lp_scene_end_rasterization(struct lp_scene *scene )
+{
+   int i, j;
+
+   lp_scene_unmap_framebuffer(scene);
 
    /* Reset all command lists:
     */
@@ -272,6 +294,11 @@ lp_scene_end_rasterization(struct lp_scene *scene )
       struct resource_ref *ref;
       int i, j = 0;
 
+      for (ref = scene->writeable_resources; ref; ref = ref->next) {
+         for (i = 0; i < ref->count; i++)
+            pipe_resource_reference(&ref->resource[i], NULL);
+      }
+
       for (ref = scene->resources; ref; ref = ref->next) {
          for (i = 0; i < ref->count; i++) {
             if (LP_DEBUG & DEBUG_SETUP)
@@ -302,6 +329,8 @@ lp_scene_end_rasterization(struct lp_scene *scene )
             if (LP_DEBUG & DEBUG_SETUP)
                debug_printf("shader %d: %p\n", j, (void *) ref->variant[i]);
             j++;
+            if (ref->tier0[i])
+               p_atomic_dec(&ref->variant[i]->tier0_scenes);
             lp_fs_variant_reference(llvmpipe_context(scene->pipe), &ref->variant[i], NULL);
          }
       }
@@ -325,7 +354,9 @@ lp_scene_end_rasterization(struct lp_scene *scene )
    lp_fence_reference(&scene->fence, NULL);
 
    scene->resources = NULL;
+   scene->writeable_resources = NULL;
    scene->frag_shaders = NULL;
+   scene->query_resolves = NULL;
    scene->scene_size = 0;
    scene->resource_reference_size = 0;
 
@@ -403,26 +434,29 @@ lp_scene_data_size( const struct lp_scene *scene )
 
 
 /**
- * Add a reference to a resource by the scene.
+ * Add a resource to a list of resource references, unless it is in the
+ * list already.
+ * \return -1 if out of memory, 0 if the resource was already listed, 1 if
+ * it was added.
  */
-boolean
-lp_scene_add_resource_reference(struct lp_scene *scene,
-                                struct pipe_resource *resource,
-                                boolean initializing_scene)
+static int
+add_resource_ref(struct lp_scene *scene,
+                 struct resource_ref **list,
+                 struct pipe_resource *resource)
 {
-   struct resource_ref *ref, **last = &scene->resources;
+   struct resource_ref *ref, **last = list;
    int i;
 
    /* Look at existing resource blocks:
     */
-   for (ref = scene->resources; ref; ref = ref->next) {
+   for (ref = *list; ref; ref = ref->next) {
       last = &ref->next;
 
       /* Search for this resource:
        */
       for (i = 0; i < ref->count; i++)
          if (ref->resource[i] == resource)
-            return TRUE;
+            return 0;
 
       if (ref->count < RESOURCE_REF_SZ) {
          /* If the block is half-empty, then append the reference here.
@@ -437,7 +471,7 @@ lp_scene_add_resource_reference(struct lp_scene *scene,
       assert(*last == NULL);
       *last = lp_scene_alloc(scene, sizeof *ref);
       if (*last == NULL)
-          return FALSE;
+          return -1;
 
       ref = *last;
       memset(ref, 0, sizeof *ref);
@@ -446,6 +480,47 @@ lp_scene_add_resource_reference(struct lp_scene *scene,
    /* Append the reference to the reference block.
     */
    pipe_resource_reference(&ref->resource[ref->count++], resource);
+   return 1;
+}
+
+
+static boolean
+is_resource_ref(const struct resource_ref *list,
+                const struct pipe_resource *resource)
+{
+   const struct resource_ref *ref;
+   int i;
+
+   for (ref = list; ref; ref = ref->next) {
+      for (i = 0; i < ref->count; i++)
+         if (ref->resource[i] == resource)
+            return TRUE;
+   }
+
+   return FALSE;
+}
+
+
+/**
+ * Add a reference to a resource by the scene.  Writeable resources are
+ * SSBOs and images the scene's shaders may store to.
+ */
+boolean
+lp_scene_add_resource_reference(struct lp_scene *scene,
+                                struct pipe_resource *resource,
+                                boolean initializing_scene,
+                                boolean writeable)
+{
+   int added;
+
+   if (writeable &&
+       add_resource_ref(scene, &scene->writeable_resources, resource) < 0)
+      return FALSE;
+
+   added = add_resource_ref(scene, &scene->resources, resource);
+   if (added <= 0)
+      return added == 0;
+
    scene->resource_reference_size += llvmpipe_resource_size(resource);
 
    /* Heuristic to advise scene flushes.  This isn't helpful in the
@@ -501,8 +576,14 @@ lp_scene_add_frag_shader_reference(struct lp_scene *scene,
       memset(ref, 0, sizeof *ref);
    }
 
-   /* Append the reference to the reference block.
+   /* Append the reference to the reference block.  Until its optimized
+    * code is installed, a tier0 variant's code may run in this scene.
     */
+   ref->tier0[ref->count] = variant->tier0 &&
+                            p_atomic_read_acquire(&variant->opt_state) !=
+                               LP_FS_OPT_INSTALLED;
+   if (ref->tier0[ref->count])
+      p_atomic_inc(&variant->tier0_scenes);
    lp_fs_variant_reference(llvmpipe_context(scene->pipe), &ref->variant[ref->count++], variant);
 
    return TRUE;
@@ -510,24 +591,57 @@ lp_scene_add_frag_shader_reference(struct lp_scene *scene,
 
 /**
  * Does this scene have a reference to the given resource?
+ * \return LP_REFERENCED_FOR_READ, and LP_REFERENCED_FOR_WRITE if the
+ * scene's shaders may store to it, or LP_UNREFERENCED.
  */
-boolean
+unsigned
 lp_scene_is_resource_referenced(const struct lp_scene *scene,
                                 const struct pipe_resource *resource)
 {
-   const struct resource_ref *ref;
-   int i;
+   if (is_resource_ref(scene->writeable_resources, resource))
+      return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
 
-   for (ref = scene->resources; ref; ref = ref->next) {
-      for (i = 0; i < ref->count; i++)
-         if (ref->resource[i] == resource)
-            return TRUE;
+   if (is_resource_ref(scene->resources, resource))
+      return LP_REFERENCED_FOR_READ;
+
+   return LP_UNREFERENCED;
+}
+
+
+/**
+ * Does this scene render to the given resource?
+ */
+boolean
+lp_scene_is_fb_referenced(const struct lp_scene *scene,
+                          const struct pipe_resource *resource)
+{
+   unsigned i;
+
+   for (i = 0; i < scene->fb.nr_cbufs; i++) {
+      if (scene->fb.cbufs[i] && scene->fb.cbufs[i]->texture == resource)
+         return TRUE;
    }
 
-   return FALSE;
+   return scene->fb.zsbuf && scene->fb.zsbuf->texture == resource;
 }
 
 
+/**
+ * Does this scene write a query result to the given resource?
+ */
+boolean
+lp_scene_is_query_target(const struct lp_scene *scene,
+                         const struct pipe_resource *resource)
+{
+   const struct lp_query_resolve *resolve;
+
+   for (resolve = scene->query_resolves; resolve; resolve = resolve->next) {
+      if (resolve->resource == resource)
+         return TRUE;
+   }
+
+   return FALSE;
+}
 
 
 /** advance curr_x,y to the next bin */
@@ -547,21 +661,136 @@ next_bin(struct lp_scene *scene)
 }
 
 
+/**
+ * Make sure there is a deque for each of num_threads threads.
+ */
+static boolean
+alloc_deques(struct lp_scene *scene, unsigned num_threads)
+{
+   unsigned i;
+
+   if (num_threads <= scene->max_deques)
+      return TRUE;
+
+   for (i = 0; i < scene->max_deques; i++)
+      mtx_destroy(&scene->deques[i].mutex);
+   FREE(scene->deques);
+   scene->max_deques = 0;
+
+   scene->deques = CALLOC(num_threads, sizeof(*scene->deques));
+   if (!scene->deques)
+      return FALSE;
+
+   for (i = 0; i < num_threads; i++)
+      (void) mtx_init(&scene->deques[i].mutex, mtx_plain);
+
+   scene->max_deques = num_threads;
+   return TRUE;
+}
+
+
+/**
+ * Prepare for handing out bins to num_threads rasterizer threads.
+ *
+ * The non-empty bins are collected in raster order and split into one
+ * contiguous range per thread, balanced by the number of commands in
+ * each bin.  Threads keep the spatial locality of their own range and
+ * only steal from others once it is done, see lp_scene_bin_iter_next().
+ */
 void
-lp_scene_bin_iter_begin( struct lp_scene *scene )
+lp_scene_bin_iter_begin( struct lp_scene *scene, unsigned num_threads )
 {
+   unsigned num_bins = scene->tiles_x * scene->tiles_y;
+   unsigned num_refs = 0;
+   uint64_t total = 0, sum = 0;
+   unsigned x, y, i, d;
+
    scene->curr_x = scene->curr_y = -1;
+   scene->use_deques = FALSE;
+
+   num_threads = MAX2(num_threads, 1);
+
+   if (num_bins > scene->max_bin_refs) {
+      FREE(scene->bin_refs);
+      scene->bin_refs = MALLOC(num_bins * sizeof(*scene->bin_refs));
+      scene->max_bin_refs = scene->bin_refs ? num_bins : 0;
+   }
+
+   /* Fall back to handing out bins in raster order */
+   if (!scene->bin_refs || !alloc_deques(scene, num_threads))
+      return;
+
+   for (y = 0; y < scene->tiles_y; y++) {
+      for (x = 0; x < scene->tiles_x; x++) {
+         const struct cmd_bin *bin = lp_scene_get_bin(scene, x, y);
+         const struct cmd_block *block;
+         unsigned cost = 0;
+
+         if (!bin->head)
+            continue;
+
+         for (block = bin->head; block; block = block->next)
+            cost += block->count;
+
+         /* even a bin without commands loads and stores the tile */
+         cost = MAX2(cost, 1);
+
+         scene->bin_refs[num_refs].x = x;
+         scene->bin_refs[num_refs].y = y;
+         scene->bin_refs[num_refs].cost = cost;
+         num_refs++;
+         total += cost;
+      }
+   }
+
+   for (d = 0; d < num_threads; d++) {
+      scene->deques[d].head = scene->deques[d].tail = num_refs;
+      scene->deques[d].cost = 0;
+   }
+
+   d = 0;
+   scene->deques[0].head = 0;
+   for (i = 0; i < num_refs; i++) {
+      if (d + 1 < num_threads && sum * num_threads >= total * (d + 1)) {
+         scene->deques[d].tail = i;
+         scene->deques[++d].head = i;
+      }
+      scene->deques[d].cost += scene->bin_refs[i].cost;
+      sum += scene->bin_refs[i].cost;
+   }
+   scene->deques[d].tail = num_refs;
+
+   scene->num_deques = num_threads;
+   scene->use_deques = TRUE;
+}
+
+
+static boolean
+deque_pop(const struct lp_scene *scene,
+          struct lp_scene_bin_deque *deque,
+          boolean steal,
+          struct lp_scene_bin_ref *ref)
+{
+   boolean found = FALSE;
+
+   mtx_lock(&deque->mutex);
+   if (deque->head < deque->tail) {
+      *ref = scene->bin_refs[steal ? --deque->tail : deque->head++];
+      p_atomic_add(&deque->cost, -(int)ref->cost);
+      found = TRUE;
+   }
+   mtx_unlock(&deque->mutex);
+
+   return found;
 }
 
 
 /**
- * Return pointer to next bin to be rendered.
+ * Return pointer to next bin to be rendered, in raster order.
  * The lp_scene::curr_x and ::curr_y fields will be advanced.
- * Multiple rendering threads will call this function to get a chunk
- * of work (a bin) to work on.
  */
-struct cmd_bin *
-lp_scene_bin_iter_next( struct lp_scene *scene , int *x, int *y)
+static struct cmd_bin *
+bin_iter_next_in_order( struct lp_scene *scene , int *x, int *y)
 {
    struct cmd_bin *bin = NULL;
 
@@ -588,6 +817,50 @@ end:
 }
 
 
+/**
+ * Return pointer to next bin to be rendered by the given thread.
+ * Multiple rendering threads will call this function to get a chunk
+ * of work (a bin) to work on.  Bins come from the thread's own deque
+ * first, then from the back of whichever deque has the most work left.
+ */
+struct cmd_bin *
+lp_scene_bin_iter_next( struct lp_scene *scene, unsigned thread_index,
+                        int *x, int *y)
+{
+   struct lp_scene_bin_ref ref;
+
+   if (!scene->use_deques)
+      return bin_iter_next_in_order(scene, x, y);
+
+   if (!deque_pop(scene, &scene->deques[thread_index % scene->num_deques],
+                  FALSE, &ref)) {
+      for (;;) {
+         unsigned i, victim = 0, max_cost = 0;
+
+         for (i = 0; i < scene->num_deques; i++) {
+            unsigned cost = p_atomic_read(&scene->deques[i].cost);
+            if (cost > max_cost) {
+               max_cost = cost;
+               victim = i;
+            }
+         }
+
+         if (!max_cost)
+            return NULL;
+
+         if (deque_pop(scene, &scene->deques[victim], TRUE, &ref)) {
+            LP_COUNT(nr_stolen_tiles);
+            break;
+         }
+      }
+   }
+
+   *x = ref.x;
+   *y = ref.y;
+   return lp_scene_get_bin(scene, ref.x, ref.y);
+}
+
+
 void lp_scene_begin_binning(struct lp_scene *scene,
                             struct pipe_framebuffer_state *fb)
 {
@@ -649,3 +922,98 @@ void lp_scene_end_binning( struct lp_scene *scene )
          lp_debug_bins( scene );
    }
 }
+
+
+/**
+ * Prepare a private scene for binning part of a draw on a binning thread.
+ * Only the state the triangle binning code looks at is copied, the
+ * framebuffer surfaces are not referenced.  Allocations are limited to
+ * size_budget bytes so the merged scene stays within LP_SCENE_MAX_SIZE.
+ */
+boolean
+lp_scene_begin_private(struct lp_scene *priv,
+                       const struct lp_scene *scene,
+                       unsigned size_budget)
+{
+   if (!priv->data.head) {
+      priv->data.head = CALLOC_STRUCT(data_block);
+      if (!priv->data.head)
+         return FALSE;
+   }
+
+   assert(priv->data.head->next == NULL);
+   assert(priv->data.head->used == 0);
+
+   priv->fb = scene->fb;
+   priv->tiles_x = scene->tiles_x;
+   priv->tiles_y = scene->tiles_y;
+   priv->fb_max_layer = scene->fb_max_layer;
+   priv->fb_max_samples = scene->fb_max_samples;
+   memcpy(priv->fixed_sample_pos, scene->fixed_sample_pos,
+          sizeof(priv->fixed_sample_pos));
+   priv->had_queries = scene->had_queries;
+   priv->alloc_failed = FALSE;
+   priv->scene_size = LP_SCENE_MAX_SIZE - MIN2(size_budget, LP_SCENE_MAX_SIZE);
+
+   return TRUE;
+}
+
+
+/**
+ * Finish a private scene.  If merge is true, its bins are appended to the
+ * matching bins of the scene and its data blocks handed over to it,
+ * otherwise everything binned into it is dropped.  The private scene is
+ * left empty either way.
+ */
+void
+lp_scene_end_private(struct lp_scene *scene,
+                     struct lp_scene *priv,
+                     boolean merge)
+{
+   struct data_block *block, *tmp;
+   unsigned x, y;
+
+   for (y = 0; y < priv->tiles_y; y++) {
+      for (x = 0; x < priv->tiles_x; x++) {
+         struct cmd_bin *src = lp_scene_get_bin(priv, x, y);
+
+         if (merge && src->head) {
+            struct cmd_bin *dst = lp_scene_get_bin(scene, x, y);
+
+            if (dst->tail)
+               dst->tail->next = src->head;
+            else
+               dst->head = src->head;
+            dst->tail = src->tail;
+            dst->last_state = src->last_state;
+         }
+
+         src->head = NULL;
+         src->tail = NULL;
+         src->last_state = NULL;
+      }
+   }
+
+   if (merge) {
+      /* Splice the private blocks in behind the scene's current block, so
+       * they are freed along with the scene once it has been rasterized.
+       */
+      for (block = priv->data.head; block->next; block = block->next)
+         scene->scene_size += sizeof *block;
+      scene->scene_size += sizeof *block;
+
+      block->next = scene->data.head->next;
+      scene->data.head->next = priv->data.head;
+      priv->data.head = NULL;
+   }
+   else {
+      for (block = priv->data.head->next; block; block = tmp) {
+         tmp = block->next;
+         FREE(block);
+      }
+      priv->data.head->next = NULL;
+      priv->data.head->used = 0;
+   }
+
+   memset(&priv->fb, 0, sizeof priv->fb);
+}
@@ -119,6 +119,41 @@ struct resource_ref;
 
 struct shader_ref;
 
+
+/**
+ * A non-empty bin and the number of commands in it, which is used as the
+ * estimate of how long it takes to rasterize.
+ */
+struct lp_scene_bin_ref {
+   uint16_t x, y;
+   unsigned cost;
+};
+
+
+/**
+ * One rasterizer thread's share of the bins, a range of
+ * lp_scene::bin_refs.  The owner takes bins from the head, threads that
+ * ran out of work steal from the tail.
+ */
+struct lp_scene_bin_deque {
+   mtx_t mutex;
+   unsigned head, tail;
+   unsigned cost;       /**< total cost of the bins left */
+};
+
+/**
+ * A query result to write to a buffer once the scene has been rasterized,
+ * see lp_setup_resolve_query().
+ */
+struct lp_query_resolve {
+   struct llvmpipe_query *pq;
+   struct pipe_resource *resource;
+   unsigned offset;
+   enum pipe_query_value_type result_type;
+   int index;
+   struct lp_query_resolve *next;
+};
+
 /**
  * All bins and bin data are contained here.
  * Per-bin data goes into the 'tile' bins.
@@ -137,6 +172,9 @@ struct lp_scene {
    /* If queries were either active or there were begin/end query commands */
    boolean had_queries;
 
+   /* Query results to write out at the end of the scene */
+   struct lp_query_resolve *query_resolves;
+
    /* Framebuffer mappings - valid only between begin_rasterization()
     * and end_rasterization().
     */
@@ -164,6 +202,9 @@ struct lp_scene {
    /** list of resources referenced by the scene commands */
    struct resource_ref *resources;
 
+   /** the SSBOs and images of those, which the scene may write */
+   struct resource_ref *writeable_resources;
+
    /** list of frag shaders referenced by the scene commands */
    struct shader_ref *frag_shaders;
 
@@ -188,6 +229,13 @@ struct lp_scene {
    int curr_x, curr_y;  /**< for iterating over bins */
    mtx_t mutex;
 
+   /** Non-empty bins in raster order, split into per-thread deques */
+   struct lp_scene_bin_ref *bin_refs;
+   unsigned max_bin_refs;
+   struct lp_scene_bin_deque *deques;
+   unsigned num_deques, max_deques;
+   boolean use_deques;
+
    struct cmd_bin tile[TILES_X][TILES_Y];
    struct data_block_list data;
 };
@@ -209,11 +257,18 @@ struct cmd_block *lp_scene_new_cmd_block( struct lp_scene *scene,
 
 boolean lp_scene_add_resource_reference(struct lp_scene *scene,
                                         struct pipe_resource *resource,
-                                        boolean initializing_scene);
+                                        boolean initializing_scene,
+                                        boolean writeable);
 
-boolean lp_scene_is_resource_referenced(const struct lp_scene *scene,
+unsigned lp_scene_is_resource_referenced(const struct lp_scene *scene,
                                         const struct pipe_resource *resource );
 
+boolean lp_scene_is_fb_referenced(const struct lp_scene *scene,
+                                  const struct pipe_resource *resource);
+
+boolean lp_scene_is_query_target(const struct lp_scene *scene,
+                                 const struct pipe_resource *resource);
+
 boolean lp_scene_add_frag_shader_reference(struct lp_scene *scene,
                                            struct lp_fragment_shader_variant *variant);
 
@@ -395,10 +450,11 @@ lp_scene_get_num_bins( const struct lp_scene *scene )
 
 
 void
-lp_scene_bin_iter_begin( struct lp_scene *scene );
+lp_scene_bin_iter_begin( struct lp_scene *scene, unsigned num_threads );
 
 struct cmd_bin *
-lp_scene_bin_iter_next( struct lp_scene *scene, int *x, int *y );
+lp_scene_bin_iter_next( struct lp_scene *scene, unsigned thread_index,
+                        int *x, int *y );
 
 
 
@@ -412,11 +468,27 @@ void
 lp_scene_end_binning(struct lp_scene *scene);
 
 
+/* Private scenes, used to bin parts of a draw on other threads
+ */
+boolean
+lp_scene_begin_private(struct lp_scene *priv,
+                       const struct lp_scene *scene,
+                       unsigned size_budget);
+
+void
+lp_scene_end_private(struct lp_scene *scene,
+                     struct lp_scene *priv,
+                     boolean merge);
+
+
 /* Begin/end rasterization of a scene
  */
 void
 lp_scene_begin_rasterization(struct lp_scene *scene);
 
+void
+lp_scene_unmap_framebuffer(struct lp_scene *scene);
+
 void
 lp_scene_end_rasterization(struct lp_scene *scene);
 
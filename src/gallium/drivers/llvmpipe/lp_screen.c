@@ -89,6 +89,7 @@ static const struct debug_named_value lp_perf_flags[] = {
    { "no_blend",       PERF_NO_BLEND, NULL },
    { "no_depth",       PERF_NO_DEPTH, NULL },
    { "no_alphatest",   PERF_NO_ALPHATEST, NULL },
+   { "no_hiz",         PERF_NO_HIZ, NULL },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -855,13 +856,25 @@ void lp_disk_cache_find_shader(struct llvmpipe_screen *screen,
 
    size_t binary_size;
    uint8_t *buffer = disk_cache_get(screen->disk_shader_cache, sha1, &binary_size);
+   if (buffer && binary_size <= sizeof(uint32_t)) {
+      free(buffer);
+      buffer = NULL;
+   }
    if (!buffer) {
       cache->data_size = 0;
       p_atomic_inc(&screen->num_disk_shader_cache_misses);
       return;
    }
+
+   /* The entry starts with the instruction count, see below */
+   uint32_t nr_instrs;
+   memcpy(&nr_instrs, buffer, sizeof(nr_instrs));
+   binary_size -= sizeof(nr_instrs);
+   memmove(buffer, buffer + sizeof(nr_instrs), binary_size);
+
    cache->data_size = binary_size;
    cache->data = buffer;
+   cache->nr_instrs = nr_instrs;
    p_atomic_inc(&screen->num_disk_shader_cache_hits);
 }
 
@@ -874,7 +887,19 @@ void lp_disk_cache_insert_shader(struct llvmpipe_screen *screen,
    if (!screen->disk_shader_cache || !cache->data_size || cache->dont_cache)
       return;
    disk_cache_compute_key(screen->disk_shader_cache, ir_sha1_cache_key, 20, sha1);
-   disk_cache_put(screen->disk_shader_cache, sha1, cache->data, cache->data_size, NULL);
+
+   /* Store the instruction count in front of the code, so variants loaded
+    * from the cache still count towards LP_MAX_SHADER_INSTRUCTIONS.
+    */
+   uint32_t nr_instrs = cache->nr_instrs;
+   size_t size = sizeof(nr_instrs) + cache->data_size;
+   uint8_t *buffer = malloc(size);
+   if (!buffer)
+      return;
+   memcpy(buffer, &nr_instrs, sizeof(nr_instrs));
+   memcpy(buffer + sizeof(nr_instrs), cache->data, cache->data_size);
+   disk_cache_put(screen->disk_shader_cache, sha1, buffer, size, NULL);
+   free(buffer);
 }
 /**
  * Create a new pipe_screen object
@@ -937,7 +962,13 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->num_threads = 0;
 #endif
    screen->num_threads = debug_get_num_option("LP_NUM_THREADS", screen->num_threads);
-   screen->num_threads = MIN2(screen->num_threads, LP_MAX_THREADS);
+   screen->num_compile_threads = debug_get_num_option("LP_NUM_COMPILE_THREADS", 0);
+   screen->num_bin_threads = debug_get_num_option("LP_NUM_BIN_THREADS", 0);
+   screen->decompress_texture_threshold =
+      debug_get_num_option("LP_DECOMPRESS_TEXTURES", 0);
+   screen->tiled_textures = debug_get_bool_option("LP_TILED_TEXTURES", FALSE);
+   screen->tiered_compile_draws =
+      debug_get_num_option("LP_TIERED_COMPILE", 0);
 
    screen->rast = lp_rast_create(screen->num_threads);
    if (!screen->rast) {
@@ -947,7 +978,10 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    }
    (void) mtx_init(&screen->rast_mutex, mtx_plain);
 
-   screen->cs_tpool = lp_cs_tpool_create(screen->num_threads);
+   screen->num_cs_threads = debug_get_num_option("LP_NUM_CS_THREADS",
+                                                 screen->num_threads);
+
+   screen->cs_tpool = lp_cs_tpool_create(screen->num_cs_threads);
    if (!screen->cs_tpool) {
       lp_rast_destroy(screen->rast);
       lp_jit_screen_cleanup(screen);
@@ -51,6 +51,34 @@ struct llvmpipe_screen
 
    unsigned num_threads;
 
+   /* Number of compute shader threads, defaults to num_threads. */
+   unsigned num_cs_threads;
+
+   /* Number of background threads per context compiling fragment shader
+    * variants ahead of the draw that needs them, zero to compile at draw
+    * time only.
+    */
+   unsigned num_compile_threads;
+
+   /* Number of threads per context binning large triangle batches in
+    * parallel with the application thread, zero to bin serially.
+    */
+   unsigned num_bin_threads;
+
+   /* Compressed textures of at least this many KiB keep an uncompressed
+    * copy for sampling, zero to always sample the compressed data.
+    */
+   unsigned decompress_texture_threshold;
+
+   /* Store sampled-only textures in tiles rather than rows. */
+   bool tiled_textures;
+
+   /* Fragment shader variants are first compiled without optimizations,
+    * and rebuilt optimized in the background once drawn with this many
+    * times.  Zero to always compile optimized.
+    */
+   unsigned tiered_compile_draws;
+
    /* Increments whenever textures are modified.  Contexts can track this.
     */
    unsigned timestamp;
@@ -64,26 +64,80 @@ static boolean set_scene_state( struct lp_setup_context *, enum setup_state,
 static boolean try_update_scene_state( struct lp_setup_context *setup );
 
 
+/**
+ * Is the rasterizer done with this scene?  Such scenes only hold on to
+ * their resources until they are recycled.
+ */
+static boolean
+scene_is_idle(const struct lp_setup_context *setup,
+              const struct lp_scene *scene)
+{
+   if (scene == setup->scene)
+      return FALSE;
+
+   return !scene->fence ||
+          (scene->fence->issued && lp_fence_signalled(scene->fence));
+}
+
+
+/**
+ * Release the data and resources of scenes the rasterizer has finished.
+ */
+static void
+lp_setup_retire_scenes(struct lp_setup_context *setup)
+{
+   unsigned i;
+
+   for (i = 0; i < setup->num_scenes; i++) {
+      struct lp_scene *scene = setup->scenes[i];
+
+      if (scene->fence && scene_is_idle(setup, scene))
+         lp_scene_end_rasterization(scene);
+   }
+}
+
+
 static void
 lp_setup_get_empty_scene(struct lp_setup_context *setup)
 {
+   struct lp_scene *scene = NULL;
+   unsigned i;
+
    assert(setup->scene == NULL);
 
-   setup->scene_idx++;
-   setup->scene_idx %= ARRAY_SIZE(setup->scenes);
+   lp_setup_retire_scenes(setup);
+
+   for (i = 0; i < setup->num_scenes; i++) {
+      if (!setup->scenes[i]->fence) {
+         scene = setup->scenes[i];
+         break;
+      }
+   }
+
+   if (!scene && setup->num_scenes < MAX_SCENES) {
+      scene = lp_scene_create(setup->pipe);
+      if (scene)
+         setup->scenes[setup->num_scenes++] = scene;
+   }
 
-   setup->scene = setup->scenes[setup->scene_idx];
+   if (!scene) {
+      /* All scenes are in flight, wait for the oldest one */
+      for (i = 0; i < setup->num_scenes; i++) {
+         if (!scene || setup->scenes[i]->fence->id < scene->fence->id)
+            scene = setup->scenes[i];
+      }
 
-   if (setup->scene->fence) {
       if (LP_DEBUG & DEBUG_SETUP)
          debug_printf("%s: wait for scene %d\n",
-                      __FUNCTION__, setup->scene->fence->id);
+                      __FUNCTION__, scene->fence->id);
 
-      lp_fence_wait(setup->scene->fence);
+      lp_fence_wait(scene->fence);
+      lp_scene_end_rasterization(scene);
    }
 
-   lp_scene_begin_binning(setup->scene, &setup->fb);
+   setup->scene = scene;
 
+   lp_scene_begin_binning(setup->scene, &setup->fb);
 }
 
 
@@ -166,23 +220,14 @@ lp_setup_rasterize_scene( struct lp_setup_context *setup )
    if (setup->last_fence)
       setup->last_fence->issued = TRUE;
 
-   mtx_lock(&screen->rast_mutex);
-
-   /* FIXME: We enqueue the scene then wait on the rasterizer to finish.
-    * This means we never actually run any vertex stuff in parallel to
-    * rasterization (not in the same context at least) which is what the
-    * multiple scenes per setup is about - when we get a new empty scene
-    * any old one is already empty again because we waited here for
-    * raster tasks to be finished. Ideally, we shouldn't need to wait here
-    * and rely on fences elsewhere when waiting is necessary.
-    * Certainly, lp_scene_end_rasterization() would need to be deferred too
-    * and there's probably other bits why this doesn't actually work.
+   /* Don't wait for the rasterizer.  The scene is recycled by
+    * lp_setup_get_empty_scene() once its fence has signalled, anything
+    * needing the results waits on the fence.
     */
+   mtx_lock(&screen->rast_mutex);
    lp_rast_queue_scene(screen->rast, scene);
-   lp_rast_finish(screen->rast);
    mtx_unlock(&screen->rast_mutex);
 
-   lp_scene_end_rasterization(setup->scene);
    lp_setup_reset( setup );
 
    LP_DBG(DEBUG_SETUP, "%s done \n", __FUNCTION__);
@@ -202,7 +247,7 @@ begin_binning( struct lp_setup_context *setup )
 
    /* Always create a fence:
     */
-   scene->fence = lp_fence_create(MAX2(1, setup->num_threads));
+   scene->fence = lp_fence_create(1);
    if (!scene->fence)
       return FALSE;
 
@@ -368,6 +413,144 @@ lp_setup_flush( struct lp_setup_context *setup,
 }
 
 
+/**
+ * Wait for the scenes already handed to the rasterizer.  Flushing doesn't
+ * wait for them, but work done on the context thread, like compute
+ * dispatches, may read what they render.
+ */
+void
+lp_setup_wait_rasterized( struct lp_setup_context *setup )
+{
+   if (setup->last_fence && !lp_fence_signalled(setup->last_fence))
+      lp_fence_wait(setup->last_fence);
+}
+
+
+static void
+lp_setup_hiz_reset(struct lp_setup_context *setup, float max_depth)
+{
+   unsigned i;
+
+   for (i = 0; i < setup->hiz.tiles_x * setup->hiz.tiles_y; i++)
+      setup->hiz.max_depth[i] = max_depth;
+}
+
+
+/**
+ * Set up hierarchical Z for the newly bound depth buffer, with every tile
+ * unknown until it is cleared or drawn to.  Layered and multisampled depth
+ * buffers don't get any.
+ */
+static void
+lp_setup_hiz_bind(struct lp_setup_context *setup)
+{
+   const struct pipe_surface *zsbuf = setup->fb.zsbuf;
+   const struct util_format_description *desc;
+   const struct util_format_channel_description *chan;
+
+   FREE(setup->hiz.max_depth);
+   setup->hiz.max_depth = NULL;
+   setup->hiz.tiles_x = 0;
+   setup->hiz.tiles_y = 0;
+   setup->hiz.test = FALSE;
+   setup->hiz.write = FALSE;
+
+   if (!zsbuf || (LP_PERF & PERF_NO_HIZ))
+      return;
+
+   desc = util_format_description(zsbuf->format);
+   if (!util_format_has_depth(desc) ||
+       zsbuf->texture->nr_samples > 1 ||
+       util_framebuffer_get_num_layers(&setup->fb) > 1)
+      return;
+
+   setup->hiz.tiles_x = DIV_ROUND_UP(setup->fb.width, TILE_SIZE);
+   setup->hiz.tiles_y = DIV_ROUND_UP(setup->fb.height, TILE_SIZE);
+   setup->hiz.max_depth = MALLOC(setup->hiz.tiles_x * setup->hiz.tiles_y *
+                                 sizeof *setup->hiz.max_depth);
+   if (!setup->hiz.max_depth) {
+      setup->hiz.tiles_x = 0;
+      setup->hiz.tiles_y = 0;
+      return;
+   }
+
+   /*
+    * Allow for the rounding of both the stored and the tested depth values,
+    * and for the rasterizer interpolating depth in single precision.
+    */
+   chan = &desc->channel[desc->swizzle[0]];
+   setup->hiz.unorm = chan->type == UTIL_FORMAT_TYPE_UNSIGNED &&
+                      chan->normalized;
+   setup->hiz.epsilon = 1.0f / (1 << 16);
+   if (setup->hiz.unorm)
+      setup->hiz.epsilon += (float)(2.0 / (double)((1ull << chan->size) - 1));
+
+   /* we're about to render to it, let other contexts know */
+   setup->hiz.generation =
+      p_atomic_inc_return(&llvmpipe_resource(zsbuf->texture)->hiz_generation);
+
+   lp_setup_hiz_reset(setup, FLT_MAX);
+}
+
+
+/**
+ * The depth buffer may also be written by other contexts, or mapped and
+ * copied to, behind max_depth's back.  Those writes bump the resource's
+ * hiz_generation, drop max_depth if it moved since we last looked.  When
+ * about to write depth ourselves, bump it too for the other contexts.
+ */
+static void
+lp_setup_hiz_sync(struct lp_setup_context *setup, boolean write)
+{
+   struct llvmpipe_resource *lpr = llvmpipe_resource(setup->fb.zsbuf->texture);
+   unsigned generation = p_atomic_read(&lpr->hiz_generation);
+
+   if (generation != setup->hiz.generation)
+      lp_setup_hiz_reset(setup, FLT_MAX);
+
+   if (write) {
+      unsigned next = p_atomic_inc_return(&lpr->hiz_generation);
+      if (next != generation + 1)
+         lp_setup_hiz_reset(setup, FLT_MAX);
+      generation = next;
+   }
+
+   setup->hiz.generation = generation;
+}
+
+
+/**
+ * Pick up the hierarchical Z behaviour of the state about to be used for
+ * drawing.
+ */
+static void
+lp_setup_update_hiz(struct lp_setup_context *setup)
+{
+   struct llvmpipe_context *lp = llvmpipe_context(setup->pipe);
+   const struct lp_fragment_shader_variant *variant = setup->fs.current.variant;
+   const struct lp_setup_variant_key *key = &setup->setup.variant->key;
+   boolean offset;
+
+   if (!setup->hiz.max_depth || !variant)
+      return;
+
+   lp_setup_hiz_sync(setup, variant->key.depth.enabled &&
+                            variant->key.depth.writemask);
+
+   if (variant->hiz_invalidate)
+      lp_setup_hiz_reset(setup, FLT_MAX);
+
+   /* polygon offset is applied by the setup function, after we see z */
+   offset = key->pgon_offset_units != 0.0f ||
+            key->pgon_offset_scale != 0.0f;
+
+   /* culled primitives would not count fragment shader invocations */
+   setup->hiz.test = variant->hiz_test && !offset &&
+                     !lp->active_statistics_queries;
+   setup->hiz.write = variant->hiz_write && !offset;
+}
+
+
 void
 lp_setup_bind_framebuffer( struct lp_setup_context *setup,
                            const struct pipe_framebuffer_state *fb )
@@ -392,6 +575,8 @@ lp_setup_bind_framebuffer( struct lp_setup_context *setup,
    setup->framebuffer.x1 = fb->width-1;
    setup->framebuffer.y1 = fb->height-1;
    setup->dirty |= LP_SETUP_NEW_SCISSOR;
+
+   lp_setup_hiz_bind(setup);
 }
 
 
@@ -517,6 +702,13 @@ lp_setup_try_clear_zs(struct lp_setup_context *setup,
          (setup->clear.zsvalue & ~zsmask) | (zsvalue & zsmask);
    }
 
+   if ((flags & PIPE_CLEAR_DEPTH) && setup->hiz.max_depth) {
+      lp_setup_hiz_sync(setup, TRUE);
+      lp_setup_hiz_reset(setup, setup->hiz.unorm ?
+                                CLAMP((float)depth, 0.0f, 1.0f) :
+                                (float)depth);
+   }
+
    return TRUE;
 }
 
@@ -902,6 +1094,10 @@ lp_setup_set_fragment_sampler_views(struct lp_setup_context *setup,
          struct lp_jit_texture *jit_tex;
          jit_tex = &setup->fs.current.jit_context.textures[i];
 
+         /* Sample the uncompressed copy instead, if there is one. */
+         if (llvmpipe_sampler_view_decompressed_format(view) != PIPE_FORMAT_NONE)
+            lp_tex = llvmpipe_resource(lp_tex->decompressed);
+
          /* We're referencing the texture's internal data, so save a
           * reference to it.
           */
@@ -1070,22 +1266,25 @@ unsigned
 lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
                                 const struct pipe_resource *texture )
 {
+   unsigned referenced = LP_UNREFERENCED;
    unsigned i;
 
-   /* check the render targets */
-   for (i = 0; i < setup->fb.nr_cbufs; i++) {
-      if (setup->fb.cbufs[i] && setup->fb.cbufs[i]->texture == texture)
+   /* check the scenes still being binned or rasterized, those which are
+    * done don't need a flush or wait
+    */
+   for (i = 0; i < setup->num_scenes; i++) {
+      const struct lp_scene *scene = setup->scenes[i];
+
+      if (scene_is_idle(setup, scene))
+         continue;
+
+      if (lp_scene_is_fb_referenced(scene, texture) ||
+          lp_scene_is_query_target(scene, texture))
          return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
-   }
-   if (setup->fb.zsbuf && setup->fb.zsbuf->texture == texture) {
-      return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
-   }
 
-   /* check textures referenced by the scene */
-   for (i = 0; i < ARRAY_SIZE(setup->scenes); i++) {
-      if (lp_scene_is_resource_referenced(setup->scenes[i], texture)) {
-         return LP_REFERENCED_FOR_READ;
-      }
+      referenced |= lp_scene_is_resource_referenced(scene, texture);
+      if (referenced & LP_REFERENCED_FOR_WRITE)
+         return referenced;
    }
 
    for (i = 0; i < ARRAY_SIZE(setup->ssbos); i++) {
@@ -1098,7 +1297,7 @@ lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
          return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
    }
 
-   return LP_UNREFERENCED;
+   return referenced;
 }
 
 
@@ -1303,7 +1502,32 @@ try_update_scene_state( struct lp_setup_context *setup )
             if (setup->fs.current_tex[i]) {
                if (!lp_scene_add_resource_reference(scene,
                                                     setup->fs.current_tex[i],
-                                                    new_scene)) {
+                                                    new_scene, FALSE)) {
+                  assert(!new_scene);
+                  return FALSE;
+               }
+            }
+         }
+
+         /* As well as the buffers and images the shader may store to,
+          * which stay written by the scene after they are unbound.
+          */
+         for (i = 0; i < ARRAY_SIZE(setup->ssbos); i++) {
+            if (setup->ssbos[i].current.buffer) {
+               if (!lp_scene_add_resource_reference(scene,
+                                                    setup->ssbos[i].current.buffer,
+                                                    new_scene, TRUE)) {
+                  assert(!new_scene);
+                  return FALSE;
+               }
+            }
+         }
+
+         for (i = 0; i < ARRAY_SIZE(setup->images); i++) {
+            if (setup->images[i].current.resource) {
+               if (!lp_scene_add_resource_reference(scene,
+                                                    setup->images[i].current.resource,
+                                                    new_scene, TRUE)) {
                   assert(!new_scene);
                   return FALSE;
                }
@@ -1369,6 +1593,9 @@ lp_setup_update_state( struct lp_setup_context *setup,
 		    setup->setup.variant->key.size) == 0);
    }
 
+   if (update_scene)
+      lp_setup_update_hiz(setup);
+
    if (update_scene && setup->state != SETUP_ACTIVE) {
       if (!set_scene_state( setup, SETUP_ACTIVE, __FUNCTION__ ))
          return FALSE;
@@ -1414,7 +1641,10 @@ lp_setup_destroy( struct lp_setup_context *setup )
 
    lp_setup_reset( setup );
 
+   lp_setup_destroy_bin_threads(setup);
+
    util_unreference_framebuffer_state(&setup->fb);
+   FREE(setup->hiz.max_depth);
 
    for (i = 0; i < ARRAY_SIZE(setup->fs.current_tex); i++) {
       pipe_resource_reference(&setup->fs.current_tex[i], NULL);
@@ -1428,13 +1658,14 @@ lp_setup_destroy( struct lp_setup_context *setup )
       pipe_resource_reference(&setup->ssbos[i].current.buffer, NULL);
    }
 
-   /* free the scenes in the 'empty' queue */
-   for (i = 0; i < ARRAY_SIZE(setup->scenes); i++) {
+   /* wait for the scenes still being rasterized, then free them all */
+   for (i = 0; i < setup->num_scenes; i++) {
       struct lp_scene *scene = setup->scenes[i];
 
-      if (scene->fence)
+      if (scene->fence && scene->fence->issued)
          lp_fence_wait(scene->fence);
 
+      lp_scene_end_rasterization(scene);
       lp_scene_destroy(scene);
    }
 
@@ -1455,7 +1686,6 @@ lp_setup_create( struct pipe_context *pipe,
 {
    struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
    struct lp_setup_context *setup;
-   unsigned i;
 
    setup = CALLOC_STRUCT(lp_setup_context);
    if (!setup) {
@@ -1478,13 +1708,16 @@ lp_setup_create( struct pipe_context *pipe,
    draw_set_rasterize_stage(draw, setup->vbuf);
    draw_set_render(draw, &setup->base);
 
-   /* create some empty scenes */
-   for (i = 0; i < MAX_SCENES; i++) {
-      setup->scenes[i] = lp_scene_create( pipe );
-      if (!setup->scenes[i]) {
-         goto no_scenes;
-      }
+   /* create an empty scene, more are added as binning gets ahead of the
+    * rasterizer
+    */
+   setup->scenes[0] = lp_scene_create( pipe );
+   if (!setup->scenes[0]) {
+      goto no_scenes;
    }
+   setup->num_scenes = 1;
+
+   lp_setup_init_bin_threads(setup, screen->num_bin_threads);
 
    setup->triangle = first_triangle;
    setup->line     = first_line;
@@ -1499,12 +1732,6 @@ lp_setup_create( struct pipe_context *pipe,
    return setup;
 
 no_scenes:
-   for (i = 0; i < MAX_SCENES; i++) {
-      if (setup->scenes[i]) {
-         lp_scene_destroy(setup->scenes[i]);
-      }
-   }
-
    setup->vbuf->destroy(setup->vbuf);
 no_vbuf:
    FREE(setup);
@@ -1631,6 +1858,54 @@ fail:
 }
 
 
+/**
+ * Have the rasterizer write a query result to a buffer once the current
+ * scene is done, instead of waiting for the query's scenes here.  Scenes
+ * are rasterized in order, so by then every scene contributing to the
+ * query has finished too.
+ *
+ * Returns FALSE if the result couldn't be binned and must be written by
+ * the caller.
+ */
+boolean
+lp_setup_resolve_query(struct lp_setup_context *setup,
+                       struct llvmpipe_query *pq,
+                       enum pipe_query_value_type result_type,
+                       int index,
+                       struct pipe_resource *resource,
+                       unsigned offset)
+{
+   struct lp_query_resolve *resolve;
+
+   if (!set_scene_state(setup, SETUP_ACTIVE, "resolve_query"))
+      return FALSE;
+
+   assert(setup->scene);
+   if (!setup->scene)
+      return FALSE;
+
+   resolve = lp_scene_alloc(setup->scene, sizeof *resolve);
+   if (!resolve)
+      return FALSE;
+
+   /* keeps the buffer alive until the scene is done */
+   lp_scene_add_resource_reference(setup->scene, resource, TRUE, FALSE);
+
+   resolve->pq = pq;
+   resolve->resource = resource;
+   resolve->offset = offset;
+   resolve->result_type = result_type;
+   resolve->index = index;
+   resolve->next = setup->scene->query_resolves;
+   setup->scene->query_resolves = resolve;
+
+   /* the query must outlive the resolve */
+   lp_fence_reference(&pq->fence, setup->scene->fence);
+
+   return TRUE;
+}
+
+
 boolean
 lp_setup_flush_and_restart(struct lp_setup_context *setup)
 {
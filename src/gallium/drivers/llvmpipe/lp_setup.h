@@ -67,6 +67,9 @@ lp_setup_flush( struct lp_setup_context *setup,
                 struct pipe_fence_handle **fence,
                 const char *reason);
 
+void
+lp_setup_wait_rasterized( struct lp_setup_context *setup );
+
 
 void
 lp_setup_bind_framebuffer( struct lp_setup_context *setup,
@@ -174,6 +177,14 @@ void
 lp_setup_end_query(struct lp_setup_context *setup,
                    struct llvmpipe_query *pq);
 
+boolean
+lp_setup_resolve_query(struct lp_setup_context *setup,
+                       struct llvmpipe_query *pq,
+                       enum pipe_query_value_type result_type,
+                       int index,
+                       struct pipe_resource *resource,
+                       unsigned offset);
+
 static inline unsigned
 lp_clamp_viewport_idx(int idx)
 {
@@ -43,6 +43,7 @@
 #include "draw/draw_vbuf.h"
 #include "util/u_rect.h"
 #include "util/u_pack_color.h"
+#include "util/u_queue.h"
 
 #define LP_SETUP_NEW_FS          0x01
 #define LP_SETUP_NEW_CONSTANTS   0x02
@@ -52,11 +53,13 @@
 #define LP_SETUP_NEW_SSBOS       0x20
 
 struct lp_setup_variant;
+struct lp_setup_bin_job;
 
 
-/** Max number of scenes */
-/* XXX: make multiple scenes per context work, see lp_setup_rasterize_scene */
-#define MAX_SCENES 1
+/** Max number of scenes, binning can run that many scenes ahead of the
+ * rasterizer.
+ */
+#define MAX_SCENES 4
 
 
 
@@ -88,11 +91,22 @@ struct lp_setup_context
     */
    struct draw_stage *vbuf;
    unsigned num_threads;
-   unsigned scene_idx;
+   unsigned num_scenes;
    struct lp_scene *scenes[MAX_SCENES];  /**< all the scenes */
    struct lp_scene *scene;               /**< current scene being built */
 
    struct lp_fence *last_fence;
+
+   /* Threads binning ranges of large triangle batches into private
+    * scenes, see lp_setup_vbuf.c.
+    */
+   unsigned num_bin_threads;
+   struct util_queue bin_queue;
+   struct lp_setup_bin_job *bin_jobs;
+
+   boolean bin_private;  /**< this is a binning thread's copy */
+   boolean bin_failed;   /**< private scene ran out of memory */
+
    struct llvmpipe_query *active_queries[LP_MAX_ACTIVE_BINNED_QUERIES];
    unsigned active_binned_queries;
 
@@ -125,6 +139,20 @@ struct lp_setup_context
       uint64_t zsvalue;               /**< lp_rast_clear_zstencil() cmd */
    } clear;
 
+   /* Hierarchical Z: a conservative maximum depth for each tile of the
+    * bound depth buffer, lowered by clears and by primitives fully covering
+    * a tile.  Primitives entirely behind it are not binned there.
+    */
+   struct {
+      float *max_depth;      /**< per tile, FLT_MAX if unknown */
+      unsigned tiles_x, tiles_y;
+      float epsilon;         /**< depth quantization and interpolation slack */
+      boolean unorm;         /**< depth values are clamped to [0,1] */
+      boolean test;          /**< current state may cull against max_depth */
+      boolean write;         /**< current state may lower max_depth */
+      unsigned generation;   /**< depth buffer's hiz_generation max_depth is for */
+   } hiz;
+
    enum setup_state {
       SETUP_FLUSHED,    /**< scene is null */
       SETUP_CLEARED,    /**< scene exists but has only clears */
@@ -200,6 +228,10 @@ void lp_setup_choose_point( struct lp_setup_context *setup );
 
 void lp_setup_init_vbuf(struct lp_setup_context *setup);
 
+void lp_setup_init_bin_threads(struct lp_setup_context *setup,
+                               unsigned num_threads);
+void lp_setup_destroy_bin_threads(struct lp_setup_context *setup);
+
 boolean lp_setup_update_state( struct lp_setup_context *setup,
                             boolean update_scene);
 
@@ -231,6 +263,7 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
                       const struct u_rect *bboxorig,
                       const struct u_rect *bbox,
                       int nr_planes,
-                      unsigned scissor_index);
+                      unsigned scissor_index,
+                      float zmin, float zmax);
 
 #endif
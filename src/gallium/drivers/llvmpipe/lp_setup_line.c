@@ -752,7 +752,11 @@ try_setup_line( struct lp_setup_context *setup,
       assert(plane_s == &plane[nr_planes]);
    }
 
-   return lp_setup_bin_triangle(setup, line, &bbox, &bboxpos, nr_planes, viewport_index);
+   /* The line quad extends past the endpoints, so its depth isn't bounded by
+    * theirs.  Leave lines out of hierarchical Z.
+    */
+   return lp_setup_bin_triangle(setup, line, &bbox, &bboxpos, nr_planes,
+                                viewport_index, -FLT_MAX, FLT_MAX);
 }
 
 
@@ -524,7 +524,9 @@ try_setup_point( struct lp_setup_context *setup,
       plane[3].eo = 0;
    }
 
-   return lp_setup_bin_triangle(setup, point, &bbox, &bbox, nr_planes, viewport_index);
+   /* Point depth is constant */
+   return lp_setup_bin_triangle(setup, point, &bbox, &bbox, nr_planes,
+                                viewport_index, v0[0][2], v0[0][2]);
 }
 
 
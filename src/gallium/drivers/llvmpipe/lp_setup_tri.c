@@ -727,7 +727,10 @@ do_triangle_ccw(struct lp_setup_context *setup,
       assert(plane_s == &plane[nr_planes]);
    }
 
-   return lp_setup_bin_triangle(setup, tri, &bbox, &bboxpos, nr_planes, viewport_index);
+   return lp_setup_bin_triangle(setup, tri, &bbox, &bboxpos, nr_planes,
+                                viewport_index,
+                                MIN3(v0[0][2], v1[0][2], v2[0][2]),
+                                MAX3(v0[0][2], v1[0][2], v2[0][2]));
 }
 
 /*
@@ -758,13 +761,58 @@ floor_pot(uint32_t n)
 }
 
 
+/**
+ * Hierarchical Z: is a primitive with minimum depth zmin entirely behind
+ * what was already drawn to tile (tx, ty)?  Only meaningful for LESS and
+ * LEQUAL depth tests, which is what setup->hiz.test implies.
+ */
+static inline boolean
+lp_setup_hiz_occluded(const struct lp_setup_context *setup,
+                      int tx, int ty, float zmin)
+{
+   if (!setup->hiz.test || setup->bin_private)
+      return FALSE;
+
+   if (setup->hiz.unorm)
+      zmin = CLAMP(zmin, 0.0f, 1.0f);
+
+   return zmin - setup->hiz.epsilon >
+          setup->hiz.max_depth[ty * setup->hiz.tiles_x + tx];
+}
+
+
+/**
+ * Hierarchical Z: a primitive with maximum depth zmax covers all of tile
+ * (tx, ty) and writes depth everywhere it passes the test.
+ *
+ * Binning threads leave the tiles alone, as they'd see each other's
+ * occluders out of order.
+ */
+static inline void
+lp_setup_hiz_occlude(struct lp_setup_context *setup,
+                     int tx, int ty, float zmax)
+{
+   float *max_depth;
+
+   if (!setup->hiz.write || setup->bin_private)
+      return;
+
+   if (setup->hiz.unorm)
+      zmax = CLAMP(zmax, 0.0f, 1.0f);
+
+   max_depth = &setup->hiz.max_depth[ty * setup->hiz.tiles_x + tx];
+   *max_depth = MIN2(*max_depth, zmax + setup->hiz.epsilon);
+}
+
+
 boolean
 lp_setup_bin_triangle(struct lp_setup_context *setup,
                       struct lp_rast_triangle *tri,
                       const struct u_rect *bboxorig,
                       const struct u_rect *bbox,
                       int nr_planes,
-                      unsigned viewport_index)
+                      unsigned viewport_index,
+                      float zmin, float zmax)
 {
    struct lp_scene *scene = setup->scene;
    struct u_rect trimmed_box = *bbox;   
@@ -813,6 +861,11 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
       assert(iy0 == bbox->y1 / TILE_SIZE &&
 	     ix0 == bbox->x1 / TILE_SIZE);
 
+      if (lp_setup_hiz_occluded(setup, ix0, iy0, zmin)) {
+         LP_COUNT(nr_hiz_occluded_64);
+         return TRUE;
+      }
+
       if (nr_planes == 3) {
          if (sz < 4)
          {
@@ -945,6 +998,11 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
                   break;  /* exiting triangle, all done with this row */
                LP_COUNT(nr_empty_64);
             }
+            else if (lp_setup_hiz_occluded(setup, x, y, zmin)) {
+               /* behind everything already drawn to the tile */
+               in = TRUE;
+               LP_COUNT(nr_hiz_occluded_64);
+            }
             else if (partial) {
                /* Not trivially accepted by at least one plane -
                 * rasterize/shade partial tile
@@ -969,6 +1027,7 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
                in = TRUE;
                if (!lp_setup_whole_tile(setup, &tri->inputs, x, y))
                   goto fail;
+               lp_setup_hiz_occlude(setup, x, y, zmax);
             }
 
             /* Iterate cx values across the region: */
@@ -1006,6 +1065,14 @@ static void retry_triangle_ccw( struct lp_setup_context *setup,
 {
    if (!do_triangle_ccw( setup, position, v0, v1, v2, front ))
    {
+      /* Binning threads can't flush, their range gets binned again
+       * serially.
+       */
+      if (setup->bin_private) {
+         setup->bin_failed = TRUE;
+         return;
+      }
+
       if (!lp_setup_flush_and_restart(setup))
          return;
 
@@ -46,6 +46,9 @@
 #define LP_MAX_VBUF_INDEXES 1024
 #define LP_MAX_VBUF_SIZE    4096
 
+/* Smallest number of triangles worth handing to a binning thread */
+#define LP_BIN_MIN_TRIANGLES 64
+
   
 
 /** cast wrapper */
@@ -135,6 +138,151 @@ static inline const_float4_ptr get_vert( const void *vertex_buffer,
    return (const_float4_ptr)((char *)vertex_buffer + index * stride);
 }
 
+/**
+ * Parallel binning of triangle lists.
+ *
+ * A large enough batch is split into contiguous ranges.  The first range
+ * is binned by the calling thread straight into the scene, each of the
+ * others by a binning thread using a private copy of the setup context
+ * which bins into a private scene.  The private bins are then appended to
+ * the scene in submission order, so every bin ends up with the same
+ * commands in the same order as with serial binning.
+ */
+struct lp_setup_bin_job {
+   struct lp_setup_context setup;
+   struct lp_scene *scene;
+   struct util_queue_fence fence;
+
+   const void *vertex_buffer;
+   const ushort *indices;        /**< NULL for non-indexed draws */
+   unsigned stride;
+   unsigned start, end;          /**< vertex range, multiples of 3 */
+};
+
+
+static void
+lp_setup_bin_triangle_range(struct lp_setup_context *setup,
+                            const void *vertex_buffer,
+                            const ushort *indices,
+                            unsigned stride,
+                            unsigned start, unsigned end)
+{
+   unsigned i;
+
+   for (i = start + 2; i < end && !setup->bin_failed; i += 3) {
+      if (indices) {
+         setup->triangle( setup,
+                          get_vert(vertex_buffer, indices[i-2], stride),
+                          get_vert(vertex_buffer, indices[i-1], stride),
+                          get_vert(vertex_buffer, indices[i-0], stride) );
+      } else {
+         setup->triangle( setup,
+                          get_vert(vertex_buffer, i-2, stride),
+                          get_vert(vertex_buffer, i-1, stride),
+                          get_vert(vertex_buffer, i-0, stride) );
+      }
+   }
+}
+
+
+static void
+lp_setup_bin_job_execute(void *data, int thread_index)
+{
+   struct lp_setup_bin_job *job = (struct lp_setup_bin_job *)data;
+
+   lp_setup_bin_triangle_range(&job->setup, job->vertex_buffer, job->indices,
+                               job->stride, job->start, job->end);
+}
+
+
+/**
+ * Bin a PIPE_PRIM_TRIANGLES batch using the binning threads.
+ * Returns FALSE if the batch should be binned serially instead.
+ */
+static boolean
+lp_setup_bin_triangles_parallel(struct lp_setup_context *setup,
+                                const void *vertex_buffer,
+                                const ushort *indices,
+                                unsigned stride,
+                                unsigned nr)
+{
+   struct llvmpipe_context *lp = llvmpipe_context(setup->pipe);
+   struct lp_scene *scene = setup->scene;
+   const struct lp_rast_state *stored = setup->fs.stored;
+   unsigned num_tris = nr / 3;
+   unsigned num_jobs, range, budget, i;
+   boolean restarted;
+
+   if (!setup->num_bin_threads || setup->bin_private)
+      return FALSE;
+
+   /* c_primitives is counted as triangles are set up */
+   if (lp->active_statistics_queries)
+      return FALSE;
+
+   num_jobs = MIN2(setup->num_bin_threads + 1,
+                   num_tris / LP_BIN_MIN_TRIANGLES);
+   if (num_jobs < 2)
+      return FALSE;
+
+   range = DIV_ROUND_UP(num_tris, num_jobs) * 3;
+   budget = (LP_SCENE_MAX_SIZE - MIN2(scene->scene_size, LP_SCENE_MAX_SIZE)) /
+            num_jobs;
+
+   for (i = 1; i < num_jobs; i++) {
+      struct lp_setup_bin_job *job = &setup->bin_jobs[i - 1];
+
+      if (i * range >= nr ||
+          !lp_scene_begin_private(job->scene, scene, budget))
+         break;
+
+      job->setup = *setup;
+      job->setup.scene = job->scene;
+      job->setup.bin_private = TRUE;
+      job->setup.bin_failed = FALSE;
+      job->vertex_buffer = vertex_buffer;
+      job->indices = indices;
+      job->stride = stride;
+      job->start = i * range;
+      job->end = MIN2(nr, (i + 1) * range);
+
+      util_queue_add_job(&setup->bin_queue, job, &job->fence,
+                         lp_setup_bin_job_execute, NULL, 0);
+   }
+   num_jobs = i;
+
+   lp_setup_bin_triangle_range(setup, vertex_buffer, indices, stride,
+                               0, MIN2(nr, range));
+
+   /* If binning the first range flushed the scene, the private bins
+    * refer to state stored in the old one.  Bin the rest serially.
+    */
+   restarted = setup->scene != scene || setup->fs.stored != stored;
+
+   for (i = 1; i < num_jobs; i++) {
+      struct lp_setup_bin_job *job = &setup->bin_jobs[i - 1];
+
+      util_queue_fence_wait(&job->fence);
+
+      if (job->setup.bin_failed)
+         restarted = TRUE;
+
+      lp_scene_end_private(scene, job->scene, !restarted);
+
+      if (restarted)
+         lp_setup_bin_triangle_range(setup, vertex_buffer, indices, stride,
+                                     job->start, job->end);
+   }
+
+   /* Anything left over if a private scene couldn't be set up */
+   if (num_jobs * range < nr)
+      lp_setup_bin_triangle_range(setup, vertex_buffer, indices, stride,
+                                  num_jobs * range, nr);
+
+   return TRUE;
+}
+
+
 /**
  * draw elements / indexed primitives
  */
@@ -190,6 +338,9 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
       break;
 
    case PIPE_PRIM_TRIANGLES:
+      if (lp_setup_bin_triangles_parallel(setup, vertex_buffer, indices,
+                                          stride, nr))
+         break;
       for (i = 2; i < nr; i += 3) {
          setup->triangle( setup,
                           get_vert(vertex_buffer, indices[i-2], stride),
@@ -388,6 +539,9 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
       break;
 
    case PIPE_PRIM_TRIANGLES:
+      if (lp_setup_bin_triangles_parallel(setup, vertex_buffer, NULL,
+                                          stride, nr))
+         break;
       for (i = 2; i < nr; i += 3) {
          setup->triangle( setup,
                           get_vert(vertex_buffer, i-2, stride),
@@ -589,6 +743,69 @@ lp_setup_pipeline_statistics(
    }
 }
 
+/**
+ * Start the binning threads.  Failing to do so isn't fatal, batches are
+ * then binned serially.
+ */
+void
+lp_setup_init_bin_threads(struct lp_setup_context *setup,
+                          unsigned num_threads)
+{
+   unsigned i;
+
+   if (!num_threads)
+      return;
+
+   setup->bin_jobs = CALLOC(num_threads, sizeof(*setup->bin_jobs));
+   if (!setup->bin_jobs)
+      return;
+
+   for (i = 0; i < num_threads; i++) {
+      setup->bin_jobs[i].scene = lp_scene_create(setup->pipe);
+      if (!setup->bin_jobs[i].scene)
+         goto fail;
+      util_queue_fence_init(&setup->bin_jobs[i].fence);
+   }
+
+   if (!util_queue_init(&setup->bin_queue, "lpbin", num_threads,
+                        num_threads, 0))
+      goto fail;
+
+   setup->num_bin_threads = num_threads;
+   return;
+
+fail:
+   for (i = 0; i < num_threads; i++) {
+      if (setup->bin_jobs[i].scene) {
+         util_queue_fence_destroy(&setup->bin_jobs[i].fence);
+         lp_scene_destroy(setup->bin_jobs[i].scene);
+      }
+   }
+   FREE(setup->bin_jobs);
+   setup->bin_jobs = NULL;
+}
+
+
+void
+lp_setup_destroy_bin_threads(struct lp_setup_context *setup)
+{
+   unsigned i;
+
+   if (!setup->num_bin_threads)
+      return;
+
+   util_queue_destroy(&setup->bin_queue);
+
+   for (i = 0; i < setup->num_bin_threads; i++) {
+      util_queue_fence_destroy(&setup->bin_jobs[i].fence);
+      lp_scene_destroy(setup->bin_jobs[i].scene);
+   }
+   FREE(setup->bin_jobs);
+   setup->bin_jobs = NULL;
+   setup->num_bin_threads = 0;
+}
+
+
 /**
  * Create the post-transform vertex handler for the given context.
  */
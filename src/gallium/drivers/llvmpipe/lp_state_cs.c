@@ -45,6 +45,7 @@
 #include "lp_memory.h"
 #include "lp_query.h"
 #include "lp_cs_tpool.h"
+#include "lp_setup.h"
 #include "frontend/sw_winsys.h"
 #include "nir/nir_to_tgsi_info.h"
 #include "util/mesa-sha1.h"
@@ -582,8 +583,8 @@ make_variant_key(struct llvmpipe_context *lp,
           * used views may be included in the shader key.
           */
          if(shader->info.base.file_mask[TGSI_FILE_SAMPLER_VIEW] & (1u << (i & 31))) {
-            lp_sampler_static_texture_state(&cs_sampler[i].texture_state,
-                                            lp->sampler_views[PIPE_SHADER_COMPUTE][i]);
+            llvmpipe_sampler_static_texture_state(&cs_sampler[i].texture_state,
+                                                  lp->sampler_views[PIPE_SHADER_COMPUTE][i]);
          }
       }
    }
@@ -591,8 +592,8 @@ make_variant_key(struct llvmpipe_context *lp,
       key->nr_sampler_views = key->nr_samplers;
       for(i = 0; i < key->nr_sampler_views; ++i) {
          if(shader->info.base.file_mask[TGSI_FILE_SAMPLER] & (1 << i)) {
-            lp_sampler_static_texture_state(&cs_sampler[i].texture_state,
-                                            lp->sampler_views[PIPE_SHADER_COMPUTE][i]);
+            llvmpipe_sampler_static_texture_state(&cs_sampler[i].texture_state,
+                                                  lp->sampler_views[PIPE_SHADER_COMPUTE][i]);
          }
       }
    }
@@ -731,22 +732,38 @@ generate_variant(struct llvmpipe_context *lp,
       if (!cached.data_size)
          needs_caching = true;
    }
-   variant->gallivm = gallivm_create(module_name, lp->context, &cached);
-   if (!variant->gallivm) {
-      FREE(variant);
-      return NULL;
-   }
 
    variant->list_item_global.base = variant;
    variant->list_item_local.base = variant;
    variant->no = shader->variants_created++;
 
-
-
    if ((LP_DEBUG & DEBUG_CS) || (gallivm_debug & GALLIVM_DEBUG_IR)) {
       lp_debug_cs_variant(variant);
    }
 
+   /*
+    * On a cache hit link the cached code directly, there's no IR to build.
+    */
+   if (cached.data_size) {
+      const char *name = "cs_variant";
+      func_pointer func;
+
+      variant->gallivm = gallivm_load_cached(module_name, &cached, 1,
+                                             &name, &func);
+      if (variant->gallivm) {
+         free(cached.data);
+         variant->nr_instrs += cached.nr_instrs;
+         variant->jit_function = (lp_jit_cs_func)func;
+         return variant;
+      }
+   }
+
+   variant->gallivm = gallivm_create(module_name, lp->context, &cached);
+   if (!variant->gallivm) {
+      FREE(variant);
+      return NULL;
+   }
+
    lp_jit_init_cs_types(variant);
 
    generate_compute(lp, shader, variant);
@@ -754,7 +771,8 @@ generate_variant(struct llvmpipe_context *lp,
    gallivm_compile_module(variant->gallivm);
 
    lp_build_coro_add_malloc_hooks(variant->gallivm);
-   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
+   cached.nr_instrs = lp_build_count_ir_module(variant->gallivm->module);
+   variant->nr_instrs += cached.nr_instrs;
 
    variant->jit_function = (lp_jit_cs_func)gallivm_jit_function(variant->gallivm, variant->function);
 
@@ -893,6 +911,10 @@ lp_csctx_set_sampler_views(struct lp_cs_context *csctx,
          struct lp_jit_texture *jit_tex;
          jit_tex = &csctx->cs.current.jit_context.textures[i];
 
+         /* Sample the uncompressed copy instead, if there is one. */
+         if (llvmpipe_sampler_view_decompressed_format(view) != PIPE_FORMAT_NONE)
+            lp_tex = llvmpipe_resource(lp_tex->decompressed);
+
          /* We're referencing the texture's internal data, so save a
           * reference to it.
           */
@@ -1215,6 +1237,15 @@ update_csctx_ssbo(struct llvmpipe_context *llvmpipe)
 static void
 llvmpipe_cs_update_derived(struct llvmpipe_context *llvmpipe, void *input)
 {
+   struct llvmpipe_screen *lp_screen = llvmpipe_screen(llvmpipe->pipe.screen);
+
+   /* Check for updated textures.
+    */
+   if (llvmpipe->cs_tex_timestamp != lp_screen->timestamp) {
+      llvmpipe->cs_tex_timestamp = lp_screen->timestamp;
+      llvmpipe->cs_dirty |= LP_CSNEW_SAMPLER_VIEW;
+   }
+
    if (llvmpipe->cs_dirty & LP_CSNEW_CONSTANTS) {
       lp_csctx_set_cs_constants(llvmpipe->csctx,
                                 ARRAY_SIZE(llvmpipe->constants[PIPE_SHADER_COMPUTE]),
@@ -1328,6 +1359,9 @@ static void llvmpipe_launch_grid(struct pipe_context *pipe,
    if (!llvmpipe_check_render_cond(llvmpipe))
       return;
 
+   /* Flushed rendering may still be in flight on the rasterizer */
+   lp_setup_wait_rasterized(llvmpipe->setup);
+
    memset(&job_info, 0, sizeof(job_info));
 
    llvmpipe_cs_update_derived(llvmpipe, info->input);
@@ -112,6 +112,17 @@
 /** Fragment shader number (for debugging) */
 static unsigned fs_no = 0;
 
+
+/**
+ * The NIR to generate code from: precompiled variants work on a private copy
+ * since lp_build_nir_soa() lowers the shader in place.
+ */
+static inline struct nir_shader *
+lp_fs_variant_nir(const struct lp_fragment_shader_variant *variant)
+{
+   return variant->nir ? variant->nir : variant->shader->base.ir.nir;
+}
+
 static void
 load_unswizzled_block(struct gallivm_state *gallivm,
                       LLVMValueRef base_ptr,
@@ -555,6 +566,7 @@ static void fs_fb_fetch(const struct lp_build_fs_iface *iface,
 static void
 generate_fs_loop(struct gallivm_state *gallivm,
                  struct lp_fragment_shader *shader,
+                 struct nir_shader *nir,
                  const struct lp_fragment_shader_variant_key *key,
                  LLVMBuilderRef builder,
                  struct lp_type type,
@@ -965,7 +977,7 @@ generate_fs_loop(struct gallivm_state *gallivm,
       lp_build_tgsi_soa(gallivm, tokens, &params,
                         outputs);
    else
-      lp_build_nir_soa(gallivm, shader->base.ir.nir, &params,
+      lp_build_nir_soa(gallivm, nir, &params,
                        outputs);
 
    /* Alpha test */
@@ -2917,8 +2929,7 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
  * 2x2 pixels.
  */
 static void
-generate_fragment(struct llvmpipe_context *lp,
-                  struct lp_fragment_shader *shader,
+generate_fragment(struct lp_fragment_shader *shader,
                   struct lp_fragment_shader_variant *variant,
                   unsigned partial_mask)
 {
@@ -3043,7 +3054,7 @@ generate_fragment(struct llvmpipe_context *lp,
       if(LLVMGetTypeKind(arg_types[i]) == LLVMPointerTypeKind)
          lp_add_function_attr(function, i + 1, LP_FUNC_ATTR_NOALIAS);
 
-   if (variant->gallivm->cache->data_size)
+   if (variant->gallivm->cache && variant->gallivm->cache->data_size)
       return;
 
    context_ptr  = LLVMGetParam(function, 0);
@@ -3204,7 +3215,7 @@ generate_fragment(struct llvmpipe_context *lp,
       }
 
       generate_fs_loop(gallivm,
-                       shader, key,
+                       shader, lp_fs_variant_nir(variant), key,
                        builder,
                        fs_type,
                        context_ptr,
@@ -3441,7 +3452,7 @@ lp_debug_fs_variant(struct lp_fragment_shader_variant *variant)
    if (variant->shader->base.type == PIPE_SHADER_IR_TGSI)
       tgsi_dump(variant->shader->base.tokens, 0);
    else
-      nir_print_shader(variant->shader->base.ir.nir, stderr);
+      nir_print_shader(lp_fs_variant_nir(variant), stderr);
    dump_fs_variant_key(&variant->key);
    debug_printf("variant->opaque = %u\n", variant->opaque);
    debug_printf("\n");
@@ -3456,7 +3467,7 @@ lp_fs_get_ir_cache_key(struct lp_fragment_shader_variant *variant,
    void *ir_binary;
 
    blob_init(&blob);
-   nir_serialize(&blob, variant->shader->base.ir.nir, true);
+   nir_serialize(&blob, lp_fs_variant_nir(variant), true);
    ir_binary = blob.data;
    ir_size = blob.size;
 
@@ -3470,53 +3481,70 @@ lp_fs_get_ir_cache_key(struct lp_fragment_shader_variant *variant,
 }
 
 /**
- * Generate a new fragment shader variant from the shader code and
- * other state indicated by the key.
+ * Allocate a new fragment shader variant for the given key, without
+ * generating any code for it yet.
  */
 static struct lp_fragment_shader_variant *
-generate_variant(struct llvmpipe_context *lp,
-                 struct lp_fragment_shader *shader,
-                 const struct lp_fragment_shader_variant_key *key)
+create_variant(struct llvmpipe_context *lp,
+               struct lp_fragment_shader *shader,
+               const struct lp_fragment_shader_variant_key *key)
 {
-   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
    struct lp_fragment_shader_variant *variant;
-   const struct util_format_description *cbuf0_format_desc = NULL;
-   boolean fullcolormask;
-   char module_name[64];
-   unsigned char ir_sha1_cache_key[20];
-   struct lp_cached_code cached = { 0 };
-   bool needs_caching = false;
+
    variant = MALLOC(sizeof *variant + shader->variant_key_size - sizeof variant->key);
    if (!variant)
       return NULL;
 
    memset(variant, 0, sizeof(*variant));
-   snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
-            shader->no, shader->variants_created);
 
    pipe_reference_init(&variant->reference, 1);
+   util_queue_fence_init(&variant->ready);
+   util_queue_fence_init(&variant->optimized);
    lp_fs_reference(lp, &variant->shader, shader);
 
    memcpy(&variant->key, key, shader->variant_key_size);
 
+   variant->list_item_global.base = variant;
+   variant->list_item_local.base = variant;
+   variant->no = shader->variants_created++;
+
+   return variant;
+}
+
+/**
+ * Generate and compile the code of a variant.  This only looks at the
+ * variant and its shader, so it can run on the context's compile queue.
+ *
+ * \param fast  on a disk cache miss, compile without optimizations and
+ *              mark the variant as tier0
+ */
+static boolean
+compile_variant(struct llvmpipe_screen *screen,
+                struct lp_fragment_shader_variant *variant,
+                LLVMContextRef context,
+                boolean fast)
+{
+   struct lp_fragment_shader *shader = variant->shader;
+   const struct lp_fragment_shader_variant_key *key = &variant->key;
+   const struct util_format_description *cbuf0_format_desc = NULL;
+   boolean fullcolormask;
+   boolean depth_less, stencil_write;
+   char module_name[64];
+   unsigned char ir_sha1_cache_key[20];
+   struct lp_cached_code cached = { 0 };
+   bool needs_caching = false;
+
+   snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
+            shader->no, variant->no);
+
    if (shader->base.ir.nir) {
       lp_fs_get_ir_cache_key(variant, ir_sha1_cache_key);
 
       lp_disk_cache_find_shader(screen, &cached, ir_sha1_cache_key);
-      if (!cached.data_size)
+      /* unoptimized code isn't worth caching */
+      if (!cached.data_size && !fast)
          needs_caching = true;
    }
-   variant->gallivm = gallivm_create(module_name, lp->context, &cached);
-   if (!variant->gallivm) {
-      FREE(variant);
-      return NULL;
-   }
-
-   variant->list_item_global.base = variant;
-   variant->list_item_local.base = variant;
-   variant->no = shader->variants_created++;
-
-
 
    /*
     * Determine whether we are touching all channels in the color buffer.
@@ -3540,29 +3568,98 @@ generate_variant(struct llvmpipe_context *lp,
          !shader->info.base.writes_samplemask
       ? TRUE : FALSE;
 
+   /*
+    * LESS/LEQUAL depth writes only ever lower the depth buffer.  Culling
+    * must not skip stencil writes or side effects of late depth tests.
+    */
+   depth_less = key->depth.enabled &&
+                (key->depth.func == PIPE_FUNC_LESS ||
+                 key->depth.func == PIPE_FUNC_LEQUAL);
+   stencil_write = key->stencil[0].enabled &&
+                   (key->stencil[0].writemask ||
+                    (key->stencil[1].enabled &&
+                     key->stencil[1].writemask));
+
+   variant->hiz_test =
+         depth_less &&
+         !key->depth_clamp &&
+         !stencil_write &&
+         !shader->info.base.writes_z &&
+         !shader->info.base.writes_stencil &&
+         (!shader->info.base.writes_memory ||
+          shader->info.base.properties[TGSI_PROPERTY_FS_EARLY_DEPTH_STENCIL]);
+
+   variant->hiz_write =
+         depth_less &&
+         key->depth.writemask &&
+         !key->depth_clamp &&
+         !key->stencil[0].enabled &&
+         !key->alpha.enabled &&
+         !key->multisample &&
+         !key->blend.alpha_to_coverage &&
+         !shader->info.base.writes_z &&
+         !shader->info.base.uses_kill &&
+         !shader->info.base.writes_samplemask;
+
+   variant->hiz_invalidate =
+         key->depth.enabled &&
+         key->depth.writemask &&
+         !depth_less &&
+         key->depth.func != PIPE_FUNC_EQUAL &&
+         key->depth.func != PIPE_FUNC_NEVER;
+
    if ((LP_DEBUG & DEBUG_FS) || (gallivm_debug & GALLIVM_DEBUG_IR)) {
       lp_debug_fs_variant(variant);
    }
 
-   lp_jit_init_types(variant);
-   
-   if (variant->jit_function[RAST_EDGE_TEST] == NULL)
-      generate_fragment(lp, shader, variant, RAST_EDGE_TEST);
-
-   if (variant->jit_function[RAST_WHOLE] == NULL) {
-      if (variant->opaque) {
-         /* Specialized shader, which doesn't need to read the color buffer. */
-         generate_fragment(lp, shader, variant, RAST_WHOLE);
+   /*
+    * On a cache hit link the cached code directly, there's no IR to build.
+    */
+   if (cached.data_size) {
+      const char *names[2] = { "fs_variant_partial", "fs_variant_whole" };
+      func_pointer funcs[2];
+
+      variant->gallivm = gallivm_load_cached(module_name, &cached,
+                                             variant->opaque ? 2 : 1,
+                                             names, funcs);
+      if (variant->gallivm) {
+         free(cached.data);
+         variant->nr_instrs += cached.nr_instrs;
+         variant->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)funcs[0];
+         variant->jit_function[RAST_WHOLE] =
+               (lp_jit_frag_func)funcs[variant->opaque ? 1 : 0];
+         return TRUE;
       }
    }
 
+   if (fast) {
+      variant->gallivm = gallivm_create_fast(module_name, context);
+      variant->tier0 = TRUE;
+      variant->tier0_context = context;
+   } else {
+      variant->gallivm = gallivm_create(module_name, context, &cached);
+   }
+   if (!variant->gallivm)
+      return FALSE;
+
+   lp_jit_init_types(variant);
+
+   variant->function[RAST_WHOLE] = NULL;
+   generate_fragment(shader, variant, RAST_EDGE_TEST);
+
+   if (variant->opaque) {
+      /* Specialized shader, which doesn't need to read the color buffer. */
+      generate_fragment(shader, variant, RAST_WHOLE);
+   }
+
    /*
     * Compile everything
     */
 
    gallivm_compile_module(variant->gallivm);
 
-   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
+   cached.nr_instrs = lp_build_count_ir_module(variant->gallivm->module);
+   variant->nr_instrs += cached.nr_instrs;
 
    if (variant->function[RAST_EDGE_TEST]) {
       variant->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
@@ -3571,10 +3668,10 @@ generate_variant(struct llvmpipe_context *lp,
    }
 
    if (variant->function[RAST_WHOLE]) {
-         variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
-               gallivm_jit_function(variant->gallivm,
-                                    variant->function[RAST_WHOLE]);
-   } else if (!variant->jit_function[RAST_WHOLE]) {
+      variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
+            gallivm_jit_function(variant->gallivm,
+                                 variant->function[RAST_WHOLE]);
+   } else {
       variant->jit_function[RAST_WHOLE] = variant->jit_function[RAST_EDGE_TEST];
    }
 
@@ -3584,10 +3681,276 @@ generate_variant(struct llvmpipe_context *lp,
 
    gallivm_free_ir(variant->gallivm);
 
+   return TRUE;
+}
+
+/**
+ * Generate a new fragment shader variant from the shader code and
+ * other state indicated by the key.
+ */
+static struct lp_fragment_shader_variant *
+generate_variant(struct llvmpipe_context *lp,
+                 struct lp_fragment_shader *shader,
+                 const struct lp_fragment_shader_variant_key *key)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   struct lp_fragment_shader_variant *variant;
+
+   variant = create_variant(lp, shader, key);
+   if (!variant)
+      return NULL;
+
+   if (!compile_variant(screen, variant, lp->context,
+                        screen->tiered_compile_draws != 0)) {
+      lp_fs_variant_reference(lp, &variant, NULL);
+      return NULL;
+   }
+
    return variant;
 }
 
 
+struct lp_fs_compile_job {
+   struct llvmpipe_screen *screen;
+   struct lp_fragment_shader_variant *variant;
+};
+
+static void
+lp_fs_compile_job_execute(void *data, int thread_index)
+{
+   struct lp_fs_compile_job *job = data;
+   struct lp_fragment_shader_variant *variant = job->variant;
+
+   /* LLVM contexts are not thread safe, so every precompiled variant gets
+    * its own and keeps it for the lifetime of its code.
+    */
+   variant->context = LLVMContextCreate();
+   if (variant->context)
+      compile_variant(job->screen, variant, variant->context,
+                      job->screen->tiered_compile_draws != 0);
+
+   FREE(job);
+}
+
+/**
+ * The optimized rebuild of a tier0 variant.  The variant may be in use by
+ * the rasterizer and by other contexts meanwhile, so the job builds into a
+ * private copy and owns the resulting code until the variant is destroyed.
+ */
+struct lp_fs_optimize_job {
+   struct llvmpipe_screen *screen;
+   struct lp_fragment_shader_variant *variant;
+   struct nir_shader *nir;
+   LLVMContextRef context;
+   struct gallivm_state *gallivm;
+};
+
+/**
+ * Rebuild a tier0 variant with optimizations.  The rasterizer picks up
+ * the new jit_function as soon as it is written.  The tier0 code is freed
+ * later by lp_fs_variant_retire_tier0().
+ */
+static void
+lp_fs_optimize_job_execute(void *data, int thread_index)
+{
+   struct lp_fs_optimize_job *job = data;
+   struct lp_fragment_shader_variant *variant = job->variant;
+   struct lp_fragment_shader *shader = variant->shader;
+   struct lp_fragment_shader_variant *opt;
+   int state = LP_FS_OPT_FAILED;
+
+   opt = MALLOC(sizeof *opt + shader->variant_key_size - sizeof opt->key);
+   job->context = LLVMContextCreate();
+   if (opt && job->context) {
+      memset(opt, 0, sizeof(*opt));
+      memcpy(&opt->key, &variant->key, shader->variant_key_size);
+      opt->shader = shader;
+      opt->no = variant->no;
+      opt->nir = job->nir;
+
+      if (compile_variant(job->screen, opt, job->context, FALSE)) {
+         job->gallivm = opt->gallivm;
+         p_atomic_set_release(&variant->jit_function[RAST_EDGE_TEST],
+                              opt->jit_function[RAST_EDGE_TEST]);
+         p_atomic_set_release(&variant->jit_function[RAST_WHOLE],
+                              opt->jit_function[RAST_WHOLE]);
+         state = LP_FS_OPT_INSTALLED;
+      }
+   }
+   FREE(opt);
+
+   /* Scenes referencing the variant from now on only see new code */
+   p_atomic_set_release(&variant->opt_state, state);
+}
+
+/**
+ * Free the tier0 code of a variant once its optimized code is installed
+ * and no scene that could still be running the tier0 code is in flight.
+ * The tier0 module belongs to the LLVMContext it was built in, so only
+ * free it from the thread owning that context.
+ */
+static void
+lp_fs_variant_retire_tier0(struct llvmpipe_context *lp,
+                           struct lp_fragment_shader_variant *variant)
+{
+   if (p_atomic_read_acquire(&variant->opt_state) != LP_FS_OPT_INSTALLED ||
+       p_atomic_read_acquire(&variant->tier0_scenes) != 0)
+      return;
+
+   if (variant->tier0_context != lp->context &&
+       variant->tier0_context != variant->context)
+      return;
+
+   struct gallivm_state *tier0 = p_atomic_read_acquire(&variant->gallivm);
+   if (tier0 &&
+       p_atomic_cmpxchg(&variant->gallivm, tier0, NULL) == tier0)
+      gallivm_destroy(tier0);
+}
+
+/**
+ * Wait for a variant queued on the compile queue, and account for its
+ * instructions now that they are known.
+ *
+ * \return FALSE if the variant could not be compiled.
+ */
+static boolean
+lp_fs_variant_finish(struct llvmpipe_context *lp,
+                     struct lp_fragment_shader_variant *variant)
+{
+   if (variant->pending) {
+      util_queue_fence_wait(&variant->ready);
+      variant->pending = FALSE;
+      lp->nr_fs_instrs += variant->nr_instrs;
+   }
+
+   return variant->jit_function[RAST_EDGE_TEST] != NULL;
+}
+
+static struct lp_fragment_shader_variant *
+lp_fs_find_variant(struct lp_fragment_shader *shader,
+                   const struct lp_fragment_shader_variant_key *key)
+{
+   struct lp_fs_variant_list_item *li;
+
+   li = first_elem(&shader->variants);
+   while(!at_end(&shader->variants, li)) {
+      if(memcmp(&li->base->key, key, shader->variant_key_size) == 0)
+         return li->base;
+      li = next_elem(li);
+   }
+   return NULL;
+}
+
+static struct lp_fragment_shader_variant_key *
+make_variant_key(struct llvmpipe_context *lp,
+                 struct lp_fragment_shader *shader,
+                 char *store);
+
+/**
+ * Count a draw with the bound fragment shader variant, and queue the
+ * optimized rebuild of a tier0 variant once it got hot.
+ */
+void
+llvmpipe_count_fs_draw(struct llvmpipe_context *lp)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   struct lp_fragment_shader_variant *variant = lp->fs_variant;
+   struct lp_fs_optimize_job *job;
+
+   if (!variant || !variant->tier0)
+      return;
+
+   if (p_atomic_read_acquire(&variant->opt_state) != LP_FS_OPT_NONE) {
+      if (p_atomic_read_acquire(&variant->gallivm))
+         lp_fs_variant_retire_tier0(lp, variant);
+      return;
+   }
+
+   if (p_atomic_inc_return(&variant->draws) < screen->tiered_compile_draws)
+      return;
+
+   /* Variants are shared between contexts, only the first one queues it */
+   if (p_atomic_cmpxchg(&variant->opt_state, LP_FS_OPT_NONE,
+                        LP_FS_OPT_QUEUED) != LP_FS_OPT_NONE)
+      return;
+
+   job = CALLOC_STRUCT(lp_fs_optimize_job);
+   if (!job) {
+      p_atomic_set_release(&variant->opt_state, LP_FS_OPT_FAILED);
+      return;
+   }
+
+   /* The shader's NIR is lowered in place, build from a copy */
+   if (variant->shader->base.ir.nir)
+      job->nir = nir_shader_clone(NULL, variant->shader->base.ir.nir);
+
+   job->screen = screen;
+   job->variant = variant;
+   variant->opt_job = job;
+   util_queue_add_job(&lp->compile_queue, job, &variant->optimized,
+                      lp_fs_optimize_job_execute, NULL, 0);
+}
+
+/**
+ * Queue a background compile of the variant that the currently bound state
+ * selects for this shader, so that the draw needing it only has to wait for
+ * the compile already in flight instead of starting it.
+ *
+ * There is no generic variant to fall back to: every variant is specialized
+ * for the key, so a draw whose key was not predicted still compiles inline.
+ */
+static void
+llvmpipe_precompile_fs(struct llvmpipe_context *lp,
+                       struct lp_fragment_shader *shader)
+{
+   struct lp_fragment_shader_variant_key *key;
+   struct lp_fragment_shader_variant *variant;
+   struct lp_fs_compile_job *job;
+   char store[LP_FS_MAX_VARIANT_KEY_SIZE];
+
+   if (!util_queue_is_initialized(&lp->compile_queue) ||
+       !llvmpipe_screen(lp->pipe.screen)->num_compile_threads)
+      return;
+
+   /* make_variant_key() needs these, and they're unset before first use */
+   if (!lp->rasterizer || !lp->blend || !lp->depth_stencil)
+      return;
+
+   /* Don't evict variants in use for a speculative compile. */
+   if (lp->nr_fs_variants >= LP_MAX_SHADER_VARIANTS ||
+       lp->nr_fs_instrs >= LP_MAX_SHADER_INSTRUCTIONS)
+      return;
+
+   key = make_variant_key(lp, shader, store);
+   if (lp_fs_find_variant(shader, key))
+      return;
+
+   job = CALLOC_STRUCT(lp_fs_compile_job);
+   if (!job)
+      return;
+
+   variant = create_variant(lp, shader, key);
+   if (!variant) {
+      FREE(job);
+      return;
+   }
+
+   if (shader->base.ir.nir)
+      variant->nir = nir_shader_clone(NULL, shader->base.ir.nir);
+   variant->pending = TRUE;
+
+   insert_at_head(&shader->variants, &variant->list_item_local);
+   insert_at_head(&lp->fs_variants_list, &variant->list_item_global);
+   lp->nr_fs_variants++;
+   shader->variants_cached++;
+
+   job->screen = llvmpipe_screen(lp->pipe.screen);
+   job->variant = variant;
+   util_queue_add_job(&lp->compile_queue, job, &variant->ready,
+                      lp_fs_compile_job_execute, NULL, 0);
+}
+
+
 static void *
 llvmpipe_create_fs_state(struct pipe_context *pipe,
                          const struct pipe_shader_state *templ)
@@ -3688,6 +4051,8 @@ llvmpipe_create_fs_state(struct pipe_context *pipe,
       debug_printf("\n");
    }
 
+   llvmpipe_precompile_fs(llvmpipe, shader);
+
    return shader;
 }
 
@@ -3705,6 +4070,9 @@ llvmpipe_bind_fs_state(struct pipe_context *pipe, void *fs)
 
    lp_fs_reference(llvmpipe, &llvmpipe->fs, lp_fs);
 
+   if (lp_fs)
+      llvmpipe_precompile_fs(llvmpipe, lp_fs);
+
    /* invalidate the setup link, NEW_FS will make it update */
    lp_setup_set_fs_variant(llvmpipe->setup, NULL);
    llvmpipe->dirty |= LP_NEW_FS;
@@ -3720,6 +4088,8 @@ static
 void llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
                                     struct lp_fragment_shader_variant *variant)
 {
+   lp_fs_variant_finish(lp, variant);
+
    if ((LP_DEBUG & DEBUG_FS) || (gallivm_debug & GALLIVM_DEBUG_IR)) {
       debug_printf("llvmpipe: del fs #%u var %u v created %u v cached %u "
                    "v total cached %u inst %u total inst %u\n",
@@ -3729,6 +4099,9 @@ void llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
                    lp->nr_fs_variants, variant->nr_instrs, lp->nr_fs_instrs);
    }
 
+   if (lp->fs_variant == variant)
+      lp->fs_variant = NULL;
+
    /* remove from shader's list */
    remove_from_list(&variant->list_item_local);
    variant->shader->variants_cached--;
@@ -3743,7 +4116,27 @@ void
 llvmpipe_destroy_shader_variant(struct llvmpipe_context *lp,
                                struct lp_fragment_shader_variant *variant)
 {
-   gallivm_destroy(variant->gallivm);
+   util_queue_fence_wait(&variant->ready);
+   util_queue_fence_destroy(&variant->ready);
+   util_queue_fence_wait(&variant->optimized);
+   util_queue_fence_destroy(&variant->optimized);
+
+   if (variant->gallivm)
+      gallivm_destroy(variant->gallivm);
+   if (variant->context)
+      LLVMContextDispose(variant->context);
+   ralloc_free(variant->nir);
+
+   if (variant->opt_job) {
+      struct lp_fs_optimize_job *job = variant->opt_job;
+
+      if (job->gallivm)
+         gallivm_destroy(job->gallivm);
+      if (job->context)
+         LLVMContextDispose(job->context);
+      ralloc_free(job->nir);
+      FREE(job);
+   }
 
    lp_fs_reference(lp, &variant->shader, NULL);
 
@@ -3797,6 +4190,8 @@ llvmpipe_set_constant_buffer(struct pipe_context *pipe,
    assert(shader < PIPE_SHADER_TYPES);
    assert(index < ARRAY_SIZE(llvmpipe->constants[shader]));
 
+   llvmpipe_wait_for_writes(pipe, constants, "constant_buffer");
+
    /* note: reference counting */
    util_copy_constant_buffer(&llvmpipe->constants[shader][index], cb,
                              take_ownership);
@@ -3888,6 +4283,9 @@ llvmpipe_set_shader_images(struct pipe_context *pipe,
    for (i = start_slot, idx = 0; i < start_slot + count; i++, idx++) {
       const struct pipe_image_view *image = images ? &images[idx] : NULL;
 
+      /* image access goes through rows */
+      if (image && image->resource)
+         llvmpipe_resource_untile(pipe, image->resource);
       util_copy_image_view(&llvmpipe->images[shader][i], image);
    }
 
@@ -4134,8 +4532,8 @@ make_variant_key(struct llvmpipe_context *lp,
           * used views may be included in the shader key.
           */
          if(shader->info.base.file_mask[TGSI_FILE_SAMPLER_VIEW] & (1u << (i & 31))) {
-            lp_sampler_static_texture_state(&fs_sampler[i].texture_state,
-                                            lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
+            llvmpipe_sampler_static_texture_state(&fs_sampler[i].texture_state,
+                                                  lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
          }
       }
    }
@@ -4143,8 +4541,8 @@ make_variant_key(struct llvmpipe_context *lp,
       key->nr_sampler_views = key->nr_samplers;
       for(i = 0; i < key->nr_sampler_views; ++i) {
          if(shader->info.base.file_mask[TGSI_FILE_SAMPLER] & (1 << i)) {
-            lp_sampler_static_texture_state(&fs_sampler[i].texture_state,
-                                            lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
+            llvmpipe_sampler_static_texture_state(&fs_sampler[i].texture_state,
+                                                  lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
          }
       }
    }
@@ -4172,20 +4570,24 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
 {
    struct lp_fragment_shader *shader = lp->fs;
    struct lp_fragment_shader_variant_key *key;
-   struct lp_fragment_shader_variant *variant = NULL;
-   struct lp_fs_variant_list_item *li;
+   struct lp_fragment_shader_variant *variant;
    char store[LP_FS_MAX_VARIANT_KEY_SIZE];
 
    key = make_variant_key(lp, shader, store);
 
    /* Search the variants for one which matches the key */
-   li = first_elem(&shader->variants);
-   while(!at_end(&shader->variants, li)) {
-      if(memcmp(&li->base->key, key, shader->variant_key_size) == 0) {
-         variant = li->base;
-         break;
+   variant = lp_fs_find_variant(shader, key);
+
+   if (variant && variant->pending) {
+      int64_t t0 = os_time_get();
+      boolean compiled = lp_fs_variant_finish(lp, variant);
+      LP_COUNT_ADD(llvm_compile_time, os_time_get() - t0);
+
+      if (!compiled) {
+         /* The background compile failed, retry below. */
+         llvmpipe_remove_shader_variant(lp, variant);
+         lp_fs_variant_reference(lp, &variant, NULL);
       }
-      li = next_elem(li);
    }
 
    if (variant) {
@@ -4263,6 +4665,7 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
    }
 
    /* Bind this variant */
+   lp->fs_variant = variant;
    lp_setup_set_fs_variant(lp->setup, variant);
 }
 
@@ -37,12 +37,23 @@
 #include "gallivm/lp_bld_tgsi.h" /* for lp_tgsi_info */
 #include "lp_bld_interp.h" /* for struct lp_shader_input */
 #include "util/u_inlines.h"
+#include "util/u_queue.h"
 #include "lp_jit.h"
 
 struct tgsi_token;
+struct nir_shader;
 struct lp_fragment_shader;
+struct lp_fs_optimize_job;
 
 
+/** Values of lp_fragment_shader_variant::opt_state */
+enum lp_fs_opt_state {
+   LP_FS_OPT_NONE,
+   LP_FS_OPT_QUEUED,
+   LP_FS_OPT_INSTALLED,
+   LP_FS_OPT_FAILED,
+};
+
 /** Indexes into jit_function[] array */
 #define RAST_WHOLE 0
 #define RAST_EDGE_TEST 1
@@ -140,6 +151,16 @@ struct lp_fragment_shader_variant
    struct pipe_reference reference;
    boolean opaque;
 
+   /*
+    * Hierarchical Z, see lp_setup_hiz_occluded():  hiz_test if primitives
+    * behind a tile's maximum depth can be culled, hiz_write if primitives
+    * covering a tile can lower it, hiz_invalidate if depth writes may
+    * raise it.
+    */
+   boolean hiz_test;
+   boolean hiz_write;
+   boolean hiz_invalidate;
+
    struct gallivm_state *gallivm;
 
    LLVMTypeRef jit_context_ptr_type;
@@ -159,6 +180,34 @@ struct lp_fragment_shader_variant
    /* For debugging/profiling purposes */
    unsigned no;
 
+   /*
+    * Variants precompiled on the context's compile queue.  They own their
+    * LLVMContext and a copy of the shader NIR (lp_build_nir_soa lowers it in
+    * place), and must be waited on before use.
+    */
+   struct util_queue_fence ready;
+   boolean pending;
+   LLVMContextRef context;
+   struct nir_shader *nir;
+
+   /*
+    * Tiered compilation (LP_TIERED_COMPILE): tier0 variants were compiled
+    * without optimizations.  After enough draws, in whichever context, the
+    * first one to move opt_state from LP_FS_OPT_NONE to LP_FS_OPT_QUEUED
+    * queues the optimized rebuild.  It is built into opt_job, then only
+    * jit_function and opt_state of the variant are written, with release
+    * stores.  tier0_scenes counts the scenes referencing the variant that
+    * were binned before opt_state became LP_FS_OPT_INSTALLED, the tier0
+    * code in gallivm is freed once they have all been rasterized.
+    */
+   boolean tier0;
+   int opt_state;
+   int tier0_scenes;
+   unsigned draws;
+   struct util_queue_fence optimized;
+   struct lp_fs_optimize_job *opt_job;
+   LLVMContextRef tier0_context;
+
    /* key is variable-sized, must be last */
    struct lp_fragment_shader_variant_key key;
 };
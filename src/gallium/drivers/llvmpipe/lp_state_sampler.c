@@ -40,6 +40,7 @@
 #include "lp_debug.h"
 #include "frontend/sw_winsys.h"
 #include "lp_flush.h"
+#include "lp_texture.h"
 
 
 static void *
@@ -148,8 +149,18 @@ llvmpipe_set_sampler_views(struct pipe_context *pipe,
                       "context\n", i);
       }
 
-      if (view)
-         llvmpipe_flush_resource(pipe, view->texture, 0, true, false, false, "sampler_view");
+      if (view) {
+         /* The draw module only samples rows, and samples them on this
+          * thread at draw time, so it has to wait for scenes writing them.
+          */
+         boolean draw_module = shader != PIPE_SHADER_FRAGMENT &&
+                               shader != PIPE_SHADER_COMPUTE;
+
+         if (draw_module)
+            llvmpipe_resource_untile(pipe, view->texture);
+         llvmpipe_flush_resource(pipe, view->texture, 0, true, draw_module,
+                                 false, "sampler_view");
+      }
       pipe_sampler_view_reference(&llvmpipe->sampler_views[shader][start + i],
                                   view);
    }
@@ -551,6 +562,24 @@ llvmpipe_prepare_tess_eval_images(struct llvmpipe_context *lp,
    prepare_shader_images(lp, num, views, PIPE_SHADER_TESS_EVAL);
 }
 
+/**
+ * lp_sampler_static_texture_state() for fragment and compute shaders,
+ * which sample the uncompressed copy of a texture if there is one, and
+ * know about tiled textures.
+ */
+void
+llvmpipe_sampler_static_texture_state(struct lp_static_texture_state *state,
+                                      const struct pipe_sampler_view *view)
+{
+   enum pipe_format format = llvmpipe_sampler_view_decompressed_format(view);
+
+   lp_sampler_static_texture_state(state, view);
+   if (format != PIPE_FORMAT_NONE)
+      state->format = format;
+   else if (view && view->texture)
+      state->tiled = llvmpipe_resource_const(view->texture)->tiled;
+}
+
 void
 llvmpipe_init_sampler_funcs(struct llvmpipe_context *llvmpipe)
 {
@@ -196,6 +196,9 @@ llvmpipe_create_surface(struct pipe_context *pipe,
       }
    }
 
+   /* rendering goes through rows */
+   llvmpipe_resource_untile(pipe, pt);
+
    ps = CALLOC_STRUCT(pipe_surface);
    if (ps) {
       pipe_reference_init(&ps->reference, 1);
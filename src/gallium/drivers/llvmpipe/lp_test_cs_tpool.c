@@ -0,0 +1,174 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The Mesa Authors.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Compute shader thread pool tests.
+ * Checks every block of a dispatch runs exactly once and measures the
+ * dispatch overhead per block with an empty work function.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "util/u_atomic.h"
+#include "util/u_memory.h"
+#include "util/os_time.h"
+
+#include "lp_cs_tpool.h"
+#include "lp_test.h"
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "threads\t"
+           "blocks\t"
+           "ns_per_block\n");
+
+   fflush(fp);
+}
+
+
+static void
+count_block(void *data, int iter_idx, struct lp_cs_local_mem *lmem)
+{
+   unsigned *counts = data;
+
+   p_atomic_inc(&counts[iter_idx]);
+}
+
+
+static void
+empty_block(void *data, int iter_idx, struct lp_cs_local_mem *lmem)
+{
+}
+
+
+static boolean
+test_cs_tpool(unsigned verbose, FILE *fp,
+              unsigned num_threads, unsigned num_blocks)
+{
+   struct lp_cs_tpool *pool;
+   struct lp_cs_tpool_task *task;
+   unsigned *counts;
+   int64_t start, end;
+   double ns_per_block;
+   boolean success = TRUE;
+   unsigned i;
+
+   pool = lp_cs_tpool_create(num_threads);
+   counts = CALLOC(num_blocks, sizeof(*counts));
+   if (!pool || !counts) {
+      lp_cs_tpool_destroy(pool);
+      FREE(counts);
+      return FALSE;
+   }
+
+   task = lp_cs_tpool_queue_task(pool, count_block, counts, num_blocks);
+   lp_cs_tpool_wait_for_task(pool, &task);
+
+   for (i = 0; i < num_blocks; i++) {
+      if (counts[i] != 1) {
+         if (verbose || !success)
+            fprintf(stderr, "block %u ran %u times\n", i, counts[i]);
+         success = FALSE;
+      }
+   }
+
+   start = os_time_get_nano();
+   task = lp_cs_tpool_queue_task(pool, empty_block, NULL, num_blocks);
+   lp_cs_tpool_wait_for_task(pool, &task);
+   end = os_time_get_nano();
+
+   ns_per_block = (double)(end - start) / num_blocks;
+
+   if (verbose || !success)
+      fprintf(stdout, "%s: %u threads, %u blocks, %.1f ns/block\n",
+              success ? "PASS" : "FAIL", num_threads, num_blocks,
+              ns_per_block);
+
+   if (fp) {
+      fprintf(fp, "%s\t%u\t%u\t%.1f\n",
+              success ? "pass" : "fail", num_threads, num_blocks,
+              ns_per_block);
+      fflush(fp);
+   }
+
+   lp_cs_tpool_destroy(pool);
+   FREE(counts);
+
+   return success;
+}
+
+
+static const unsigned thread_counts[] = { 0, 1, 2, 4, 8, 16 };
+
+static const unsigned block_counts[] = { 1, 3, 64, 1000, 4096, 1 << 20 };
+
+
+boolean
+test_all(unsigned verbose, FILE *fp)
+{
+   boolean success = TRUE;
+   unsigned i, j;
+
+   for (i = 0; i < ARRAY_SIZE(thread_counts); i++) {
+      for (j = 0; j < ARRAY_SIZE(block_counts); j++) {
+         if (!test_cs_tpool(verbose, fp, thread_counts[i], block_counts[j]))
+            success = FALSE;
+      }
+   }
+
+   return success;
+}
+
+
+boolean
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   boolean success = TRUE;
+   unsigned long i;
+
+   n = MIN2(n, 16);
+   for (i = 0; i < n; i++) {
+      unsigned num_threads = thread_counts[rand() % ARRAY_SIZE(thread_counts)];
+      unsigned num_blocks = block_counts[rand() % ARRAY_SIZE(block_counts)];
+
+      if (!test_cs_tpool(verbose, fp, num_threads, num_blocks))
+         success = FALSE;
+   }
+
+   return success;
+}
+
+
+boolean
+test_single(unsigned verbose, FILE *fp)
+{
+   return test_cs_tpool(verbose, fp, 4, 1 << 20);
+}
@@ -0,0 +1,376 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The Mesa Authors.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * JIT linking tests.
+ * Runs code that reads constant data, calls a mapped external function and
+ * is reloaded from its cached object, through whichever of the orc session
+ * or MCJIT GALLIVM_PERF selects.  Also checks the constants are not mapped
+ * executable.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "util/u_memory.h"
+#include "util/u_pointer.h"
+#include "gallivm/lp_bld.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_misc.h"
+
+#include "lp_test.h"
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "test\n");
+
+   fflush(fp);
+}
+
+
+typedef int32_t (*test_jit_table_t)(int32_t i);
+typedef const int32_t *(*test_jit_table_ptr_t)(void);
+typedef int32_t (*test_jit_call_t)(int32_t i);
+
+
+static const int32_t table_values[4] = { 3, 5, 7, 11 };
+
+
+static int32_t
+test_jit_external(int32_t i)
+{
+   return i * 2;
+}
+
+
+/*
+ * int32_t test_jit_table(int32_t i) { return table[i & 3]; }
+ * const int32_t *test_jit_table_ptr(void) { return table; }
+ */
+static void
+add_table_test(struct gallivm_state *gallivm)
+{
+   LLVMContextRef context = gallivm->context;
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef i32t = LLVMInt32TypeInContext(context);
+   LLVMTypeRef table_type = LLVMArrayType(i32t, ARRAY_SIZE(table_values));
+   LLVMValueRef values[ARRAY_SIZE(table_values)];
+   LLVMValueRef table, func, index, ptr;
+   LLVMBasicBlockRef block;
+   unsigned i;
+
+   for (i = 0; i < ARRAY_SIZE(table_values); i++)
+      values[i] = LLVMConstInt(i32t, table_values[i], 0);
+
+   table = LLVMAddGlobal(gallivm->module, table_type, "test_jit_table_data");
+   LLVMSetInitializer(table, LLVMConstArray(i32t, values, ARRAY_SIZE(values)));
+   LLVMSetGlobalConstant(table, TRUE);
+   LLVMSetLinkage(table, LLVMPrivateLinkage);
+
+   func = LLVMAddFunction(gallivm->module, "test_jit_table",
+                          LLVMFunctionType(i32t, &i32t, 1, 0));
+   LLVMSetFunctionCallConv(func, LLVMCCallConv);
+   block = LLVMAppendBasicBlockInContext(context, func, "entry");
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   LLVMValueRef indices[2] = {
+      LLVMConstInt(i32t, 0, 0),
+      LLVMBuildAnd(builder, LLVMGetParam(func, 0),
+                   LLVMConstInt(i32t, ARRAY_SIZE(table_values) - 1, 0), ""),
+   };
+   ptr = LLVMBuildGEP(builder, table, indices, 2, "");
+   LLVMBuildRet(builder, LLVMBuildLoad(builder, ptr, ""));
+   gallivm_verify_function(gallivm, func);
+
+   func = LLVMAddFunction(gallivm->module, "test_jit_table_ptr",
+                          LLVMFunctionType(LLVMPointerType(i32t, 0),
+                                           NULL, 0, 0));
+   LLVMSetFunctionCallConv(func, LLVMCCallConv);
+   block = LLVMAppendBasicBlockInContext(context, func, "entry");
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   index = LLVMConstInt(i32t, 0, 0);
+   indices[0] = index;
+   indices[1] = index;
+   LLVMBuildRet(builder, LLVMBuildGEP(builder, table, indices, 2, ""));
+   gallivm_verify_function(gallivm, func);
+}
+
+
+/*
+ * int32_t test_jit_call(int32_t i) { return test_jit_external(i) + 1; }
+ */
+static LLVMValueRef
+add_call_test(struct gallivm_state *gallivm, LLVMValueRef *external)
+{
+   LLVMContextRef context = gallivm->context;
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef i32t = LLVMInt32TypeInContext(context);
+   LLVMTypeRef func_type = LLVMFunctionType(i32t, &i32t, 1, 0);
+   LLVMValueRef func, arg, ret;
+
+   *external = LLVMAddFunction(gallivm->module, "test_jit_external",
+                               func_type);
+
+   func = LLVMAddFunction(gallivm->module, "test_jit_call", func_type);
+   LLVMSetFunctionCallConv(func, LLVMCCallConv);
+   LLVMPositionBuilderAtEnd(builder,
+                            LLVMAppendBasicBlockInContext(context, func,
+                                                          "entry"));
+
+   arg = LLVMGetParam(func, 0);
+   ret = LLVMBuildCall(builder, *external, &arg, 1, "");
+   LLVMBuildRet(builder, LLVMBuildAdd(builder, ret,
+                                      LLVMConstInt(i32t, 1, 0), ""));
+   gallivm_verify_function(gallivm, func);
+
+   return func;
+}
+
+
+/*
+ * Whether the page holding ptr is mapped executable.  Only known on Linux,
+ * elsewhere this always returns FALSE.
+ */
+static boolean
+is_executable(const void *ptr)
+{
+   boolean exec = FALSE;
+#if defined(__linux__)
+   uintptr_t addr = (uintptr_t)ptr;
+   char line[512];
+   FILE *maps = fopen("/proc/self/maps", "r");
+
+   if (!maps)
+      return FALSE;
+
+   while (fgets(line, sizeof line, maps)) {
+      uintptr_t begin, end;
+      char perms[5];
+
+      if (sscanf(line, "%" SCNxPTR "-%" SCNxPTR " %4s",
+                 &begin, &end, perms) != 3)
+         continue;
+
+      if (addr >= begin && addr < end) {
+         exec = perms[2] == 'x';
+         break;
+      }
+   }
+
+   fclose(maps);
+#endif
+   return exec;
+}
+
+
+static boolean
+check_table(unsigned verbose, FILE *fp, const char *name,
+            test_jit_table_t table_func, test_jit_table_ptr_t table_ptr_func)
+{
+   boolean success = TRUE;
+   const int32_t *table;
+   unsigned i;
+
+   for (i = 0; i < 2 * ARRAY_SIZE(table_values); i++) {
+      int32_t value = table_func(i);
+      if (value != table_values[i % ARRAY_SIZE(table_values)]) {
+         if (verbose)
+            fprintf(stderr, "%s: table[%u] = %i, expected %i\n", name, i,
+                    value, table_values[i % ARRAY_SIZE(table_values)]);
+         success = FALSE;
+      }
+   }
+
+   table = table_ptr_func();
+   if (memcmp(table, table_values, sizeof(table_values)) != 0) {
+      if (verbose)
+         fprintf(stderr, "%s: table contents differ\n", name);
+      success = FALSE;
+   }
+
+   if (is_executable(table)) {
+      if (verbose)
+         fprintf(stderr, "%s: constant data is mapped executable\n", name);
+      success = FALSE;
+   }
+
+   if (fp)
+      fprintf(fp, "%s\t%s\n", success ? "pass" : "fail", name);
+
+   return success;
+}
+
+
+PIPE_ALIGN_STACK
+static boolean
+test_table(unsigned verbose, FILE *fp)
+{
+   static const char *names[2] = { "test_jit_table", "test_jit_table_ptr" };
+   struct lp_cached_code cached = { 0 }, copy = { 0 };
+   LLVMContextRef context;
+   struct gallivm_state *gallivm;
+   func_pointer funcs[2];
+   LLVMValueRef table_func, table_ptr_func;
+   boolean success = TRUE;
+
+   context = LLVMContextCreate();
+   gallivm = gallivm_create("test_jit_table", context, &cached);
+
+   add_table_test(gallivm);
+   table_func = LLVMGetNamedFunction(gallivm->module, names[0]);
+   table_ptr_func = LLVMGetNamedFunction(gallivm->module, names[1]);
+
+   gallivm_compile_module(gallivm);
+
+   funcs[0] = gallivm_jit_function(gallivm, table_func);
+   funcs[1] = gallivm_jit_function(gallivm, table_ptr_func);
+
+   /* Keep the object the module was compiled to, like the shader cache
+    * does, gallivm_free_ir() releases it.
+    */
+   if (cached.data_size) {
+      copy.data = malloc(cached.data_size);
+      memcpy(copy.data, cached.data, cached.data_size);
+      copy.data_size = cached.data_size;
+   }
+
+   gallivm_free_ir(gallivm);
+
+   if (!check_table(verbose, fp, "table",
+                    (test_jit_table_t)funcs[0],
+                    (test_jit_table_ptr_t)funcs[1]))
+      success = FALSE;
+
+   gallivm_destroy(gallivm);
+   LLVMContextDispose(context);
+
+   /* Link the cached object again. */
+   if (!copy.data_size) {
+      if (verbose)
+         fprintf(stderr, "table: no object was cached\n");
+      return FALSE;
+   }
+
+   gallivm = gallivm_load_cached("test_jit_table", &copy,
+                                 ARRAY_SIZE(names), names, funcs);
+   if (!gallivm) {
+      if (verbose)
+         fprintf(stderr, "table: loading the cached object failed\n");
+      free(copy.data);
+      return FALSE;
+   }
+
+   if (!check_table(verbose, fp, "cached_table",
+                    (test_jit_table_t)funcs[0],
+                    (test_jit_table_ptr_t)funcs[1]))
+      success = FALSE;
+
+   gallivm_destroy(gallivm);
+   free(copy.data);
+
+   return success;
+}
+
+
+PIPE_ALIGN_STACK
+static boolean
+test_call(unsigned verbose, FILE *fp)
+{
+   LLVMContextRef context;
+   struct gallivm_state *gallivm;
+   LLVMValueRef func, external;
+   test_jit_call_t call_func;
+   boolean success = TRUE;
+   int32_t i;
+
+   context = LLVMContextCreate();
+   gallivm = gallivm_create("test_jit_call", context, NULL);
+
+   func = add_call_test(gallivm, &external);
+
+   gallivm_compile_module(gallivm);
+
+   /* Mappings can be added until the first function is looked up. */
+   gallivm_add_global_mapping(gallivm, external,
+                              func_to_pointer((func_pointer)test_jit_external));
+
+   call_func = (test_jit_call_t)gallivm_jit_function(gallivm, func);
+
+   gallivm_free_ir(gallivm);
+
+   for (i = -4; i < 4; i++) {
+      if (call_func(i) != test_jit_external(i) + 1) {
+         if (verbose)
+            fprintf(stderr, "call: test_jit_call(%i) = %i, expected %i\n",
+                    i, call_func(i), test_jit_external(i) + 1);
+         success = FALSE;
+      }
+   }
+
+   if (fp)
+      fprintf(fp, "%s\tcall\n", success ? "pass" : "fail");
+
+   gallivm_destroy(gallivm);
+   LLVMContextDispose(context);
+
+   return success;
+}
+
+
+boolean
+test_all(unsigned verbose, FILE *fp)
+{
+   boolean success = TRUE;
+
+   if (!test_table(verbose, fp))
+      success = FALSE;
+
+   if (!test_call(verbose, fp))
+      success = FALSE;
+
+   return success;
+}
+
+
+boolean
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_all(verbose, fp);
+}
+
+
+boolean
+test_single(unsigned verbose, FILE *fp)
+{
+   return test_all(verbose, fp);
+}
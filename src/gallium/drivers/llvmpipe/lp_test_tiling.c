@@ -0,0 +1,577 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The Mesa Authors.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * Tiled texture layout tests.
+ * Checks the texel offsets the sampler generates for tiled textures, also
+ * after the texcoord wrapping of the AoS paths, against
+ * llvmpipe_tiled_offset(), and measures fetching bilinear footprints down
+ * the columns of a texture in both layouts.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "util/u_memory.h"
+#include "util/u_pointer.h"
+#include "util/os_time.h"
+#include "util/format/u_format.h"
+
+#include "gallivm/lp_bld.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_const.h"
+#include "gallivm/lp_bld_sample.h"
+#include "gallivm/lp_bld_sample_aos.h"
+
+#include "lp_texture.h"
+#include "lp_test.h"
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "format\t"
+           "layout\t"
+           "ns_per_footprint\n");
+
+   fflush(fp);
+}
+
+
+static void
+write_tsv_row(FILE *fp,
+              const struct util_format_description *desc,
+              boolean tiled,
+              double ns_per_footprint,
+              boolean success)
+{
+   fprintf(fp, "%s\t%s\t%s\t%.2f\n",
+           success ? "pass" : "fail",
+           desc->short_name,
+           tiled ? "tiled" : "linear",
+           ns_per_footprint);
+
+   fflush(fp);
+}
+
+
+typedef void
+(*offset_ptr_t)(int32_t *offset, const int32_t *x, const int32_t *y,
+                int32_t row_stride);
+
+
+static LLVMValueRef
+add_offset_test(struct gallivm_state *gallivm,
+                const struct util_format_description *desc,
+                boolean tiled)
+{
+   LLVMContextRef context = gallivm->context;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_type type = lp_type_int_vec(32, 128);
+   struct lp_build_context bld;
+   LLVMTypeRef vec_ptr_type;
+   LLVMTypeRef args[4];
+   LLVMValueRef func, x, y, row_stride, offset, i, j;
+   LLVMBasicBlockRef block;
+
+   lp_build_context_init(&bld, gallivm, type);
+   vec_ptr_type = LLVMPointerType(bld.vec_type, 0);
+
+   args[0] = args[1] = args[2] = vec_ptr_type;
+   args[3] = LLVMInt32TypeInContext(context);
+
+   func = LLVMAddFunction(gallivm->module, "offset",
+                          LLVMFunctionType(LLVMVoidTypeInContext(context),
+                                           args, ARRAY_SIZE(args), 0));
+   LLVMSetFunctionCallConv(func, LLVMCCallConv);
+
+   block = LLVMAppendBasicBlockInContext(context, func, "entry");
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   x = LLVMBuildLoad(builder, LLVMGetParam(func, 1), "");
+   y = LLVMBuildLoad(builder, LLVMGetParam(func, 2), "");
+   row_stride = lp_build_broadcast_scalar(&bld, LLVMGetParam(func, 3));
+
+   lp_build_sample_offset(&bld, desc, tiled, x, y, NULL,
+                          row_stride, NULL, &offset, &i, &j);
+
+   LLVMBuildStore(builder, offset, LLVMGetParam(func, 0));
+   LLVMBuildRetVoid(builder);
+
+   gallivm_verify_function(gallivm, func);
+
+   return func;
+}
+
+
+typedef void
+(*wrap_ptr_t)(int32_t *offset0, int32_t *offset1, const int32_t *coord,
+              const float *coord_f, int32_t length, int32_t stride,
+              int32_t tile_step);
+
+
+struct wrap_test {
+   const char *name;
+   boolean linear;
+   unsigned wrap_mode;
+   boolean is_pot;
+};
+
+
+static const struct wrap_test wrap_tests[] = {
+   { "nearest_repeat_pot", FALSE, PIPE_TEX_WRAP_REPEAT, TRUE },
+   { "nearest_repeat_npot", FALSE, PIPE_TEX_WRAP_REPEAT, FALSE },
+   { "nearest_clamp_to_edge", FALSE, PIPE_TEX_WRAP_CLAMP_TO_EDGE, FALSE },
+   { "linear_repeat_pot", TRUE, PIPE_TEX_WRAP_REPEAT, TRUE },
+   { "linear_repeat_npot", TRUE, PIPE_TEX_WRAP_REPEAT, FALSE },
+   { "linear_clamp_to_edge", TRUE, PIPE_TEX_WRAP_CLAMP_TO_EDGE, FALSE },
+};
+
+
+/*
+ * Wrap one texcoord axis with lp_build_sample_wrap_nearest_int() or
+ * lp_build_sample_wrap_linear_int(), and return the offsets of both texels
+ * of the footprint (the same one twice for nearest).
+ */
+static LLVMValueRef
+add_wrap_test(struct gallivm_state *gallivm,
+              const struct wrap_test *test,
+              boolean tiled)
+{
+   LLVMContextRef context = gallivm->context;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_build_sample_context bld;
+   LLVMTypeRef args[7];
+   LLVMValueRef func, coord, coord_f, length, stride, tile_step = NULL;
+   LLVMValueRef offset0, offset1, weight, i0, i1;
+   LLVMBasicBlockRef block;
+
+   memset(&bld, 0, sizeof bld);
+   bld.gallivm = gallivm;
+   bld.coord_type = lp_type_float_vec(32, 128);
+   bld.int_coord_type = lp_int_type(bld.coord_type);
+   lp_build_context_init(&bld.coord_bld, gallivm, bld.coord_type);
+   lp_build_context_init(&bld.int_coord_bld, gallivm, bld.int_coord_type);
+
+   args[0] = args[1] = args[2] = LLVMPointerType(bld.int_coord_bld.vec_type, 0);
+   args[3] = LLVMPointerType(bld.coord_bld.vec_type, 0);
+   args[4] = args[5] = args[6] = LLVMInt32TypeInContext(context);
+
+   func = LLVMAddFunction(gallivm->module, test->name,
+                          LLVMFunctionType(LLVMVoidTypeInContext(context),
+                                           args, ARRAY_SIZE(args), 0));
+   LLVMSetFunctionCallConv(func, LLVMCCallConv);
+
+   block = LLVMAppendBasicBlockInContext(context, func, "entry");
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   coord = LLVMBuildLoad(builder, LLVMGetParam(func, 2), "");
+   coord_f = LLVMBuildLoad(builder, LLVMGetParam(func, 3), "");
+   length = lp_build_broadcast_scalar(&bld.int_coord_bld,
+                                      LLVMGetParam(func, 4));
+   stride = lp_build_broadcast_scalar(&bld.int_coord_bld,
+                                      LLVMGetParam(func, 5));
+   if (tiled)
+      tile_step = lp_build_broadcast_scalar(&bld.int_coord_bld,
+                                            LLVMGetParam(func, 6));
+
+   if (test->linear) {
+      weight = bld.int_coord_bld.zero;
+      lp_build_sample_wrap_linear_int(&bld, 1, coord, &weight, coord_f,
+                                      length, stride, tile_step, NULL,
+                                      test->is_pot, test->wrap_mode,
+                                      &offset0, &offset1, &i0, &i1);
+   }
+   else {
+      lp_build_sample_wrap_nearest_int(&bld, 1, coord, coord_f,
+                                       length, stride, tile_step, NULL,
+                                       test->is_pot, test->wrap_mode,
+                                       &offset0, &i0);
+      offset1 = offset0;
+   }
+
+   LLVMBuildStore(builder, offset0, LLVMGetParam(func, 0));
+   LLVMBuildStore(builder, offset1, LLVMGetParam(func, 1));
+   LLVMBuildRetVoid(builder);
+
+   gallivm_verify_function(gallivm, func);
+
+   return func;
+}
+
+
+static int32_t
+wrap_coord(const struct wrap_test *test, int32_t coord, int32_t length)
+{
+   if (test->wrap_mode == PIPE_TEX_WRAP_REPEAT)
+      return ((coord % length) + length) % length;
+   else
+      return CLAMP(coord, 0, length - 1);
+}
+
+
+/*
+ * Byte offset along one axis of a texel, in the layout the axis and
+ * tiling select.
+ */
+static int32_t
+axis_offset(boolean tiled, boolean y_axis, int32_t coord,
+            int32_t row_stride, unsigned block_size)
+{
+   if (!tiled)
+      return coord * (y_axis ? row_stride : block_size);
+   else if (y_axis)
+      return llvmpipe_tiled_offset(0, coord, row_stride, block_size);
+   else
+      return llvmpipe_tiled_offset(coord, 0, row_stride, block_size);
+}
+
+
+/**
+ * Check the texel offsets the AoS texcoord wrapping produces for both axes
+ * of a tiled or linear texture.
+ */
+PIPE_ALIGN_STACK
+static boolean
+test_wrap(unsigned verbose, FILE *fp,
+          const struct wrap_test *test,
+          boolean tiled, unsigned n)
+{
+   const struct util_format_description *desc =
+      util_format_description(PIPE_FORMAT_R8G8B8A8_UNORM);
+   const unsigned block_size = 4;
+   LLVMContextRef context;
+   struct gallivm_state *gallivm;
+   LLVMValueRef func;
+   wrap_ptr_t wrap_ptr;
+   PIPE_ALIGN_VAR(16) int32_t coord[4];
+   PIPE_ALIGN_VAR(16) float coord_f[4];
+   PIPE_ALIGN_VAR(16) int32_t offset0[4];
+   PIPE_ALIGN_VAR(16) int32_t offset1[4];
+   boolean success = TRUE;
+   unsigned i, k;
+
+   context = LLVMContextCreate();
+   gallivm = gallivm_create("test_module_tiling_wrap", context, NULL);
+
+   func = add_wrap_test(gallivm, test, tiled);
+
+   gallivm_compile_module(gallivm);
+
+   wrap_ptr = (wrap_ptr_t) gallivm_jit_function(gallivm, func);
+
+   gallivm_free_ir(gallivm);
+
+   for (i = 0; i < n; i++) {
+      boolean y_axis = i & 1;
+      int32_t length = test->is_pot ? 1 << (rand() % 10) : 1 + rand() % 300;
+      int32_t row_stride = (1 + rand() % 256) *
+                           LP_SAMPLER_TILE_SIZE * block_size;
+      int32_t stride, tile_step;
+
+      /*
+       * Along x a tile step is one texel and the stride one tile, along y
+       * the step is one row of a tile and the stride a row of texels.
+       */
+      if (y_axis) {
+         stride = row_stride;
+         tile_step = LP_SAMPLER_TILE_SIZE * block_size;
+      }
+      else {
+         stride = tiled ? LP_SAMPLER_TILE_SIZE * block_size : block_size;
+         tile_step = block_size;
+      }
+
+      for (k = 0; k < 4; k++) {
+         coord[k] = rand() % (5 * length) - 2 * length;
+         /* texel centers, so the float and integer paths agree */
+         coord_f[k] = (coord[k] + 0.5f) / length;
+      }
+
+      wrap_ptr(offset0, offset1, coord, coord_f, length, stride, tile_step);
+
+      for (k = 0; k < 4; k++) {
+         int32_t c0 = wrap_coord(test, coord[k], length);
+         int32_t c1 = test->linear ?
+                      wrap_coord(test, coord[k] + 1, length) : c0;
+         int32_t expected0 = axis_offset(tiled, y_axis, c0, row_stride,
+                                         block_size);
+         int32_t expected1 = axis_offset(tiled, y_axis, c1, row_stride,
+                                         block_size);
+
+         if (offset0[k] != expected0 || offset1[k] != expected1) {
+            if (verbose || success)
+               printf("FAILED: %s %s %c %d of %d: (%d, %d) obtained, "
+                      "(%d, %d) expected\n",
+                      test->name, tiled ? "tiled" : "linear",
+                      y_axis ? 'y' : 'x', coord[k], length,
+                      offset0[k], offset1[k], expected0, expected1);
+            success = FALSE;
+         }
+      }
+   }
+
+   gallivm_destroy(gallivm);
+   LLVMContextDispose(context);
+
+   if (verbose)
+      printf("%s: %s %s\n", success ? "PASS" : "FAIL", test->name,
+             tiled ? "tiled" : "linear");
+
+   if (fp)
+      write_tsv_row(fp, desc, tiled, 0.0, success);
+
+   return success;
+}
+
+
+/**
+ * Sum one texel of each bilinear footprint, walking the texture column by
+ * column, which is the worst case for rows.
+ */
+static double
+time_footprints(const uint32_t *data, unsigned width, unsigned height,
+                unsigned row_stride, boolean tiled, uint32_t *sum)
+{
+   int64_t start, end;
+   unsigned x, y;
+   uint32_t acc = 0;
+
+   start = os_time_get_nano();
+   for (x = 0; x + 1 < width; x++) {
+      for (y = 0; y + 1 < height; y++) {
+         unsigned o00, o10, o01, o11;
+
+         if (tiled) {
+            o00 = llvmpipe_tiled_offset(x, y, row_stride, 4);
+            o10 = llvmpipe_tiled_offset(x + 1, y, row_stride, 4);
+            o01 = llvmpipe_tiled_offset(x, y + 1, row_stride, 4);
+            o11 = llvmpipe_tiled_offset(x + 1, y + 1, row_stride, 4);
+         }
+         else {
+            o00 = y * row_stride + x * 4;
+            o10 = o00 + 4;
+            o01 = o00 + row_stride;
+            o11 = o01 + 4;
+         }
+         acc += data[o00 / 4] + data[o10 / 4] + data[o01 / 4] + data[o11 / 4];
+      }
+   }
+   end = os_time_get_nano();
+
+   *sum = acc;
+   return (double)(end - start) / ((width - 1) * (height - 1));
+}
+
+
+/**
+ * Check the footprint walk finds the same texels in both layouts, and
+ * report how long each takes.
+ */
+static boolean
+test_footprints(unsigned verbose, FILE *fp, unsigned size)
+{
+   const struct util_format_description *desc =
+      util_format_description(PIPE_FORMAT_R8G8B8A8_UNORM);
+   unsigned row_stride = size * 4;
+   uint32_t *linear, *tiled;
+   uint32_t linear_sum, tiled_sum;
+   double linear_ns, tiled_ns;
+   boolean success;
+   unsigned x, y;
+
+   linear = MALLOC(row_stride * size);
+   tiled = MALLOC(row_stride * size);
+   if (!linear || !tiled) {
+      FREE(linear);
+      FREE(tiled);
+      return FALSE;
+   }
+
+   for (y = 0; y < size; y++) {
+      for (x = 0; x < size; x++) {
+         uint32_t texel = rand();
+         linear[(y * row_stride + x * 4) / 4] = texel;
+         tiled[llvmpipe_tiled_offset(x, y, row_stride, 4) / 4] = texel;
+      }
+   }
+
+   linear_ns = time_footprints(linear, size, size, row_stride, FALSE,
+                               &linear_sum);
+   tiled_ns = time_footprints(tiled, size, size, row_stride, TRUE,
+                              &tiled_sum);
+   success = linear_sum == tiled_sum;
+
+   if (verbose || !success)
+      fprintf(stdout, "%s: %ux%u %s, %.2f ns/footprint linear, "
+              "%.2f ns/footprint tiled\n",
+              success ? "PASS" : "FAIL", size, size, desc->short_name,
+              linear_ns, tiled_ns);
+
+   if (fp) {
+      write_tsv_row(fp, desc, FALSE, linear_ns, success);
+      write_tsv_row(fp, desc, TRUE, tiled_ns, success);
+   }
+
+   FREE(linear);
+   FREE(tiled);
+
+   return success;
+}
+
+
+PIPE_ALIGN_STACK
+static boolean
+test_offsets(unsigned verbose, FILE *fp,
+             const struct util_format_description *desc,
+             boolean tiled, unsigned n)
+{
+   LLVMContextRef context;
+   struct gallivm_state *gallivm;
+   LLVMValueRef func;
+   offset_ptr_t offset_ptr;
+   PIPE_ALIGN_VAR(16) int32_t x[4];
+   PIPE_ALIGN_VAR(16) int32_t y[4];
+   PIPE_ALIGN_VAR(16) int32_t offset[4];
+   unsigned block_size = desc->block.bits / 8;
+   boolean success = TRUE;
+   unsigned i, k;
+
+   context = LLVMContextCreate();
+   gallivm = gallivm_create("test_module_tiling", context, NULL);
+
+   func = add_offset_test(gallivm, desc, tiled);
+
+   gallivm_compile_module(gallivm);
+
+   offset_ptr = (offset_ptr_t) gallivm_jit_function(gallivm, func);
+
+   gallivm_free_ir(gallivm);
+
+   for (i = 0; i < n; i++) {
+      /* row strides are multiples of the tile width */
+      int32_t row_stride = (1 + rand() % 256) *
+                           LP_SAMPLER_TILE_SIZE * block_size;
+
+      for (k = 0; k < 4; k++) {
+         x[k] = rand() % (row_stride / block_size);
+         y[k] = rand() % 1024;
+      }
+
+      offset_ptr(offset, x, y, row_stride);
+
+      for (k = 0; k < 4; k++) {
+         int32_t expected = tiled ?
+            llvmpipe_tiled_offset(x[k], y[k], row_stride, block_size) :
+            y[k] * row_stride + x[k] * block_size;
+
+         if (offset[k] != expected) {
+            if (verbose || success)
+               printf("FAILED: %s %s (%d, %d) stride %d: %d obtained, "
+                      "%d expected\n",
+                      desc->short_name, tiled ? "tiled" : "linear",
+                      x[k], y[k], row_stride, offset[k], expected);
+            success = FALSE;
+         }
+      }
+   }
+
+   gallivm_destroy(gallivm);
+   LLVMContextDispose(context);
+
+   if (fp)
+      write_tsv_row(fp, desc, tiled, 0.0, success);
+
+   return success;
+}
+
+
+static const enum pipe_format formats[] = {
+   PIPE_FORMAT_R8_UNORM,
+   PIPE_FORMAT_R8G8B8A8_UNORM,
+   PIPE_FORMAT_R16G16B16A16_FLOAT,
+   PIPE_FORMAT_R32G32B32A32_FLOAT,
+};
+
+
+boolean
+test_all(unsigned verbose, FILE *fp)
+{
+   boolean success = TRUE;
+   unsigned i;
+
+   for (i = 0; i < ARRAY_SIZE(formats); i++) {
+      const struct util_format_description *desc =
+         util_format_description(formats[i]);
+
+      if (!test_offsets(verbose, fp, desc, FALSE, 1000))
+         success = FALSE;
+      if (!test_offsets(verbose, fp, desc, TRUE, 1000))
+         success = FALSE;
+   }
+
+   for (i = 0; i < ARRAY_SIZE(wrap_tests); i++) {
+      if (!test_wrap(verbose, fp, &wrap_tests[i], FALSE, 1000))
+         success = FALSE;
+      if (!test_wrap(verbose, fp, &wrap_tests[i], TRUE, 1000))
+         success = FALSE;
+   }
+
+   if (!test_footprints(verbose, fp, 2048))
+      success = FALSE;
+
+   return success;
+}
+
+
+boolean
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   const struct util_format_description *desc =
+      util_format_description(formats[rand() % ARRAY_SIZE(formats)]);
+   const struct wrap_test *test = &wrap_tests[rand() % ARRAY_SIZE(wrap_tests)];
+   boolean success = TRUE;
+
+   if (!test_offsets(verbose, fp, desc, TRUE, MAX2(n, 1)))
+      success = FALSE;
+   if (!test_wrap(verbose, fp, test, TRUE, MAX2(n, 1)))
+      success = FALSE;
+
+   return success;
+}
+
+
+boolean
+test_single(unsigned verbose, FILE *fp)
+{
+   return test_footprints(verbose, fp, 2048);
+}
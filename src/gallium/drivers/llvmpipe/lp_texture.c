@@ -42,6 +42,7 @@
 #include "util/u_memory.h"
 #include "util/simple_list.h"
 #include "util/u_transfer.h"
+#include "util/u_box.h"
 
 #include "lp_context.h"
 #include "lp_flush.h"
@@ -50,6 +51,7 @@
 #include "lp_setup.h"
 #include "lp_state.h"
 #include "lp_rast.h"
+#include "lp_cs_tpool.h"
 
 #include "frontend/sw_winsys.h"
 
@@ -243,6 +245,317 @@ llvmpipe_displaytarget_layout(struct llvmpipe_screen *screen,
 }
 
 
+/**
+ * Whether a texture is stored in tiles. The sampler only handles tiles of
+ * single pixel blocks, and everything that accesses the storage directly
+ * (rendering, images, vertex sampling, foreign mappings) needs rows, see
+ * llvmpipe_resource_untile(). Shareable textures are never tiled: display
+ * targets have their own layout, and textures backed by memory objects or
+ * other processes' storage don't go through alloc_backing.
+ */
+static bool
+llvmpipe_want_tiled(const struct llvmpipe_screen *screen,
+                    const struct llvmpipe_resource *lpr)
+{
+   const struct pipe_resource *pt = &lpr->base;
+
+   /* tiles must not straddle the padding of the texture layout */
+   STATIC_ASSERT(LP_SAMPLER_TILE_SIZE == LP_RASTER_BLOCK_SIZE);
+
+   return screen->tiled_textures &&
+          !llvmpipe_resource_is_1d(pt) &&
+          pt->nr_samples <= 1 &&
+          util_format_get_blockwidth(pt->format) == 1 &&
+          util_format_get_blockheight(pt->format) == 1 &&
+          !(pt->bind & (PIPE_BIND_LINEAR |
+                        PIPE_BIND_SHADER_IMAGE)) &&
+          !(pt->flags & (PIPE_RESOURCE_FLAG_MAP_PERSISTENT |
+                         PIPE_RESOURCE_FLAG_MAP_COHERENT));
+}
+
+
+/**
+ * Copy a box of one level of a tiled texture to or from a linear buffer.
+ * The texture may have been converted to rows while a box was mapped, in
+ * which case this copies rows.
+ */
+static void
+llvmpipe_tile_box(struct llvmpipe_resource *lpr,
+                  unsigned level,
+                  const struct pipe_box *box,
+                  ubyte *linear,
+                  unsigned stride,
+                  unsigned layer_stride,
+                  bool to_tiled)
+{
+   unsigned block_size = util_format_get_blocksize(lpr->base.format);
+   unsigned row_stride = lpr->row_stride[level];
+   int x, y, z;
+
+   for (z = 0; z < box->depth; z++) {
+      ubyte *image = llvmpipe_get_texture_image_address(lpr, box->z + z, level);
+
+      for (y = 0; y < box->height; y++) {
+         ubyte *row = linear + z * layer_stride + y * stride;
+
+         for (x = 0; x < box->width;) {
+            unsigned tx = box->x + x;
+            unsigned n;
+            ubyte *texel;
+
+            if (lpr->tiled) {
+               /* the texels up to the end of the tile are contiguous */
+               n = MIN2(LP_SAMPLER_TILE_SIZE -
+                        (tx & (LP_SAMPLER_TILE_SIZE - 1)),
+                        box->width - x);
+               texel = image + llvmpipe_tiled_offset(tx, box->y + y,
+                                                     row_stride, block_size);
+            }
+            else {
+               n = box->width - x;
+               texel = image + (box->y + y) * row_stride + tx * block_size;
+            }
+
+            if (to_tiled)
+               memcpy(texel, row + x * block_size, n * block_size);
+            else
+               memcpy(row + x * block_size, texel, n * block_size);
+            x += n;
+         }
+      }
+   }
+}
+
+
+/**
+ * Convert a tiled texture back to rows. This is one way, after this the
+ * texture stays linear for the rest of its life.
+ *
+ * The rows go to new storage rather than over the tiles: scenes in flight
+ * in any context may still sample the tiled storage, so it is left
+ * untouched and only freed with the resource. No flush is needed since
+ * tiled textures are never written by the rasterizer. The timestamp bump
+ * makes the next draws or dispatches of every context pick up the new
+ * storage and layout.
+ */
+void
+llvmpipe_resource_untile(struct pipe_context *pipe,
+                         struct pipe_resource *resource)
+{
+   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+   unsigned mip_align = MAX2(64, util_get_cpu_caps()->cacheline);
+   unsigned block_size, level;
+   ubyte *tiled_data, *data;
+
+   if (!lpr->tiled)
+      return;
+
+   data = align_malloc(lpr->size_required, mip_align);
+   if (!data)
+      return;
+
+   tiled_data = lpr->tex_data;
+   block_size = util_format_get_blocksize(resource->format);
+
+   for (level = 0; level <= resource->last_level; level++) {
+      unsigned row_stride = lpr->row_stride[level];
+      unsigned width = align(u_minify(resource->width0, level),
+                             LP_SAMPLER_TILE_SIZE);
+      unsigned height = align(u_minify(resource->height0, level),
+                              LP_SAMPLER_TILE_SIZE);
+      unsigned num_slices = resource->target == PIPE_TEXTURE_3D ?
+                            u_minify(resource->depth0, level) :
+                            resource->array_size;
+      unsigned slice, x, y;
+
+      for (slice = 0; slice < num_slices; slice++) {
+         uint64_t offset = lpr->mip_offsets[level] +
+                           (uint64_t)lpr->img_stride[level] * slice;
+         const ubyte *src = tiled_data + offset;
+         ubyte *dst = data + offset;
+
+         for (y = 0; y < height; y++) {
+            for (x = 0; x < width; x += LP_SAMPLER_TILE_SIZE) {
+               memcpy(dst + y * row_stride + x * block_size,
+                      src + llvmpipe_tiled_offset(x, y, row_stride,
+                                                  block_size),
+                      LP_SAMPLER_TILE_SIZE * block_size);
+            }
+         }
+      }
+   }
+
+   lpr->tiled_data = tiled_data;
+   lpr->tex_data = data;
+   lpr->tiled = FALSE;
+
+   /* Sampler state of every context depends on the layout. */
+   llvmpipe_screen(resource->screen)->timestamp++;
+}
+
+
+/**
+ * Whether a compressed texture gets an uncompressed copy for sampling.
+ * Only formats which decode exactly to 8 bits (possibly srgb) per channel
+ * qualify, and only resources we own the storage of, since writes through
+ * foreign mappings could not be tracked.
+ */
+static bool
+llvmpipe_want_decompressed(const struct llvmpipe_screen *screen,
+                           const struct llvmpipe_resource *lpr)
+{
+   const struct pipe_resource *pt = &lpr->base;
+   enum pipe_format linear = util_format_linear(pt->format);
+
+   if (!screen->decompress_texture_threshold ||
+       !util_format_is_compressed(pt->format) ||
+       !util_format_fits_8unorm(util_format_description(linear)) ||
+       !util_format_unpack_description(linear)->unpack_rgba_8unorm ||
+       pt->nr_samples > 1)
+      return false;
+
+   return lpr->size_required >= screen->decompress_texture_threshold * 1024ull;
+}
+
+
+struct llvmpipe_decompress_job
+{
+   const struct llvmpipe_resource *src;
+   struct llvmpipe_resource *dst;
+   const struct util_format_unpack_description *unpack;
+   unsigned level;
+   struct pipe_box box;   /**< in pixels, aligned to whole blocks */
+   unsigned nblocksy;
+};
+
+
+/**
+ * Decode one row of blocks of one slice.
+ */
+static void
+llvmpipe_decompress_row(void *data, int iter_idx,
+                        struct lp_cs_local_mem *lmem)
+{
+   const struct llvmpipe_decompress_job *job = data;
+   const struct llvmpipe_resource *src = job->src;
+   struct llvmpipe_resource *dst = job->dst;
+   enum pipe_format format = src->base.format;
+   unsigned bw = util_format_get_blockwidth(format);
+   unsigned bh = util_format_get_blockheight(format);
+   unsigned slice = job->box.z + iter_idx / job->nblocksy;
+   unsigned y = job->box.y + (iter_idx % job->nblocksy) * bh;
+   const ubyte *src_map;
+   ubyte *dst_map;
+
+   src_map = (const ubyte *)src->tex_data + src->mip_offsets[job->level] +
+             slice * src->img_stride[job->level] +
+             y / bh * src->row_stride[job->level] +
+             job->box.x / bw * util_format_get_blocksize(format);
+   dst_map = llvmpipe_get_texture_image_address(dst, slice, job->level) +
+             y * dst->row_stride[job->level] + job->box.x * 4;
+
+   job->unpack->unpack_rgba_8unorm(dst_map, dst->row_stride[job->level],
+                                   src_map, src->row_stride[job->level],
+                                   job->box.width,
+                                   MIN2(bh, job->box.y + job->box.height - y));
+}
+
+
+/**
+ * Refresh the uncompressed copy of a texture for a region of one level.
+ * The rows of blocks are spread over the compute thread pool.
+ */
+static void
+llvmpipe_decompress_box(struct llvmpipe_screen *screen,
+                        struct llvmpipe_resource *lpr,
+                        unsigned level,
+                        const struct pipe_box *box)
+{
+   const struct pipe_resource *pt = &lpr->base;
+   struct llvmpipe_decompress_job job;
+   struct lp_cs_tpool_task *task;
+   unsigned bw = util_format_get_blockwidth(pt->format);
+   unsigned bh = util_format_get_blockheight(pt->format);
+   unsigned width = u_minify(pt->width0, level);
+   unsigned height = u_minify(pt->height0, level);
+   unsigned x1, y1;
+
+   job.src = lpr;
+   job.dst = llvmpipe_resource(lpr->decompressed);
+   job.unpack = util_format_unpack_description(util_format_linear(pt->format));
+   job.level = level;
+   job.box = *box;
+   job.box.x = box->x / bw * bw;
+   job.box.y = box->y / bh * bh;
+   x1 = MIN2(align(box->x + box->width, bw), width);
+   y1 = MIN2(align(box->y + box->height, bh), height);
+   if (x1 <= job.box.x || y1 <= job.box.y || box->depth <= 0)
+      return;
+   job.box.width = x1 - job.box.x;
+   job.box.height = y1 - job.box.y;
+   job.nblocksy = DIV_ROUND_UP(job.box.height, bh);
+
+   mtx_lock(&screen->cs_mutex);
+   task = lp_cs_tpool_queue_task(screen->cs_tpool, llvmpipe_decompress_row,
+                                 &job, job.nblocksy * box->depth);
+   lp_cs_tpool_wait_for_task(screen->cs_tpool, &task);
+   mtx_unlock(&screen->cs_mutex);
+}
+
+
+/**
+ * Create the uncompressed copy of a texture and fill it from the
+ * (initially cleared) compressed data.
+ */
+static bool
+llvmpipe_create_decompressed(struct llvmpipe_screen *screen,
+                             struct llvmpipe_resource *lpr)
+{
+   struct pipe_resource templ = lpr->base;
+   unsigned level;
+
+   templ.format = PIPE_FORMAT_R8G8B8A8_UNORM;
+   /* written in rows by llvmpipe_decompress_row() */
+   templ.bind = PIPE_BIND_SAMPLER_VIEW | PIPE_BIND_LINEAR;
+   templ.flags = 0;
+   lpr->decompressed = screen->base.resource_create(&screen->base, &templ);
+   if (!lpr->decompressed)
+      return false;
+
+   for (level = 0; level <= templ.last_level; level++) {
+      struct pipe_box box;
+      unsigned depth = templ.target == PIPE_TEXTURE_3D ?
+                       u_minify(templ.depth0, level) : templ.array_size;
+
+      u_box_3d(0, 0, 0, u_minify(templ.width0, level),
+               u_minify(templ.height0, level), depth, &box);
+      llvmpipe_decompress_box(screen, lpr, level, &box);
+   }
+   return true;
+}
+
+
+/**
+ * Format to sample an uncompressed texture copy with, or PIPE_FORMAT_NONE
+ * if the view should sample the texture itself.
+ */
+enum pipe_format
+llvmpipe_sampler_view_decompressed_format(const struct pipe_sampler_view *view)
+{
+   if (!view || !view->texture ||
+       !llvmpipe_resource_const(view->texture)->decompressed)
+      return PIPE_FORMAT_NONE;
+
+   /* uncompressed views of compressed textures, e.g. for copies */
+   if (util_format_linear(view->format) !=
+       util_format_linear(view->texture->format))
+      return PIPE_FORMAT_NONE;
+
+   return util_format_is_srgb(view->format) ? PIPE_FORMAT_R8G8B8A8_SRGB :
+                                              PIPE_FORMAT_R8G8B8A8_UNORM;
+}
+
+
 static struct pipe_resource *
 llvmpipe_resource_create_all(struct pipe_screen *_screen,
                              const struct pipe_resource *templat,
@@ -271,6 +584,18 @@ llvmpipe_resource_create_all(struct pipe_screen *_screen,
          /* texture map */
          if (!llvmpipe_texture_layout(screen, lpr, alloc_backing))
             goto fail;
+
+         /* Tiles use the same size and strides, only the texel order
+          * within an image differs. The storage is zeroed, so there is
+          * nothing to swizzle yet.
+          */
+         lpr->tiled = alloc_backing && llvmpipe_want_tiled(screen, lpr);
+
+         if (alloc_backing && llvmpipe_want_decompressed(screen, lpr) &&
+             !llvmpipe_create_decompressed(screen, lpr)) {
+            align_free(lpr->tex_data);
+            goto fail;
+         }
       }
    }
    else {
@@ -370,6 +695,11 @@ llvmpipe_resource_destroy(struct pipe_screen *pscreen,
             align_free(lpr->tex_data);
             lpr->tex_data = NULL;
          }
+         if (lpr->tiled_data) {
+            align_free(lpr->tiled_data);
+            lpr->tiled_data = NULL;
+         }
+         pipe_resource_reference(&lpr->decompressed, NULL);
       }
       else if (!lpr->userBuffer) {
          if (lpr->data)
@@ -603,6 +933,10 @@ llvmpipe_transfer_map_ms( struct pipe_context *pipe,
       }
    }
 
+   /* Persistent and direct maps need the storage itself in rows. */
+   if (lpr->tiled && (usage & (PIPE_MAP_DIRECTLY | PIPE_MAP_PERSISTENT)))
+      llvmpipe_resource_untile(pipe, resource);
+
    lpt = CALLOC_STRUCT(llvmpipe_transfer);
    if (!lpt)
       return NULL;
@@ -617,6 +951,29 @@ llvmpipe_transfer_map_ms( struct pipe_context *pipe,
 
    assert(level < LP_MAX_TEXTURE_LEVELS);
 
+   if (lpr->tiled) {
+      /* Map a linear copy of the box, tiled again on unmap. */
+      pt->stride = box->width * util_format_get_blocksize(resource->format);
+      pt->layer_stride = pt->stride * box->height;
+      lpt->staging = MALLOC(pt->layer_stride * box->depth);
+      if (!lpt->staging) {
+         pipe_resource_reference(&pt->resource, NULL);
+         FREE(lpt);
+         *transfer = NULL;
+         return NULL;
+      }
+
+      if (!(usage & (PIPE_MAP_DISCARD_RANGE |
+                     PIPE_MAP_DISCARD_WHOLE_RESOURCE)))
+         llvmpipe_tile_box(lpr, level, box, lpt->staging,
+                           pt->stride, pt->layer_stride, false);
+
+      if (usage & PIPE_MAP_WRITE)
+         screen->timestamp++;
+
+      return lpt->staging;
+   }
+
    /*
    printf("tex_transfer_map(%d, %d  %d x %d of %d x %d,  usage %d )\n",
           transfer->x, transfer->y, transfer->width, transfer->height,
@@ -678,6 +1035,8 @@ static void
 llvmpipe_transfer_unmap(struct pipe_context *pipe,
                         struct pipe_transfer *transfer)
 {
+   struct llvmpipe_transfer *lpt = llvmpipe_transfer(transfer);
+
    assert(transfer->resource);
 
    llvmpipe_resource_unmap(transfer->resource,
@@ -686,9 +1045,22 @@ llvmpipe_transfer_unmap(struct pipe_context *pipe,
 
    /* Effectively do the texture_update work here - if texture images
     * needed post-processing to put them into hardware layout, this is
-    * where it would happen.  For llvmpipe, nothing to do.
+    * where it would happen.  For llvmpipe, only tiled textures and the
+    * uncompressed copy of compressed textures need it.
     */
-   assert (transfer->resource);
+   if (lpt->staging) {
+      if (transfer->usage & PIPE_MAP_WRITE)
+         llvmpipe_tile_box(llvmpipe_resource(transfer->resource),
+                           transfer->level, &transfer->box, lpt->staging,
+                           transfer->stride, transfer->layer_stride, true);
+      FREE(lpt->staging);
+   }
+   if ((transfer->usage & PIPE_MAP_WRITE) &&
+       llvmpipe_resource(transfer->resource)->decompressed) {
+      llvmpipe_decompress_box(llvmpipe_screen(pipe->screen),
+                              llvmpipe_resource(transfer->resource),
+                              transfer->level, &transfer->box);
+   }
    pipe_resource_reference(&transfer->resource, NULL);
    FREE(transfer);
 }
@@ -30,7 +30,9 @@
 
 
 #include "pipe/p_state.h"
+#include "util/u_atomic.h"
 #include "util/u_debug.h"
+#include "gallivm/lp_bld_sample.h" /* for LP_SAMPLER_TILE_SIZE */
 #include "lp_limits.h"
 
 
@@ -95,6 +97,34 @@ struct llvmpipe_resource
    uint64_t size_required;
    uint64_t backing_offset;
    bool backable;
+
+   /**
+    * R8G8B8A8 copy of a compressed texture, updated on every write and
+    * sampled by fragment and compute shaders instead of the compressed
+    * data. Only created with LP_DECOMPRESS_TEXTURES.
+    */
+   struct pipe_resource *decompressed;
+
+   /**
+    * Texels are stored in LP_SAMPLER_TILE_SIZE x LP_SAMPLER_TILE_SIZE
+    * tiles, see llvmpipe_tiled_offset(). Only set with LP_TILED_TEXTURES,
+    * and cleared for good once the texture is used as anything but a
+    * fragment or compute shader sampler view.
+    */
+   boolean tiled;
+
+   /**
+    * The tiled storage of a texture converted to rows, kept until the
+    * resource is destroyed since scenes in flight may still sample it.
+    */
+   void *tiled_data;
+
+   /**
+    * Bumped on every write of the depth data, by draws and clears of any
+    * context as well as maps and copies, so a context's hierarchical Z
+    * can tell its max_depth may be stale, see lp_setup_update_hiz().
+    */
+   unsigned hiz_generation;
 #ifdef DEBUG
    /** for linked list */
    struct llvmpipe_resource *prev, *next;
@@ -107,6 +137,9 @@ struct llvmpipe_transfer
    struct pipe_transfer base;
 
    unsigned long offset;
+
+   /** Linear copy of the mapped box of a tiled texture */
+   void *staging;
 };
 
 
@@ -132,7 +165,20 @@ llvmpipe_transfer(struct pipe_transfer *pt)
 }
 
 
+/**
+ * Called when the resource may be written other than by draws and clears,
+ * eg. when mapped for writing or as a copy destination.
+ */
+static inline void
+llvmpipe_resource_invalidate_hiz(struct pipe_resource *pt)
+{
+   p_atomic_inc(&llvmpipe_resource(pt)->hiz_generation);
+}
+
+
 void llvmpipe_init_screen_resource_funcs(struct pipe_screen *screen);
+enum pipe_format
+llvmpipe_sampler_view_decompressed_format(const struct pipe_sampler_view *view);
 void llvmpipe_init_context_resource_funcs(struct pipe_context *pipe);
 
 
@@ -206,6 +252,26 @@ llvmpipe_sample_stride(struct pipe_resource *resource)
    return lpr->sample_stride;
 }
 
+/**
+ * Byte offset of texel (x, y) from the start of an image of a tiled
+ * texture. The tiles are stored like the texels of a linear texture,
+ * so each row of tiles takes LP_SAMPLER_TILE_SIZE rows of row_stride bytes.
+ */
+static inline unsigned
+llvmpipe_tiled_offset(unsigned x, unsigned y,
+                      unsigned row_stride, unsigned block_size)
+{
+   const unsigned mask = LP_SAMPLER_TILE_SIZE - 1;
+
+   return (y & ~mask) * row_stride + (y & mask) * LP_SAMPLER_TILE_SIZE * block_size +
+          (x & ~mask) * LP_SAMPLER_TILE_SIZE * block_size + (x & mask) * block_size;
+}
+
+
+void
+llvmpipe_resource_untile(struct pipe_context *pipe,
+                         struct pipe_resource *resource);
+
 void *
 llvmpipe_resource_map(struct pipe_resource *resource,
                       unsigned level,
@@ -42,6 +42,7 @@ static VkResult lvp_create_cmd_buffer(
    cmd_buffer->device = device;
    cmd_buffer->pool = pool;
    list_inithead(&cmd_buffer->cmds);
+   list_inithead(&cmd_buffer->blocks);
    cmd_buffer->last_emit = &cmd_buffer->cmds;
    cmd_buffer->status = LVP_CMD_BUFFER_STATUS_INITIAL;
    if (pool) {
@@ -60,10 +61,27 @@ static VkResult lvp_create_cmd_buffer(
 static void
 lvp_cmd_buffer_free_all_cmds(struct lvp_cmd_buffer *cmd_buffer)
 {
-   struct lvp_cmd_buffer_entry *tmp, *cmd;
-   LIST_FOR_EACH_ENTRY_SAFE(cmd, tmp, &cmd_buffer->cmds, cmd_link) {
-      list_del(&cmd->cmd_link);
-      vk_free(&cmd_buffer->pool->alloc, cmd);
+   /* The commands live in the blocks, standard sized ones are recycled. */
+   list_for_each_entry_safe(struct lvp_cmd_block, block,
+                            &cmd_buffer->blocks, link) {
+      list_del(&block->link);
+      if (block->size == LVP_CMD_BLOCK_SIZE) {
+         block->used = 0;
+         list_add(&block->link, &cmd_buffer->pool->free_blocks);
+      } else {
+         vk_free(&cmd_buffer->pool->alloc, block);
+      }
+   }
+   list_inithead(&cmd_buffer->cmds);
+}
+
+static void
+lvp_cmd_pool_free_blocks(struct lvp_cmd_pool *pool)
+{
+   list_for_each_entry_safe(struct lvp_cmd_block, block,
+                            &pool->free_blocks, link) {
+      list_del(&block->link);
+      vk_free(&pool->alloc, block);
    }
 }
 
@@ -138,6 +156,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_FreeCommandBuffers(
 
       if (cmd_buffer) {
          if (cmd_buffer->pool) {
+            lvp_cmd_buffer_free_all_cmds(cmd_buffer);
             list_del(&cmd_buffer->pool_link);
             list_addtail(&cmd_buffer->pool_link, &cmd_buffer->pool->free_cmd_buffers);
          } else
@@ -201,6 +220,7 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateCommandPool(
 
    list_inithead(&pool->cmd_buffers);
    list_inithead(&pool->free_cmd_buffers);
+   list_inithead(&pool->free_blocks);
 
    *pCmdPool = lvp_cmd_pool_to_handle(pool);
 
@@ -228,6 +248,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyCommandPool(
       lvp_cmd_buffer_destroy(cmd_buffer);
    }
 
+   lvp_cmd_pool_free_blocks(pool);
    vk_object_base_finish(&pool->base);
    vk_free2(&device->vk.alloc, pAllocator, pool);
 }
@@ -263,6 +284,130 @@ VKAPI_ATTR void VKAPI_CALL lvp_TrimCommandPool(
                             &pool->free_cmd_buffers, pool_link) {
       lvp_cmd_buffer_destroy(cmd_buffer);
    }
+
+   lvp_cmd_pool_free_blocks(pool);
+}
+
+#define CMD_SIZE(type, member) \
+   [type] = offsetof(struct lvp_cmd_buffer_entry, u) + \
+            sizeof(((struct lvp_cmd_buffer_entry *)NULL)->u.member)
+
+/* Commands are variable sized packets: only the union member the command
+ * type uses is allocated, followed by its extra data.
+ */
+static const uint16_t cmd_buf_entry_sizes[] = {
+   CMD_SIZE(LVP_CMD_BIND_PIPELINE, pipeline),
+   CMD_SIZE(LVP_CMD_SET_VIEWPORT, set_viewport),
+   CMD_SIZE(LVP_CMD_SET_SCISSOR, set_scissor),
+   CMD_SIZE(LVP_CMD_SET_LINE_WIDTH, set_line_width),
+   CMD_SIZE(LVP_CMD_SET_DEPTH_BIAS, set_depth_bias),
+   CMD_SIZE(LVP_CMD_SET_BLEND_CONSTANTS, set_blend_constants),
+   CMD_SIZE(LVP_CMD_SET_DEPTH_BOUNDS, set_depth_bounds),
+   CMD_SIZE(LVP_CMD_SET_STENCIL_COMPARE_MASK, stencil_vals),
+   CMD_SIZE(LVP_CMD_SET_STENCIL_WRITE_MASK, stencil_vals),
+   CMD_SIZE(LVP_CMD_SET_STENCIL_REFERENCE, stencil_vals),
+   CMD_SIZE(LVP_CMD_BIND_DESCRIPTOR_SETS, descriptor_sets),
+   CMD_SIZE(LVP_CMD_BIND_INDEX_BUFFER, index_buffer),
+   CMD_SIZE(LVP_CMD_BIND_VERTEX_BUFFERS, vertex_buffers),
+   CMD_SIZE(LVP_CMD_DRAW, draw),
+   CMD_SIZE(LVP_CMD_DRAW_INDEXED, draw_indexed),
+   CMD_SIZE(LVP_CMD_DRAW_INDIRECT, draw_indirect),
+   CMD_SIZE(LVP_CMD_DRAW_INDEXED_INDIRECT, draw_indirect),
+   CMD_SIZE(LVP_CMD_DISPATCH, dispatch),
+   CMD_SIZE(LVP_CMD_DISPATCH_INDIRECT, dispatch_indirect),
+   CMD_SIZE(LVP_CMD_COPY_BUFFER, copy_buffer),
+   CMD_SIZE(LVP_CMD_COPY_IMAGE, copy_image),
+   CMD_SIZE(LVP_CMD_BLIT_IMAGE, blit_image),
+   CMD_SIZE(LVP_CMD_COPY_BUFFER_TO_IMAGE, buffer_to_img),
+   CMD_SIZE(LVP_CMD_COPY_IMAGE_TO_BUFFER, img_to_buffer),
+   CMD_SIZE(LVP_CMD_UPDATE_BUFFER, update_buffer),
+   CMD_SIZE(LVP_CMD_FILL_BUFFER, fill_buffer),
+   CMD_SIZE(LVP_CMD_CLEAR_COLOR_IMAGE, clear_color_image),
+   CMD_SIZE(LVP_CMD_CLEAR_DEPTH_STENCIL_IMAGE, clear_ds_image),
+   CMD_SIZE(LVP_CMD_CLEAR_ATTACHMENTS, clear_attachments),
+   CMD_SIZE(LVP_CMD_RESOLVE_IMAGE, resolve_image),
+   CMD_SIZE(LVP_CMD_SET_EVENT, event_set),
+   CMD_SIZE(LVP_CMD_RESET_EVENT, event_set),
+   CMD_SIZE(LVP_CMD_WAIT_EVENTS, wait_events),
+   CMD_SIZE(LVP_CMD_PIPELINE_BARRIER, pipeline_barrier),
+   CMD_SIZE(LVP_CMD_BEGIN_QUERY, query),
+   CMD_SIZE(LVP_CMD_END_QUERY, query),
+   CMD_SIZE(LVP_CMD_RESET_QUERY_POOL, query),
+   CMD_SIZE(LVP_CMD_WRITE_TIMESTAMP, query),
+   CMD_SIZE(LVP_CMD_COPY_QUERY_POOL_RESULTS, copy_query_pool_results),
+   CMD_SIZE(LVP_CMD_PUSH_CONSTANTS, push_constants),
+   CMD_SIZE(LVP_CMD_BEGIN_RENDER_PASS, begin_render_pass),
+   CMD_SIZE(LVP_CMD_NEXT_SUBPASS, next_subpass),
+   [LVP_CMD_END_RENDER_PASS] = offsetof(struct lvp_cmd_buffer_entry, u),
+   CMD_SIZE(LVP_CMD_EXECUTE_COMMANDS, execute_commands),
+   CMD_SIZE(LVP_CMD_DRAW_INDIRECT_COUNT, draw_indirect_count),
+   CMD_SIZE(LVP_CMD_DRAW_INDEXED_INDIRECT_COUNT, draw_indirect_count),
+   CMD_SIZE(LVP_CMD_PUSH_DESCRIPTOR_SET, push_descriptor_set),
+   CMD_SIZE(LVP_CMD_BIND_TRANSFORM_FEEDBACK_BUFFERS, bind_transform_feedback_buffers),
+   CMD_SIZE(LVP_CMD_BEGIN_TRANSFORM_FEEDBACK, begin_transform_feedback),
+   CMD_SIZE(LVP_CMD_END_TRANSFORM_FEEDBACK, end_transform_feedback),
+   CMD_SIZE(LVP_CMD_DRAW_INDIRECT_BYTE_COUNT, draw_indirect_byte_count),
+   CMD_SIZE(LVP_CMD_BEGIN_CONDITIONAL_RENDERING, begin_conditional_rendering),
+   [LVP_CMD_END_CONDITIONAL_RENDERING] = offsetof(struct lvp_cmd_buffer_entry, u),
+   CMD_SIZE(LVP_CMD_SET_CULL_MODE, set_cull_mode),
+   CMD_SIZE(LVP_CMD_SET_FRONT_FACE, set_front_face),
+   CMD_SIZE(LVP_CMD_SET_PRIMITIVE_TOPOLOGY, set_primitive_topology),
+   CMD_SIZE(LVP_CMD_SET_DEPTH_TEST_ENABLE, set_depth_test_enable),
+   CMD_SIZE(LVP_CMD_SET_DEPTH_WRITE_ENABLE, set_depth_write_enable),
+   CMD_SIZE(LVP_CMD_SET_DEPTH_COMPARE_OP, set_depth_compare_op),
+   CMD_SIZE(LVP_CMD_SET_DEPTH_BOUNDS_TEST_ENABLE, set_depth_bounds_test_enable),
+   CMD_SIZE(LVP_CMD_SET_STENCIL_TEST_ENABLE, set_stencil_test_enable),
+   CMD_SIZE(LVP_CMD_SET_STENCIL_OP, set_stencil_op),
+};
+
+static inline uint32_t cmd_buf_entry_size(enum lvp_cmds type)
+{
+   STATIC_ASSERT(ARRAY_SIZE(cmd_buf_entry_sizes) == LVP_CMD_SET_STENCIL_OP + 1);
+   assert(cmd_buf_entry_sizes[type]);
+   return align(cmd_buf_entry_sizes[type], 8);
+}
+
+/* extra data of a command, placed right after its packet */
+#define cmd_buf_entry_extra(cmd) \
+   ((void *)((uint8_t *)(cmd) + cmd_buf_entry_size((cmd)->cmd_type)))
+
+static void *cmd_buf_arena_alloc(struct lvp_cmd_buffer *cmd_buffer,
+                                 uint32_t size)
+{
+   struct lvp_cmd_pool *pool = cmd_buffer->pool;
+   struct lvp_cmd_block *block = NULL;
+   void *ptr;
+
+   size = align(size, 8);
+   if (!list_is_empty(&cmd_buffer->blocks)) {
+      block = list_last_entry(&cmd_buffer->blocks, struct lvp_cmd_block, link);
+      if (block->size - block->used < size)
+         block = NULL;
+   }
+
+   if (!block) {
+      uint32_t block_size = LVP_CMD_BLOCK_SIZE;
+
+      if (size > LVP_CMD_BLOCK_SIZE - sizeof(*block))
+         block_size = sizeof(*block) + size;
+
+      if (block_size == LVP_CMD_BLOCK_SIZE && !list_is_empty(&pool->free_blocks)) {
+         block = list_first_entry(&pool->free_blocks, struct lvp_cmd_block, link);
+         list_del(&block->link);
+      } else {
+         block = vk_alloc(&pool->alloc, block_size, 8,
+                          VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+         if (!block)
+            return NULL;
+         block->size = block_size;
+      }
+      block->used = sizeof(*block);
+      list_addtail(&block->link, &cmd_buffer->blocks);
+   }
+
+   ptr = (uint8_t *)block + block->used;
+   block->used += size;
+   return ptr;
 }
 
 static struct lvp_cmd_buffer_entry *cmd_buf_entry_alloc_size(struct lvp_cmd_buffer *cmd_buffer,
@@ -270,10 +415,8 @@ static struct lvp_cmd_buffer_entry *cmd_buf_entry_alloc_size(struct lvp_cmd_buff
                                                              enum lvp_cmds type)
 {
    struct lvp_cmd_buffer_entry *cmd;
-   uint32_t cmd_size = sizeof(*cmd) + extra_size;
-   cmd = vk_alloc(&cmd_buffer->pool->alloc,
-                  cmd_size,
-                  8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+   uint32_t cmd_size = cmd_buf_entry_size(type) + extra_size;
+   cmd = cmd_buf_arena_alloc(cmd_buffer, cmd_size);
    if (!cmd)
       return NULL;
 
@@ -363,7 +506,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdBeginRenderPass(
    cmd->u.begin_render_pass.framebuffer = framebuffer;
    cmd->u.begin_render_pass.render_area = pRenderPassBegin->renderArea;
 
-   cmd->u.begin_render_pass.attachments = (struct lvp_attachment_state *)(cmd + 1);
+   cmd->u.begin_render_pass.attachments = (struct lvp_attachment_state *)cmd_buf_entry_extra(cmd);
    state_setup_attachments(cmd->u.begin_render_pass.attachments, pass, pRenderPassBegin->pClearValues);
 
    cmd_buf_queue(cmd_buffer, cmd);
@@ -423,7 +566,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdBindVertexBuffers(
    cmd->u.vertex_buffers.first = firstBinding;
    cmd->u.vertex_buffers.binding_count = bindingCount;
 
-   buffers = (struct lvp_buffer **)(cmd + 1);
+   buffers = (struct lvp_buffer **)cmd_buf_entry_extra(cmd);
    offsets = (VkDeviceSize *)(buffers + bindingCount);
    for (i = 0; i < bindingCount; i++) {
       buffers[i] = lvp_buffer_from_handle(pBuffers[i]);
@@ -483,7 +626,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdBindDescriptorSets(
 
    for (i = 0; i < layout->num_sets; i++)
       cmd->u.descriptor_sets.set_layout[i] = layout->set[i].layout;
-   sets = (struct lvp_descriptor_set **)(cmd + 1);
+   sets = (struct lvp_descriptor_set **)cmd_buf_entry_extra(cmd);
    for (i = 0; i < descriptorSetCount; i++) {
 
       sets[i] = lvp_descriptor_set_from_handle(pDescriptorSets[i]);
@@ -952,7 +1095,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdWaitEvents(VkCommandBuffer commandBuffer,
    cmd->u.wait_events.src_stage_mask = srcStageMask;
    cmd->u.wait_events.dst_stage_mask = dstStageMask;
    cmd->u.wait_events.event_count = eventCount;
-   cmd->u.wait_events.events = (struct lvp_event **)(cmd + 1);
+   cmd->u.wait_events.events = (struct lvp_event **)cmd_buf_entry_extra(cmd);
    for (unsigned i = 0; i < eventCount; i++)
       cmd->u.wait_events.events[i] = lvp_event_from_handle(pEvents[i]);
    cmd->u.wait_events.memory_barrier_count = memoryBarrierCount;
@@ -1000,7 +1143,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdCopyBufferToImage2KHR(
    {
       VkBufferImageCopy *regions;
 
-      regions = (VkBufferImageCopy *)(cmd + 1);
+      regions = (VkBufferImageCopy *)cmd_buf_entry_extra(cmd);
       COPY_STRUCT2_ARRAY(info->regionCount, regions, info->pRegions, VkBufferImageCopy);
       cmd->u.buffer_to_img.regions = regions;
    }
@@ -1030,7 +1173,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdCopyImageToBuffer2KHR(
    {
       VkBufferImageCopy *regions;
 
-      regions = (VkBufferImageCopy *)(cmd + 1);
+      regions = (VkBufferImageCopy *)cmd_buf_entry_extra(cmd);
       COPY_STRUCT2_ARRAY(info->regionCount, regions, info->pRegions, VkBufferImageCopy);
       cmd->u.img_to_buffer.regions = regions;
    }
@@ -1061,7 +1204,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdCopyImage2KHR(
    {
       VkImageCopy *regions;
 
-      regions = (VkImageCopy *)(cmd + 1);
+      regions = (VkImageCopy *)cmd_buf_entry_extra(cmd);
       COPY_STRUCT2_ARRAY(info->regionCount, regions, info->pRegions, VkImageCopy);
       cmd->u.copy_image.regions = regions;
    }
@@ -1091,7 +1234,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdCopyBuffer2KHR(
    {
       VkBufferCopy *regions;
 
-      regions = (VkBufferCopy *)(cmd + 1);
+      regions = (VkBufferCopy *)cmd_buf_entry_extra(cmd);
       COPY_STRUCT2_ARRAY(info->regionCount, regions, info->pRegions, VkBufferCopy);
       cmd->u.copy_buffer.regions = regions;
    }
@@ -1124,7 +1267,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdBlitImage2KHR(
    {
       VkImageBlit *regions;
 
-      regions = (VkImageBlit *)(cmd + 1);
+      regions = (VkImageBlit *)cmd_buf_entry_extra(cmd);
       COPY_STRUCT2_ARRAY(info->regionCount, regions, info->pRegions, VkImageBlit);
       cmd->u.blit_image.regions = regions;
    }
@@ -1148,7 +1291,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdClearAttachments(
       return;
 
    cmd->u.clear_attachments.attachment_count = attachmentCount;
-   cmd->u.clear_attachments.attachments = (VkClearAttachment *)(cmd + 1);
+   cmd->u.clear_attachments.attachments = (VkClearAttachment *)cmd_buf_entry_extra(cmd);
    for (unsigned i = 0; i < attachmentCount; i++)
       cmd->u.clear_attachments.attachments[i] = pAttachments[i];
    cmd->u.clear_attachments.rect_count = rectCount;
@@ -1226,7 +1369,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdClearColorImage(
    cmd->u.clear_color_image.layout = imageLayout;
    cmd->u.clear_color_image.clear_val = *pColor;
    cmd->u.clear_color_image.range_count = rangeCount;
-   cmd->u.clear_color_image.ranges = (VkImageSubresourceRange *)(cmd + 1);
+   cmd->u.clear_color_image.ranges = (VkImageSubresourceRange *)cmd_buf_entry_extra(cmd);
    for (unsigned i = 0; i < rangeCount; i++)
       cmd->u.clear_color_image.ranges[i] = pRanges[i];
 
@@ -1254,7 +1397,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdClearDepthStencilImage(
    cmd->u.clear_ds_image.layout = imageLayout;
    cmd->u.clear_ds_image.clear_val = *pDepthStencil;
    cmd->u.clear_ds_image.range_count = rangeCount;
-   cmd->u.clear_ds_image.ranges = (VkImageSubresourceRange *)(cmd + 1);
+   cmd->u.clear_ds_image.ranges = (VkImageSubresourceRange *)cmd_buf_entry_extra(cmd);
    for (unsigned i = 0; i < rangeCount; i++)
       cmd->u.clear_ds_image.ranges[i] = pRanges[i];
 
@@ -1281,7 +1424,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdResolveImage2KHR(
    cmd->u.resolve_image.src_layout = info->srcImageLayout;
    cmd->u.resolve_image.dst_layout = info->dstImageLayout;
    cmd->u.resolve_image.region_count = info->regionCount;
-   cmd->u.resolve_image.regions = (VkImageResolve *)(cmd + 1);
+   cmd->u.resolve_image.regions = (VkImageResolve *)cmd_buf_entry_extra(cmd);
    COPY_STRUCT2_ARRAY(info->regionCount, cmd->u.resolve_image.regions, info->pRegions, VkImageResolve);
 
    cmd_buf_queue(cmd_buffer, cmd);
@@ -1540,7 +1683,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdPushDescriptorSetKHR(
    cmd->u.push_descriptor_set.layout = layout;
    cmd->u.push_descriptor_set.set = set;
    cmd->u.push_descriptor_set.descriptor_write_count = descriptorWriteCount;
-   cmd->u.push_descriptor_set.descriptors = (struct lvp_write_descriptor *)(cmd + 1);
+   cmd->u.push_descriptor_set.descriptors = (struct lvp_write_descriptor *)cmd_buf_entry_extra(cmd);
    cmd->u.push_descriptor_set.infos = (union lvp_descriptor_info *)(cmd->u.push_descriptor_set.descriptors + descriptorWriteCount);
 
    unsigned descriptor_index = 0;
@@ -1620,7 +1763,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdPushDescriptorSetWithTemplateKHR(
    cmd->u.push_descriptor_set.layout = templ->pipeline_layout;
    cmd->u.push_descriptor_set.set = templ->set;
    cmd->u.push_descriptor_set.descriptor_write_count = templ->entry_count;
-   cmd->u.push_descriptor_set.descriptors = (struct lvp_write_descriptor *)(cmd + 1);
+   cmd->u.push_descriptor_set.descriptors = (struct lvp_write_descriptor *)cmd_buf_entry_extra(cmd);
    cmd->u.push_descriptor_set.infos = (union lvp_descriptor_info *)(cmd->u.push_descriptor_set.descriptors + templ->entry_count);
 
    unsigned descriptor_index = 0;
@@ -1700,7 +1843,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdBindTransformFeedbackBuffersEXT(
 
    cmd->u.bind_transform_feedback_buffers.first_binding = firstBinding;
    cmd->u.bind_transform_feedback_buffers.binding_count = bindingCount;
-   cmd->u.bind_transform_feedback_buffers.buffers = (struct lvp_buffer **)(cmd + 1);
+   cmd->u.bind_transform_feedback_buffers.buffers = (struct lvp_buffer **)cmd_buf_entry_extra(cmd);
    cmd->u.bind_transform_feedback_buffers.offsets = (VkDeviceSize *)(cmd->u.bind_transform_feedback_buffers.buffers + bindingCount);
    cmd->u.bind_transform_feedback_buffers.sizes = (VkDeviceSize *)(cmd->u.bind_transform_feedback_buffers.offsets + bindingCount);
 
@@ -1731,7 +1874,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdBeginTransformFeedbackEXT(
 
    cmd->u.begin_transform_feedback.first_counter_buffer = firstCounterBuffer;
    cmd->u.begin_transform_feedback.counter_buffer_count = counterBufferCount;
-   cmd->u.begin_transform_feedback.counter_buffers = (struct lvp_buffer **)(cmd + 1);
+   cmd->u.begin_transform_feedback.counter_buffers = (struct lvp_buffer **)cmd_buf_entry_extra(cmd);
    cmd->u.begin_transform_feedback.counter_buffer_offsets = (VkDeviceSize *)(cmd->u.begin_transform_feedback.counter_buffers + counterBufferCount);
 
    for (unsigned i = 0; i < counterBufferCount; i++) {
@@ -1763,7 +1906,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdEndTransformFeedbackEXT(
 
    cmd->u.begin_transform_feedback.first_counter_buffer = firstCounterBuffer;
    cmd->u.begin_transform_feedback.counter_buffer_count = counterBufferCount;
-   cmd->u.begin_transform_feedback.counter_buffers = (struct lvp_buffer **)(cmd + 1);
+   cmd->u.begin_transform_feedback.counter_buffers = (struct lvp_buffer **)cmd_buf_entry_extra(cmd);
    cmd->u.begin_transform_feedback.counter_buffer_offsets = (VkDeviceSize *)(cmd->u.begin_transform_feedback.counter_buffers + counterBufferCount);
 
    for (unsigned i = 0; i < counterBufferCount; i++) {
@@ -1973,7 +2116,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdBindVertexBuffers2EXT(
    cmd->u.vertex_buffers.first = firstBinding;
    cmd->u.vertex_buffers.binding_count = bindingCount;
 
-   buffers = (struct lvp_buffer **)(cmd + 1);
+   buffers = (struct lvp_buffer **)cmd_buf_entry_extra(cmd);
    offsets = (VkDeviceSize *)(buffers + bindingCount);
    sizes = (VkDeviceSize *)(offsets + bindingCount);
    strides = (VkDeviceSize *)(sizes + bindingCount);
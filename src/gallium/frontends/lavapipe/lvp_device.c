@@ -34,6 +34,7 @@
 #include "util/os_memory.h"
 #include "util/u_thread.h"
 #include "util/u_atomic.h"
+#include "util/u_debug.h"
 #include "util/timespec.h"
 #include "os_time.h"
 
@@ -894,6 +895,157 @@ VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL vk_icdGetPhysicalDeviceProcAddr(
    return vk_instance_get_physical_device_proc_addr(&instance->vk, pName);
 }
 
+struct lvp_exec_job {
+   struct util_queue_fence fence;
+   struct lvp_queue *queue;
+   struct lvp_cmd_buffer *cmd_buffer;
+};
+
+static void
+ctx_finish(struct pipe_context *ctx)
+{
+   struct pipe_screen *screen = ctx->screen;
+   struct pipe_fence_handle *handle = NULL;
+
+   ctx->flush(ctx, &handle, 0);
+   if (handle) {
+      screen->fence_finish(screen, NULL, handle, PIPE_TIMEOUT_INFINITE);
+      screen->fence_reference(screen, &handle, NULL);
+   }
+}
+
+static void
+exec_job_execute(void *data, int thread_index)
+{
+   struct lvp_exec_job *job = data;
+   struct pipe_context *ctx = job->queue->exec_ctx[thread_index];
+
+   lvp_execute_cmds(job->queue->device, ctx, thread_index, NULL, job->cmd_buffer);
+   ctx_finish(ctx);
+}
+
+static void
+wait_run(struct lvp_exec_job *jobs, unsigned start, unsigned end)
+{
+   for (unsigned i = start; i < end; i++)
+      util_queue_fence_wait(&jobs[i].fence);
+}
+
+static bool
+resources_overlap(struct pipe_resource *const *a, unsigned num_a,
+                  struct pipe_resource *const *b, unsigned num_b)
+{
+   for (unsigned i = 0; i < num_a; i++) {
+      for (unsigned j = 0; j < num_b; j++) {
+         if (a[i] == b[j])
+            return true;
+      }
+   }
+   return false;
+}
+
+/* Check whether a command buffer has to wait for the run: it writes a
+ * resource the run reads or writes, or reads a resource the run writes.
+ */
+static bool
+run_conflicts(const struct lvp_resource_access *run,
+              const struct lvp_resource_access *cb)
+{
+   if (run->num_reads + cb->num_reads > LVP_MAX_RUN_RESOURCES ||
+       run->num_writes + cb->num_writes > LVP_MAX_RUN_RESOURCES)
+      return true;
+   return resources_overlap(cb->writes, cb->num_writes,
+                            run->writes, run->num_writes) ||
+          resources_overlap(cb->writes, cb->num_writes,
+                            run->reads, run->num_reads) ||
+          resources_overlap(cb->reads, cb->num_reads,
+                            run->writes, run->num_writes);
+}
+
+/* Execute the command buffers of a submit, running consecutive independent
+ * command buffers concurrently on the exec threads.  A run of them is
+ * completed before a command buffer containing synchronization commands, or
+ * accessing a resource in a way that conflicts with the run, starts
+ * executing, and the queue context is idled before a run starts, so all
+ * the ordering a serial execution gives between dependent work is kept.
+ */
+static void
+queue_execute_concurrent(struct lvp_queue *queue, struct lvp_queue_work *task)
+{
+   struct lvp_exec_job *jobs = calloc(task->cmd_buffer_count, sizeof(*jobs));
+   struct lvp_resource_access *run = malloc(2 * sizeof(*run));
+   struct lvp_resource_access *cb = run + 1;
+   unsigned run_start = 0;
+   bool ctx_busy = false;
+
+   if (!jobs || !run) {
+      free(jobs);
+      free(run);
+      for (unsigned i = 0; i < task->cmd_buffer_count; i++)
+         lvp_execute_cmds(queue->device, queue->ctx, -1, task->fence, task->cmd_buffers[i]);
+      return;
+   }
+
+   run->num_reads = 0;
+   run->num_writes = 0;
+
+   for (unsigned i = 0; i < task->cmd_buffer_count; i++)
+      util_queue_fence_init(&jobs[i].fence);
+
+   for (unsigned i = 0; i < task->cmd_buffer_count; i++) {
+      struct lvp_cmd_buffer *cmd_buffer = task->cmd_buffers[i];
+      bool independent = lvp_cmd_buffer_is_independent(cmd_buffer, cb);
+
+      if (!independent || run_conflicts(run, cb)) {
+         wait_run(jobs, run_start, i);
+         run_start = i;
+         run->num_reads = 0;
+         run->num_writes = 0;
+      }
+
+      if (!independent) {
+         lvp_execute_cmds(queue->device, queue->ctx, -1, NULL, cmd_buffer);
+         ctx_busy = true;
+         run_start = i + 1;
+         continue;
+      }
+
+      if (ctx_busy) {
+         ctx_finish(queue->ctx);
+         ctx_busy = false;
+      }
+
+      memcpy(&run->reads[run->num_reads], cb->reads,
+             cb->num_reads * sizeof(cb->reads[0]));
+      run->num_reads += cb->num_reads;
+      memcpy(&run->writes[run->num_writes], cb->writes,
+             cb->num_writes * sizeof(cb->writes[0]));
+      run->num_writes += cb->num_writes;
+
+      jobs[i].queue = queue;
+      jobs[i].cmd_buffer = cmd_buffer;
+      util_queue_add_job(&queue->exec_queue, &jobs[i], &jobs[i].fence,
+                         exec_job_execute, NULL, 0);
+   }
+   wait_run(jobs, run_start, task->cmd_buffer_count);
+
+   /* Everything run on the exec threads is complete, so the queue context's
+    * last fence covers the whole submit.
+    */
+   if (task->fence) {
+      struct pipe_fence_handle *handle = NULL;
+      queue->ctx->flush(queue->ctx, &handle, 0);
+      mtx_lock(&queue->device->fence_lock);
+      task->fence->handle = handle;
+      mtx_unlock(&queue->device->fence_lock);
+   }
+
+   for (unsigned i = 0; i < task->cmd_buffer_count; i++)
+      util_queue_fence_destroy(&jobs[i].fence);
+   free(jobs);
+   free(run);
+}
+
 static int queue_thread(void *data)
 {
    struct lvp_queue *queue = data;
@@ -912,8 +1064,12 @@ static int queue_thread(void *data)
 
       mtx_unlock(&queue->m);
       //execute
-      for (unsigned i = 0; i < task->cmd_buffer_count; i++) {
-         lvp_execute_cmds(queue->device, queue, task->fence, task->cmd_buffers[i]);
+      if (queue->num_exec_threads && task->cmd_buffer_count > 1) {
+         queue_execute_concurrent(queue, task);
+      } else {
+         for (unsigned i = 0; i < task->cmd_buffer_count; i++) {
+            lvp_execute_cmds(queue->device, queue->ctx, -1, task->fence, task->cmd_buffers[i]);
+         }
       }
       if (!task->cmd_buffer_count && task->fence)
          task->fence->signaled = true;
@@ -926,6 +1082,57 @@ static int queue_thread(void *data)
    return 0;
 }
 
+static void
+lvp_queue_init_exec_threads(struct lvp_device *device, struct lvp_queue *queue)
+{
+   unsigned num_threads = debug_get_num_option("LVP_NUM_EXEC_THREADS", 0);
+   unsigned i;
+
+   queue->num_exec_threads = 0;
+   if (!num_threads)
+      return;
+
+   queue->exec_ctx = calloc(num_threads, sizeof(*queue->exec_ctx));
+   if (!queue->exec_ctx)
+      return;
+
+   for (i = 0; i < num_threads; i++) {
+      queue->exec_ctx[i] = device->pscreen->context_create(device->pscreen, NULL,
+                                                           PIPE_CONTEXT_ROBUST_BUFFER_ACCESS);
+      if (!queue->exec_ctx[i])
+         goto fail;
+   }
+
+   if (!util_queue_init(&queue->exec_queue, "lvpexec", num_threads,
+                        num_threads, 0))
+      goto fail;
+
+   queue->num_exec_threads = num_threads;
+   return;
+
+fail:
+   for (i = 0; i < num_threads; i++) {
+      if (queue->exec_ctx[i])
+         queue->exec_ctx[i]->destroy(queue->exec_ctx[i]);
+   }
+   free(queue->exec_ctx);
+   queue->exec_ctx = NULL;
+}
+
+static void
+lvp_queue_destroy_exec_threads(struct lvp_queue *queue)
+{
+   if (!queue->num_exec_threads)
+      return;
+
+   util_queue_destroy(&queue->exec_queue);
+   for (unsigned i = 0; i < queue->num_exec_threads; i++)
+      queue->exec_ctx[i]->destroy(queue->exec_ctx[i]);
+   free(queue->exec_ctx);
+   queue->exec_ctx = NULL;
+   queue->num_exec_threads = 0;
+}
+
 static VkResult
 lvp_queue_init(struct lvp_device *device, struct lvp_queue *queue)
 {
@@ -936,6 +1143,7 @@ lvp_queue_init(struct lvp_device *device, struct lvp_queue *queue)
    list_inithead(&queue->workqueue);
    p_atomic_set(&queue->count, 0);
    mtx_init(&queue->m, mtx_plain);
+   lvp_queue_init_exec_threads(device, queue);
    queue->exec_thread = u_thread_create(queue_thread, queue);
 
    vk_object_base_init(&device->vk, &queue->base, VK_OBJECT_TYPE_QUEUE);
@@ -951,6 +1159,7 @@ lvp_queue_finish(struct lvp_queue *queue)
    mtx_unlock(&queue->m);
 
    thrd_join(queue->exec_thread, NULL);
+   lvp_queue_destroy_exec_threads(queue);
 
    cnd_destroy(&queue->new_work);
    mtx_destroy(&queue->m);
@@ -45,6 +45,7 @@
 
 struct rendering_state {
    struct pipe_context *pctx;
+   int exec_index; /* index of pctx in queue->exec_ctx, -1 for queue->ctx */
 
    bool blend_dirty;
    bool rs_dirty;
@@ -323,6 +324,15 @@ static void emit_state(struct rendering_state *state)
    }
 }
 
+static void *
+pipeline_cso(struct rendering_state *state, struct lvp_pipeline *pipeline,
+             enum pipe_shader_type type)
+{
+   if (state->exec_index < 0)
+      return pipeline->shader_cso[type];
+   return pipeline->exec_shader_cso[state->exec_index][type];
+}
+
 static void handle_compute_pipeline(struct lvp_cmd_buffer_entry *cmd,
                                     struct rendering_state *state)
 {
@@ -331,7 +341,7 @@ static void handle_compute_pipeline(struct lvp_cmd_buffer_entry *cmd,
    state->dispatch_info.block[0] = pipeline->pipeline_nir[MESA_SHADER_COMPUTE]->info.cs.local_size[0];
    state->dispatch_info.block[1] = pipeline->pipeline_nir[MESA_SHADER_COMPUTE]->info.cs.local_size[1];
    state->dispatch_info.block[2] = pipeline->pipeline_nir[MESA_SHADER_COMPUTE]->info.cs.local_size[2];
-   state->pctx->bind_compute_state(state->pctx, pipeline->shader_cso[PIPE_SHADER_COMPUTE]);
+   state->pctx->bind_compute_state(state->pctx, pipeline_cso(state, pipeline, PIPE_SHADER_COMPUTE));
 }
 
 static void
@@ -399,23 +409,23 @@ static void handle_graphics_pipeline(struct lvp_cmd_buffer_entry *cmd,
          const VkPipelineShaderStageCreateInfo *sh = &pipeline->graphics_create_info.pStages[i];
          switch (sh->stage) {
          case VK_SHADER_STAGE_FRAGMENT_BIT:
-            state->pctx->bind_fs_state(state->pctx, pipeline->shader_cso[PIPE_SHADER_FRAGMENT]);
+            state->pctx->bind_fs_state(state->pctx, pipeline_cso(state, pipeline, PIPE_SHADER_FRAGMENT));
             has_stage[PIPE_SHADER_FRAGMENT] = true;
             break;
          case VK_SHADER_STAGE_VERTEX_BIT:
-            state->pctx->bind_vs_state(state->pctx, pipeline->shader_cso[PIPE_SHADER_VERTEX]);
+            state->pctx->bind_vs_state(state->pctx, pipeline_cso(state, pipeline, PIPE_SHADER_VERTEX));
             has_stage[PIPE_SHADER_VERTEX] = true;
             break;
          case VK_SHADER_STAGE_GEOMETRY_BIT:
-            state->pctx->bind_gs_state(state->pctx, pipeline->shader_cso[PIPE_SHADER_GEOMETRY]);
+            state->pctx->bind_gs_state(state->pctx, pipeline_cso(state, pipeline, PIPE_SHADER_GEOMETRY));
             has_stage[PIPE_SHADER_GEOMETRY] = true;
             break;
          case VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT:
-            state->pctx->bind_tcs_state(state->pctx, pipeline->shader_cso[PIPE_SHADER_TESS_CTRL]);
+            state->pctx->bind_tcs_state(state->pctx, pipeline_cso(state, pipeline, PIPE_SHADER_TESS_CTRL));
             has_stage[PIPE_SHADER_TESS_CTRL] = true;
             break;
          case VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT:
-            state->pctx->bind_tes_state(state->pctx, pipeline->shader_cso[PIPE_SHADER_TESS_EVAL]);
+            state->pctx->bind_tes_state(state->pctx, pipeline_cso(state, pipeline, PIPE_SHADER_TESS_EVAL));
             has_stage[PIPE_SHADER_TESS_EVAL] = true;
             break;
          default:
@@ -427,7 +437,7 @@ static void handle_graphics_pipeline(struct lvp_cmd_buffer_entry *cmd,
 
    /* there should always be a dummy fs. */
    if (!has_stage[PIPE_SHADER_FRAGMENT])
-      state->pctx->bind_fs_state(state->pctx, pipeline->shader_cso[PIPE_SHADER_FRAGMENT]);
+      state->pctx->bind_fs_state(state->pctx, pipeline_cso(state, pipeline, PIPE_SHADER_FRAGMENT));
    if (state->pctx->bind_gs_state && !has_stage[PIPE_SHADER_GEOMETRY])
       state->pctx->bind_gs_state(state->pctx, NULL);
    if (state->pctx->bind_tcs_state && !has_stage[PIPE_SHADER_TESS_CTRL])
@@ -3066,15 +3076,229 @@ static void lvp_execute_cmd_buffer(struct lvp_cmd_buffer *cmd_buffer,
    }
 }
 
+static bool
+add_access(struct pipe_resource *pres, struct pipe_resource **list,
+           unsigned *num)
+{
+   for (unsigned i = 0; i < *num; i++) {
+      if (list[i] == pres)
+         return true;
+   }
+   if (*num == LVP_MAX_RUN_RESOURCES)
+      return false;
+   list[(*num)++] = pres;
+   return true;
+}
+
+static bool
+add_read(struct lvp_resource_access *access, struct pipe_resource *pres)
+{
+   return !pres || add_access(pres, access->reads, &access->num_reads);
+}
+
+static bool
+add_write(struct lvp_resource_access *access, struct pipe_resource *pres)
+{
+   return !pres || add_access(pres, access->writes, &access->num_writes);
+}
+
+static bool
+add_descriptor(struct lvp_resource_access *access, VkDescriptorType type,
+               const union lvp_descriptor_info *info)
+{
+   switch (type) {
+   case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+   case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+   case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
+      return !info->iview || add_read(access, info->iview->image->bo);
+   case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+      return !info->iview || add_write(access, info->iview->image->bo);
+   case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+   case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+      return !info->buffer || add_read(access, info->buffer->bo);
+   case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+   case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+      return !info->buffer || add_write(access, info->buffer->bo);
+   case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+      return !info->buffer_view || add_read(access, info->buffer_view->buffer->bo);
+   case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+      return !info->buffer_view || add_write(access, info->buffer_view->buffer->bo);
+   default:
+      return true;
+   }
+}
+
+static bool
+add_descriptor_sets(struct lvp_resource_access *access,
+                    const struct lvp_cmd_bind_descriptor_sets *bds)
+{
+   for (unsigned i = 0; i < bds->count; i++) {
+      const struct lvp_descriptor_set *set = bds->sets[i];
+      for (unsigned j = 0; j < set->layout->size; j++) {
+         if (!add_descriptor(access, set->descriptors[j].type,
+                             &set->descriptors[j].info))
+            return false;
+      }
+   }
+   return true;
+}
+
+static bool
+add_push_descriptor_set(struct lvp_resource_access *access,
+                        const struct lvp_cmd_push_descriptor_set *pds)
+{
+   unsigned info_idx = 0;
+   for (unsigned i = 0; i < pds->descriptor_write_count; i++) {
+      const struct lvp_write_descriptor *desc = &pds->descriptors[i];
+      for (unsigned j = 0; j < desc->descriptor_count; j++) {
+         if (!add_descriptor(access, desc->descriptor_type,
+                             &pds->infos[info_idx + j]))
+            return false;
+      }
+      info_idx += desc->descriptor_count;
+   }
+   return true;
+}
+
+static bool
+add_render_pass(struct lvp_resource_access *access,
+                const struct lvp_cmd_begin_render_pass *bcmd)
+{
+   /* An external subpass dependency orders the render pass against the
+    * commands submitted before or after it.
+    */
+   if (bcmd->render_pass->has_external_dependency)
+      return false;
+
+   for (unsigned i = 0; i < bcmd->framebuffer->attachment_count; i++) {
+      if (!add_write(access, bcmd->framebuffer->attachments[i]->image->bo))
+         return false;
+   }
+   return true;
+}
+
+/* Check whether a command buffer may execute concurrently with its
+ * neighbours in a submit: it must not contain any synchronization or query
+ * commands, or render passes with external subpass dependencies, which are
+ * ordered against everything submitted before them.  The resources it
+ * reads and writes are returned in access, so the caller can keep command
+ * buffers with read-after-write, write-after-read and write-after-write
+ * hazards between them in submission order; running out of room for them
+ * also makes it dependent.
+ */
+bool lvp_cmd_buffer_is_independent(struct lvp_cmd_buffer *cmd_buffer,
+                                   struct lvp_resource_access *access)
+{
+   struct lvp_cmd_buffer_entry *cmd;
+   bool ok = true;
+
+   access->num_reads = 0;
+   access->num_writes = 0;
+
+   LIST_FOR_EACH_ENTRY(cmd, &cmd_buffer->cmds, cmd_link) {
+      switch (cmd->cmd_type) {
+      case LVP_CMD_SET_EVENT:
+      case LVP_CMD_RESET_EVENT:
+      case LVP_CMD_WAIT_EVENTS:
+      case LVP_CMD_PIPELINE_BARRIER:
+      case LVP_CMD_BEGIN_QUERY:
+      case LVP_CMD_END_QUERY:
+      case LVP_CMD_RESET_QUERY_POOL:
+      case LVP_CMD_WRITE_TIMESTAMP:
+      case LVP_CMD_COPY_QUERY_POOL_RESULTS:
+      case LVP_CMD_EXECUTE_COMMANDS:
+      case LVP_CMD_BEGIN_TRANSFORM_FEEDBACK:
+      case LVP_CMD_BEGIN_CONDITIONAL_RENDERING:
+         return false;
+      case LVP_CMD_BIND_DESCRIPTOR_SETS:
+         ok = add_descriptor_sets(access, &cmd->u.descriptor_sets);
+         break;
+      case LVP_CMD_PUSH_DESCRIPTOR_SET:
+         ok = add_push_descriptor_set(access, &cmd->u.push_descriptor_set);
+         break;
+      case LVP_CMD_BIND_INDEX_BUFFER:
+         ok = add_read(access, cmd->u.index_buffer.buffer->bo);
+         break;
+      case LVP_CMD_BIND_VERTEX_BUFFERS:
+         for (unsigned i = 0; i < cmd->u.vertex_buffers.binding_count && ok; i++) {
+            if (cmd->u.vertex_buffers.buffers[i])
+               ok = add_read(access, cmd->u.vertex_buffers.buffers[i]->bo);
+         }
+         break;
+      case LVP_CMD_DRAW_INDIRECT:
+      case LVP_CMD_DRAW_INDEXED_INDIRECT:
+         ok = add_read(access, cmd->u.draw_indirect.buffer->bo);
+         break;
+      case LVP_CMD_DRAW_INDIRECT_COUNT:
+      case LVP_CMD_DRAW_INDEXED_INDIRECT_COUNT:
+         ok = add_read(access, cmd->u.draw_indirect_count.buffer->bo) &&
+              add_read(access, cmd->u.draw_indirect_count.count_buffer->bo);
+         break;
+      case LVP_CMD_DRAW_INDIRECT_BYTE_COUNT:
+         ok = add_read(access, cmd->u.draw_indirect_byte_count.counter_buffer->bo);
+         break;
+      case LVP_CMD_DISPATCH_INDIRECT:
+         ok = add_read(access, cmd->u.dispatch_indirect.buffer->bo);
+         break;
+      case LVP_CMD_COPY_BUFFER:
+         ok = add_read(access, cmd->u.copy_buffer.src->bo) &&
+              add_write(access, cmd->u.copy_buffer.dst->bo);
+         break;
+      case LVP_CMD_COPY_IMAGE:
+         ok = add_read(access, cmd->u.copy_image.src->bo) &&
+              add_write(access, cmd->u.copy_image.dst->bo);
+         break;
+      case LVP_CMD_BLIT_IMAGE:
+         ok = add_read(access, cmd->u.blit_image.src->bo) &&
+              add_write(access, cmd->u.blit_image.dst->bo);
+         break;
+      case LVP_CMD_COPY_BUFFER_TO_IMAGE:
+         ok = add_read(access, cmd->u.buffer_to_img.src->bo) &&
+              add_write(access, cmd->u.buffer_to_img.dst->bo);
+         break;
+      case LVP_CMD_COPY_IMAGE_TO_BUFFER:
+         ok = add_read(access, cmd->u.img_to_buffer.src->bo) &&
+              add_write(access, cmd->u.img_to_buffer.dst->bo);
+         break;
+      case LVP_CMD_UPDATE_BUFFER:
+         ok = add_write(access, cmd->u.update_buffer.buffer->bo);
+         break;
+      case LVP_CMD_FILL_BUFFER:
+         ok = add_write(access, cmd->u.fill_buffer.buffer->bo);
+         break;
+      case LVP_CMD_CLEAR_COLOR_IMAGE:
+         ok = add_write(access, cmd->u.clear_color_image.image->bo);
+         break;
+      case LVP_CMD_CLEAR_DEPTH_STENCIL_IMAGE:
+         ok = add_write(access, cmd->u.clear_ds_image.image->bo);
+         break;
+      case LVP_CMD_RESOLVE_IMAGE:
+         ok = add_read(access, cmd->u.resolve_image.src->bo) &&
+              add_write(access, cmd->u.resolve_image.dst->bo);
+         break;
+      case LVP_CMD_BEGIN_RENDER_PASS:
+         ok = add_render_pass(access, &cmd->u.begin_render_pass);
+         break;
+      default:
+         break;
+      }
+      if (!ok)
+         return false;
+   }
+   return true;
+}
+
 VkResult lvp_execute_cmds(struct lvp_device *device,
-                          struct lvp_queue *queue,
+                          struct pipe_context *ctx,
+                          int exec_index,
                           struct lvp_fence *fence,
                           struct lvp_cmd_buffer *cmd_buffer)
 {
    struct rendering_state state;
    struct pipe_fence_handle *handle = NULL;
    memset(&state, 0, sizeof(state));
-   state.pctx = queue->ctx;
+   state.pctx = ctx;
+   state.exec_index = exec_index;
    state.blend_dirty = true;
    state.dsa_dirty = true;
    state.rs_dirty = true;
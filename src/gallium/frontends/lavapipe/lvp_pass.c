@@ -176,6 +176,12 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateRenderPass2(
    pass->subpass_count = pCreateInfo->subpassCount;
    pass->attachments = (struct lvp_render_pass_attachment *)((char *)pass + attachments_offset);
 
+   for (uint32_t i = 0; i < pCreateInfo->dependencyCount; i++) {
+      if (pCreateInfo->pDependencies[i].srcSubpass == VK_SUBPASS_EXTERNAL ||
+          pCreateInfo->pDependencies[i].dstSubpass == VK_SUBPASS_EXTERNAL)
+         pass->has_external_dependency = true;
+   }
+
    for (uint32_t i = 0; i < pCreateInfo->attachmentCount; i++) {
       struct lvp_render_pass_attachment *att = &pass->attachments[i];
 
@@ -23,6 +23,7 @@
 
 #include "lvp_private.h"
 #include "vk_util.h"
+#include "util/mesa-sha1.h"
 #include "glsl_types.h"
 #include "spirv/nir_spirv.h"
 #include "nir/nir_builder.h"
@@ -30,6 +31,7 @@
 #include "pipe/p_state.h"
 #include "pipe/p_context.h"
 #include "nir/nir_xfb_info.h"
+#include "tgsi/tgsi_from_mesa.h"
 
 #define SPIR_V_MAGIC_NUMBER 0x07230203
 
@@ -40,6 +42,23 @@
       dst = temp;                                                \
    } while(0)
 
+static void
+lvp_pipeline_delete_csos(void **shader_cso, struct pipe_context *ctx)
+{
+   if (shader_cso[PIPE_SHADER_VERTEX])
+      ctx->delete_vs_state(ctx, shader_cso[PIPE_SHADER_VERTEX]);
+   if (shader_cso[PIPE_SHADER_FRAGMENT])
+      ctx->delete_fs_state(ctx, shader_cso[PIPE_SHADER_FRAGMENT]);
+   if (shader_cso[PIPE_SHADER_GEOMETRY])
+      ctx->delete_gs_state(ctx, shader_cso[PIPE_SHADER_GEOMETRY]);
+   if (shader_cso[PIPE_SHADER_TESS_CTRL])
+      ctx->delete_tcs_state(ctx, shader_cso[PIPE_SHADER_TESS_CTRL]);
+   if (shader_cso[PIPE_SHADER_TESS_EVAL])
+      ctx->delete_tes_state(ctx, shader_cso[PIPE_SHADER_TESS_EVAL]);
+   if (shader_cso[PIPE_SHADER_COMPUTE])
+      ctx->delete_compute_state(ctx, shader_cso[PIPE_SHADER_COMPUTE]);
+}
+
 VKAPI_ATTR void VKAPI_CALL lvp_DestroyPipeline(
    VkDevice                                    _device,
    VkPipeline                                  _pipeline,
@@ -51,18 +70,12 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyPipeline(
    if (!_pipeline)
       return;
 
-   if (pipeline->shader_cso[PIPE_SHADER_VERTEX])
-      device->queue.ctx->delete_vs_state(device->queue.ctx, pipeline->shader_cso[PIPE_SHADER_VERTEX]);
-   if (pipeline->shader_cso[PIPE_SHADER_FRAGMENT])
-      device->queue.ctx->delete_fs_state(device->queue.ctx, pipeline->shader_cso[PIPE_SHADER_FRAGMENT]);
-   if (pipeline->shader_cso[PIPE_SHADER_GEOMETRY])
-      device->queue.ctx->delete_gs_state(device->queue.ctx, pipeline->shader_cso[PIPE_SHADER_GEOMETRY]);
-   if (pipeline->shader_cso[PIPE_SHADER_TESS_CTRL])
-      device->queue.ctx->delete_tcs_state(device->queue.ctx, pipeline->shader_cso[PIPE_SHADER_TESS_CTRL]);
-   if (pipeline->shader_cso[PIPE_SHADER_TESS_EVAL])
-      device->queue.ctx->delete_tes_state(device->queue.ctx, pipeline->shader_cso[PIPE_SHADER_TESS_EVAL]);
-   if (pipeline->shader_cso[PIPE_SHADER_COMPUTE])
-      device->queue.ctx->delete_compute_state(device->queue.ctx, pipeline->shader_cso[PIPE_SHADER_COMPUTE]);
+   lvp_pipeline_delete_csos(pipeline->shader_cso, device->queue.ctx);
+   if (pipeline->exec_shader_cso) {
+      for (unsigned i = 0; i < device->queue.num_exec_threads; i++)
+         lvp_pipeline_delete_csos(pipeline->exec_shader_cso[i],
+                                  device->queue.exec_ctx[i]);
+   }
 
    ralloc_free(pipeline->mem_ctx);
    vk_object_base_finish(&pipeline->base);
@@ -400,8 +413,70 @@ shared_var_info(const struct glsl_type *type, unsigned *size, unsigned *align)
          progress |= this_progress;                               \
       } while(0)
 
+static void
+lvp_hash_pipeline_layout(struct mesa_sha1 *ctx,
+                         const struct lvp_pipeline_layout *layout,
+                         gl_shader_stage stage)
+{
+   /* Only hash what lvp_lower_pipeline_layout() looks at, the layout
+    * objects themselves contain pointers.
+    */
+   _mesa_sha1_update(ctx, &layout->num_sets, sizeof(layout->num_sets));
+   _mesa_sha1_update(ctx, &layout->push_constant_size,
+                     sizeof(layout->push_constant_size));
+   for (unsigned s = 0; s < layout->num_sets; s++) {
+      const struct lvp_descriptor_set_layout *set_layout = layout->set[s].layout;
+
+      _mesa_sha1_update(ctx, &set_layout->binding_count,
+                        sizeof(set_layout->binding_count));
+      for (unsigned st = 0; st < MESA_SHADER_STAGES; st++) {
+         _mesa_sha1_update(ctx, &set_layout->stage[st].const_buffer_count, sizeof(uint16_t));
+         _mesa_sha1_update(ctx, &set_layout->stage[st].shader_buffer_count, sizeof(uint16_t));
+         _mesa_sha1_update(ctx, &set_layout->stage[st].sampler_count, sizeof(uint16_t));
+         _mesa_sha1_update(ctx, &set_layout->stage[st].sampler_view_count, sizeof(uint16_t));
+         _mesa_sha1_update(ctx, &set_layout->stage[st].image_count, sizeof(uint16_t));
+      }
+      for (unsigned b = 0; b < set_layout->binding_count; b++) {
+         const struct lvp_descriptor_set_binding_layout *binding = &set_layout->binding[b];
+
+         _mesa_sha1_update(ctx, &binding->type, sizeof(binding->type));
+         _mesa_sha1_update(ctx, &binding->array_size, sizeof(binding->array_size));
+         _mesa_sha1_update(ctx, &binding->valid, sizeof(binding->valid));
+         _mesa_sha1_update(ctx, &binding->stage[stage].const_buffer_index, sizeof(int16_t));
+         _mesa_sha1_update(ctx, &binding->stage[stage].shader_buffer_index, sizeof(int16_t));
+         _mesa_sha1_update(ctx, &binding->stage[stage].sampler_index, sizeof(int16_t));
+         _mesa_sha1_update(ctx, &binding->stage[stage].sampler_view_index, sizeof(int16_t));
+         _mesa_sha1_update(ctx, &binding->stage[stage].image_index, sizeof(int16_t));
+      }
+   }
+}
+
+static void
+lvp_hash_shader_stage(unsigned char *sha1_out,
+                      const struct lvp_pipeline *pipeline,
+                      const struct vk_shader_module *module,
+                      const char *entrypoint_name,
+                      gl_shader_stage stage,
+                      const VkSpecializationInfo *spec_info)
+{
+   struct mesa_sha1 ctx;
+
+   _mesa_sha1_init(&ctx);
+   _mesa_sha1_update(&ctx, module->sha1, sizeof(module->sha1));
+   _mesa_sha1_update(&ctx, entrypoint_name, strlen(entrypoint_name));
+   _mesa_sha1_update(&ctx, &stage, sizeof(stage));
+   if (spec_info && spec_info->mapEntryCount > 0) {
+      _mesa_sha1_update(&ctx, spec_info->pMapEntries,
+                        spec_info->mapEntryCount * sizeof(*spec_info->pMapEntries));
+      _mesa_sha1_update(&ctx, spec_info->pData, spec_info->dataSize);
+   }
+   lvp_hash_pipeline_layout(&ctx, pipeline->layout, stage);
+   _mesa_sha1_final(&ctx, sha1_out);
+}
+
 static void
 lvp_shader_compile_to_ir(struct lvp_pipeline *pipeline,
+                         struct lvp_pipeline_cache *cache,
                          struct vk_shader_module *module,
                          const char *entrypoint_name,
                          gl_shader_stage stage,
@@ -410,6 +485,18 @@ lvp_shader_compile_to_ir(struct lvp_pipeline *pipeline,
    nir_shader *nir;
    const nir_shader_compiler_options *drv_options = pipeline->device->pscreen->get_compiler_options(pipeline->device->pscreen, PIPE_SHADER_IR_NIR, st_shader_stage_to_ptarget(stage));
    bool progress;
+   unsigned char sha1[20];
+
+   if (cache) {
+      lvp_hash_shader_stage(sha1, pipeline, module, entrypoint_name,
+                            stage, spec_info);
+      nir = lvp_pipeline_cache_search_nir(cache, sha1, drv_options);
+      if (nir) {
+         pipeline->pipeline_nir[stage] = nir;
+         return;
+      }
+   }
+
    uint32_t *spirv = (uint32_t *) module->data;
    assert(spirv[0] == SPIR_V_MAGIC_NUMBER);
    assert(module->size % 4 == 0);
@@ -583,6 +670,9 @@ lvp_shader_compile_to_ir(struct lvp_pipeline *pipeline,
    }
    nir_assign_io_var_locations(nir, nir_var_shader_out, &nir->num_outputs,
                                nir->info.stage);
+
+   if (cache)
+      lvp_pipeline_cache_upload_nir(cache, sha1, nir);
    pipeline->pipeline_nir[stage] = nir;
 }
 
@@ -653,20 +743,75 @@ lvp_shader_stage(VkShaderStageFlagBits stage)
    }
 }
 
+static void *
+lvp_create_shader_cso(struct pipe_context *ctx, gl_shader_stage stage,
+                      const struct pipe_shader_state *shstate,
+                      nir_shader *nir)
+{
+   if (stage == MESA_SHADER_COMPUTE) {
+      struct pipe_compute_state cstate = {0};
+      cstate.prog = (void *)nir;
+      cstate.ir_type = PIPE_SHADER_IR_NIR;
+      cstate.req_local_mem = nir->info.cs.shared_size;
+      return ctx->create_compute_state(ctx, &cstate);
+   }
+
+   struct pipe_shader_state state = *shstate;
+   state.ir.nir = nir;
+
+   switch (stage) {
+   case MESA_SHADER_FRAGMENT:
+      return ctx->create_fs_state(ctx, &state);
+   case MESA_SHADER_VERTEX:
+      return ctx->create_vs_state(ctx, &state);
+   case MESA_SHADER_GEOMETRY:
+      return ctx->create_gs_state(ctx, &state);
+   case MESA_SHADER_TESS_CTRL:
+      return ctx->create_tcs_state(ctx, &state);
+   case MESA_SHADER_TESS_EVAL:
+      return ctx->create_tes_state(ctx, &state);
+   default:
+      unreachable("illegal shader");
+      return NULL;
+   }
+}
+
+/* Create the shader CSOs of a stage for the queue context and each of the
+ * queue's exec contexts.  Drivers keep per-context lists of the variants
+ * of a CSO, so the exec threads can't share the queue context's CSOs; each
+ * context also takes ownership of its NIR, so they get a clone of it.
+ */
+static void
+lvp_pipeline_create_csos(struct lvp_pipeline *pipeline,
+                         gl_shader_stage stage,
+                         const struct pipe_shader_state *shstate)
+{
+   struct lvp_queue *queue = &pipeline->device->queue;
+   enum pipe_shader_type type = pipe_shader_type_from_mesa(stage);
+   nir_shader *nir = pipeline->pipeline_nir[stage];
+
+   if (queue->num_exec_threads && !pipeline->exec_shader_cso) {
+      pipeline->exec_shader_cso =
+         rzalloc_size(pipeline->mem_ctx, queue->num_exec_threads *
+                                         sizeof(*pipeline->exec_shader_cso));
+   }
+   for (unsigned i = 0; i < queue->num_exec_threads; i++) {
+      pipeline->exec_shader_cso[i][type] =
+         lvp_create_shader_cso(queue->exec_ctx[i], stage, shstate,
+                               nir_shader_clone(NULL, nir));
+   }
+   pipeline->shader_cso[type] = lvp_create_shader_cso(queue->ctx, stage,
+                                                      shstate, nir);
+}
+
 static VkResult
 lvp_pipeline_compile(struct lvp_pipeline *pipeline,
                      gl_shader_stage stage)
 {
    struct lvp_device *device = pipeline->device;
+   struct pipe_shader_state shstate = {0};
    device->physical_device->pscreen->finalize_nir(device->physical_device->pscreen, pipeline->pipeline_nir[stage], true);
-   if (stage == MESA_SHADER_COMPUTE) {
-      struct pipe_compute_state shstate = {0};
-      shstate.prog = (void *)pipeline->pipeline_nir[MESA_SHADER_COMPUTE];
-      shstate.ir_type = PIPE_SHADER_IR_NIR;
-      shstate.req_local_mem = pipeline->pipeline_nir[MESA_SHADER_COMPUTE]->info.cs.shared_size;
-      pipeline->shader_cso[PIPE_SHADER_COMPUTE] = device->queue.ctx->create_compute_state(device->queue.ctx, &shstate);
-   } else {
-      struct pipe_shader_state shstate = {0};
+   if (stage != MESA_SHADER_COMPUTE) {
       fill_shader_prog(&shstate, stage, pipeline);
 
       nir_xfb_info *xfb_info = NULL;
@@ -700,28 +845,8 @@ lvp_pipeline_compile(struct lvp_pipeline *pipeline,
             }
          }
       }
-
-      switch (stage) {
-      case MESA_SHADER_FRAGMENT:
-         pipeline->shader_cso[PIPE_SHADER_FRAGMENT] = device->queue.ctx->create_fs_state(device->queue.ctx, &shstate);
-         break;
-      case MESA_SHADER_VERTEX:
-         pipeline->shader_cso[PIPE_SHADER_VERTEX] = device->queue.ctx->create_vs_state(device->queue.ctx, &shstate);
-         break;
-      case MESA_SHADER_GEOMETRY:
-         pipeline->shader_cso[PIPE_SHADER_GEOMETRY] = device->queue.ctx->create_gs_state(device->queue.ctx, &shstate);
-         break;
-      case MESA_SHADER_TESS_CTRL:
-         pipeline->shader_cso[PIPE_SHADER_TESS_CTRL] = device->queue.ctx->create_tcs_state(device->queue.ctx, &shstate);
-         break;
-      case MESA_SHADER_TESS_EVAL:
-         pipeline->shader_cso[PIPE_SHADER_TESS_EVAL] = device->queue.ctx->create_tes_state(device->queue.ctx, &shstate);
-         break;
-      default:
-         unreachable("illegal shader");
-         break;
-      }
    }
+   lvp_pipeline_create_csos(pipeline, stage, &shstate);
    return VK_SUCCESS;
 }
 
@@ -747,7 +872,7 @@ lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
       VK_FROM_HANDLE(vk_shader_module, module,
                       pCreateInfo->pStages[i].module);
       gl_shader_stage stage = lvp_shader_stage(pCreateInfo->pStages[i].stage);
-      lvp_shader_compile_to_ir(pipeline, module,
+      lvp_shader_compile_to_ir(pipeline, cache, module,
                                pCreateInfo->pStages[i].pName,
                                stage,
                                pCreateInfo->pStages[i].pSpecializationInfo);
@@ -786,8 +911,7 @@ lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
       pipeline->pipeline_nir[MESA_SHADER_FRAGMENT] = b.shader;
       struct pipe_shader_state shstate = {0};
       shstate.type = PIPE_SHADER_IR_NIR;
-      shstate.ir.nir = pipeline->pipeline_nir[MESA_SHADER_FRAGMENT];
-      pipeline->shader_cso[PIPE_SHADER_FRAGMENT] = device->queue.ctx->create_fs_state(device->queue.ctx, &shstate);
+      lvp_pipeline_create_csos(pipeline, MESA_SHADER_FRAGMENT, &shstate);
    }
    return VK_SUCCESS;
 }
@@ -872,7 +996,7 @@ lvp_compute_pipeline_init(struct lvp_pipeline *pipeline,
                                  &pipeline->compute_create_info, pCreateInfo);
    pipeline->is_compute_pipeline = true;
 
-   lvp_shader_compile_to_ir(pipeline, module,
+   lvp_shader_compile_to_ir(pipeline, cache, module,
                             pCreateInfo->stage.pName,
                             MESA_SHADER_COMPUTE,
                             pCreateInfo->stage.pSpecializationInfo);
@@ -22,6 +22,153 @@
  */
 
 #include "lvp_private.h"
+#include "util/blob.h"
+#include "util/hash_table.h"
+#include "util/u_dynarray.h"
+#include "util/mesa-sha1.h"
+#include "nir/nir_serialize.h"
+#include "vk_util.h"
+
+struct lvp_cached_nir {
+   unsigned char sha1[20];
+   uint32_t size;
+   uint8_t data[0];
+};
+
+static uint32_t
+sha1_hash_func(const void *sha1)
+{
+   return _mesa_hash_data(sha1, 20);
+}
+
+static bool
+sha1_compare_func(const void *sha1_a, const void *sha1_b)
+{
+   return memcmp(sha1_a, sha1_b, 20) == 0;
+}
+
+static struct lvp_cached_nir *
+lvp_cached_nir_create(struct lvp_pipeline_cache *cache,
+                      const unsigned char *sha1,
+                      const void *data, size_t size)
+{
+   struct lvp_cached_nir *snir =
+      ralloc_size(cache->nir_cache, sizeof(*snir) + size);
+   if (!snir)
+      return NULL;
+
+   memcpy(snir->sha1, sha1, sizeof(snir->sha1));
+   snir->size = size;
+   memcpy(snir->data, data, size);
+   return snir;
+}
+
+/* Must be called with the cache mutex held. */
+static void
+lvp_pipeline_cache_add_locked(struct lvp_pipeline_cache *cache,
+                              const unsigned char *sha1,
+                              const void *data, size_t size)
+{
+   if (_mesa_hash_table_search(cache->nir_cache, sha1))
+      return;
+
+   struct lvp_cached_nir *snir =
+      lvp_cached_nir_create(cache, sha1, data, size);
+   if (snir)
+      _mesa_hash_table_insert(cache->nir_cache, snir->sha1, snir);
+}
+
+nir_shader *
+lvp_pipeline_cache_search_nir(struct lvp_pipeline_cache *cache,
+                              const unsigned char *sha1,
+                              const nir_shader_compiler_options *options)
+{
+   if (!cache)
+      return NULL;
+
+   mtx_lock(&cache->mutex);
+   struct hash_entry *entry =
+      _mesa_hash_table_search(cache->nir_cache, sha1);
+   struct lvp_cached_nir *snir = entry ? entry->data : NULL;
+   mtx_unlock(&cache->mutex);
+
+   /* Entries are never removed while the cache is alive, so the blob can be
+    * read without holding the lock.
+    */
+   if (!snir)
+      return NULL;
+
+   struct blob_reader blob;
+   blob_reader_init(&blob, snir->data, snir->size);
+
+   nir_shader *nir = nir_deserialize(NULL, options, &blob);
+   if (blob.overrun) {
+      ralloc_free(nir);
+      return NULL;
+   }
+   return nir;
+}
+
+void
+lvp_pipeline_cache_upload_nir(struct lvp_pipeline_cache *cache,
+                              const unsigned char *sha1,
+                              const nir_shader *nir)
+{
+   if (!cache)
+      return;
+
+   struct blob blob;
+   blob_init(&blob);
+   nir_serialize(&blob, nir, false);
+   if (!blob.out_of_memory) {
+      mtx_lock(&cache->mutex);
+      lvp_pipeline_cache_add_locked(cache, sha1, blob.data, blob.size);
+      mtx_unlock(&cache->mutex);
+   }
+   blob_finish(&blob);
+}
+
+static bool
+lvp_pipeline_cache_header_valid(const struct vk_pipeline_cache_header *header)
+{
+   uint8_t uuid[VK_UUID_SIZE];
+
+   if (header->header_size < sizeof(*header))
+      return false;
+   if (header->header_version != VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+      return false;
+   if (header->vendor_id != VK_VENDOR_ID_MESA)
+      return false;
+   if (header->device_id != 0)
+      return false;
+
+   lvp_device_get_cache_uuid(uuid);
+   return memcmp(header->uuid, uuid, VK_UUID_SIZE) == 0;
+}
+
+static void
+lvp_pipeline_cache_load(struct lvp_pipeline_cache *cache,
+                        const void *data, size_t size)
+{
+   struct blob_reader blob;
+   blob_reader_init(&blob, data, size);
+
+   struct vk_pipeline_cache_header header;
+   blob_copy_bytes(&blob, &header, sizeof(header));
+   uint32_t count = blob_read_uint32(&blob);
+   if (blob.overrun || !lvp_pipeline_cache_header_valid(&header))
+      return;
+
+   for (uint32_t i = 0; i < count; i++) {
+      const unsigned char *sha1 = blob_read_bytes(&blob, 20);
+      uint32_t nir_size = blob_read_uint32(&blob);
+      const void *nir_data = blob_read_bytes(&blob, nir_size);
+      if (blob.overrun)
+         break;
+
+      lvp_pipeline_cache_add_locked(cache, sha1, nir_data, nir_size);
+   }
+}
 
 VKAPI_ATTR VkResult VKAPI_CALL lvp_CreatePipelineCache(
     VkDevice                                    _device,
@@ -41,6 +188,13 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreatePipelineCache(
    if (cache == NULL)
       return vk_error(device->instance, VK_ERROR_OUT_OF_HOST_MEMORY);
 
+   cache->nir_cache = _mesa_hash_table_create(NULL, sha1_hash_func,
+                                              sha1_compare_func);
+   if (cache->nir_cache == NULL) {
+      vk_free2(&device->vk.alloc, pAllocator, cache);
+      return vk_error(device->instance, VK_ERROR_OUT_OF_HOST_MEMORY);
+   }
+
    vk_object_base_init(&device->vk, &cache->base,
                        VK_OBJECT_TYPE_PIPELINE_CACHE);
    if (pAllocator)
@@ -49,6 +203,12 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreatePipelineCache(
      cache->alloc = device->vk.alloc;
 
    cache->device = device;
+   mtx_init(&cache->mutex, mtx_plain);
+
+   if (pCreateInfo->initialDataSize > 0)
+      lvp_pipeline_cache_load(cache, pCreateInfo->pInitialData,
+                              pCreateInfo->initialDataSize);
+
    *pPipelineCache = lvp_pipeline_cache_to_handle(cache);
 
    return VK_SUCCESS;
@@ -64,7 +224,10 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyPipelineCache(
 
    if (!_cache)
       return;
-//   lvp_pipeline_cache_finish(cache);
+
+   /* The cached blobs are ralloc'ed off the hash table. */
+   _mesa_hash_table_destroy(cache->nir_cache, NULL);
+   mtx_destroy(&cache->mutex);
    vk_object_base_finish(&cache->base);
    vk_free2(&device->vk.alloc, pAllocator, cache);
 }
@@ -75,21 +238,55 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_GetPipelineCacheData(
         size_t*                                     pDataSize,
         void*                                       pData)
 {
+   LVP_FROM_HANDLE(lvp_pipeline_cache, cache, _cache);
    VkResult result = VK_SUCCESS;
-   if (pData) {
-      if (*pDataSize < 32) {
-         *pDataSize = 0;
+   struct blob blob;
+
+   if (pData)
+      blob_init_fixed(&blob, pData, *pDataSize);
+   else
+      blob_init_fixed(&blob, NULL, SIZE_MAX);
+
+   struct vk_pipeline_cache_header header = {
+      .header_size = sizeof(struct vk_pipeline_cache_header),
+      .header_version = VK_PIPELINE_CACHE_HEADER_VERSION_ONE,
+      .vendor_id = VK_VENDOR_ID_MESA,
+      .device_id = 0,
+   };
+   lvp_device_get_cache_uuid(header.uuid);
+   blob_write_bytes(&blob, &header, sizeof(header));
+
+   uint32_t count = 0;
+   intptr_t count_offset = blob_reserve_uint32(&blob);
+   if (count_offset < 0) {
+      *pDataSize = 0;
+      blob_finish(&blob);
+      return VK_INCOMPLETE;
+   }
+
+   mtx_lock(&cache->mutex);
+   hash_table_foreach(cache->nir_cache, entry) {
+      struct lvp_cached_nir *snir = entry->data;
+
+      size_t save_size = blob.size;
+      blob_write_bytes(&blob, snir->sha1, sizeof(snir->sha1));
+      blob_write_uint32(&blob, snir->size);
+      if (!blob_write_bytes(&blob, snir->data, snir->size)) {
+         /* If it fails reset to the previous size and bail */
+         blob.size = save_size;
          result = VK_INCOMPLETE;
-      } else {
-         uint32_t *hdr = (uint32_t *)pData;
-         hdr[0] = 32;
-         hdr[1] = 1;
-         hdr[2] = VK_VENDOR_ID_MESA;
-         hdr[3] = 0;
-         lvp_device_get_cache_uuid(&hdr[4]);
+         break;
       }
-   } else
-      *pDataSize = 32;
+      count++;
+   }
+   mtx_unlock(&cache->mutex);
+
+   blob_overwrite_uint32(&blob, count_offset, count);
+
+   *pDataSize = blob.size;
+
+   blob_finish(&blob);
+
    return result;
 }
 
@@ -99,5 +296,35 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_MergePipelineCaches(
         uint32_t                                    srcCacheCount,
         const VkPipelineCache*                      pSrcCaches)
 {
+   LVP_FROM_HANDLE(lvp_pipeline_cache, dst, destCache);
+   struct util_dynarray snirs;
+
+   util_dynarray_init(&snirs, NULL);
+
+   /* Snapshot each source under its own lock and only then take the dst
+    * lock, so that merges in opposite directions can't deadlock.  The
+    * cached blobs are immutable and never removed while the cache is alive.
+    */
+   for (uint32_t i = 0; i < srcCacheCount; i++) {
+      LVP_FROM_HANDLE(lvp_pipeline_cache, src, pSrcCaches[i]);
+
+      if (src == dst)
+         continue;
+
+      mtx_lock(&src->mutex);
+      hash_table_foreach(src->nir_cache, entry)
+         util_dynarray_append(&snirs, struct lvp_cached_nir *, entry->data);
+      mtx_unlock(&src->mutex);
+   }
+
+   mtx_lock(&dst->mutex);
+   util_dynarray_foreach(&snirs, struct lvp_cached_nir *, snir) {
+      lvp_pipeline_cache_add_locked(dst, (*snir)->sha1,
+                                    (*snir)->data, (*snir)->size);
+   }
+   mtx_unlock(&dst->mutex);
+
+   util_dynarray_fini(&snirs);
+
    return VK_SUCCESS;
 }
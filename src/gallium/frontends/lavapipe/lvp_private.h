@@ -31,6 +31,8 @@
 
 #include "util/macros.h"
 #include "util/list.h"
+#include "util/u_queue.h"
+#include "c11/threads.h"
 
 #include "compiler/shader_enums.h"
 #include "pipe/p_screen.h"
@@ -180,6 +182,13 @@ struct lvp_queue {
    cnd_t new_work;
    struct list_head workqueue;
    volatile int count;
+
+   /* Worker threads executing independent command buffers of a submit
+    * concurrently, each on its own context.
+    */
+   unsigned num_exec_threads;
+   struct util_queue exec_queue;
+   struct pipe_context **exec_ctx;
 };
 
 struct lvp_queue_work {
@@ -193,8 +202,22 @@ struct lvp_pipeline_cache {
    struct vk_object_base                        base;
    struct lvp_device *                          device;
    VkAllocationCallbacks                        alloc;
+
+   mtx_t                                        mutex;
+   /* sha1 -> struct lvp_cached_nir, serialized NIR per shader stage */
+   struct hash_table *                          nir_cache;
 };
 
+nir_shader *
+lvp_pipeline_cache_search_nir(struct lvp_pipeline_cache *cache,
+                              const unsigned char *sha1,
+                              const nir_shader_compiler_options *options);
+
+void
+lvp_pipeline_cache_upload_nir(struct lvp_pipeline_cache *cache,
+                              const unsigned char *sha1,
+                              const nir_shader *nir);
+
 struct lvp_device {
    struct vk_device vk;
 
@@ -311,6 +334,7 @@ struct lvp_render_pass {
    struct vk_object_base                        base;
    uint32_t                                     attachment_count;
    uint32_t                                     subpass_count;
+   bool                                         has_external_dependency;
    struct lvp_subpass_attachment *              subpass_attachments;
    struct lvp_render_pass_attachment *          attachments;
    struct lvp_subpass                           subpasses[0];
@@ -482,6 +506,8 @@ struct lvp_pipeline {
    bool force_min_sample;
    nir_shader *pipeline_nir[MESA_SHADER_STAGES];
    void *shader_cso[PIPE_SHADER_TYPES];
+   /* shader_cso for each of the queue's exec contexts */
+   void *(*exec_shader_cso)[PIPE_SHADER_TYPES];
    VkGraphicsPipelineCreateInfo graphics_create_info;
    VkComputePipelineCreateInfo compute_create_info;
 };
@@ -538,6 +564,19 @@ struct lvp_cmd_pool {
    VkAllocationCallbacks                        alloc;
    struct list_head                             cmd_buffers;
    struct list_head                             free_cmd_buffers;
+   struct list_head                             free_blocks;
+};
+
+/* Commands are recorded linearly into blocks of this size, which go back
+ * to the pool when their command buffer is reset.  Commands that do not
+ * fit get a block of their own, freed on reset.
+ */
+#define LVP_CMD_BLOCK_SIZE (16 * 1024)
+
+struct lvp_cmd_block {
+   struct list_head link;
+   uint32_t size;
+   uint32_t used;
 };
 
 
@@ -561,6 +600,7 @@ struct lvp_cmd_buffer {
 
    struct list_head                             cmds;
    struct list_head                            *last_emit;
+   struct list_head                             blocks;
 
    uint8_t push_constants[MAX_PUSH_CONSTANTS_SIZE];
 };
@@ -1110,10 +1150,24 @@ struct lvp_cmd_buffer_entry {
 };
 
 VkResult lvp_execute_cmds(struct lvp_device *device,
-                          struct lvp_queue *queue,
+                          struct pipe_context *ctx,
+                          int exec_index,
                           struct lvp_fence *fence,
                           struct lvp_cmd_buffer *cmd_buffer);
 
+#define LVP_MAX_RUN_RESOURCES 128
+
+/* Resources read and written by a command buffer, or a run of them */
+struct lvp_resource_access {
+   struct pipe_resource *reads[LVP_MAX_RUN_RESOURCES];
+   struct pipe_resource *writes[LVP_MAX_RUN_RESOURCES];
+   unsigned num_reads;
+   unsigned num_writes;
+};
+
+bool lvp_cmd_buffer_is_independent(struct lvp_cmd_buffer *cmd_buffer,
+                                   struct lvp_resource_access *access);
+
 enum pipe_format vk_format_to_pipe(VkFormat format);
 
 static inline VkImageAspectFlags
@@ -39,6 +39,7 @@
 
 #include "util/crc32.h"
 #include "util/debug.h"
+#include "util/hash_table.h"
 #include "util/rand_xor.h"
 #include "util/u_atomic.h"
 #include "util/mesa-sha1.h"
@@ -62,12 +63,182 @@
  */
 #define CACHE_VERSION 1
 
+/* Puts are dropped rather than queued once this much data is waiting to be
+ * written. A dropped put only costs a later cache miss, while blocking would
+ * stall the compiling thread.
+ */
+#define CACHE_MAX_QUEUED_SIZE (64 * 1024 * 1024)
+
+/* Default size of the in-memory cache, see MESA_DISK_CACHE_MEMORY_SIZE.
+ * Off by default, as every process using the cache would pay for it.
+ */
+#define DEFAULT_MEM_CACHE_SIZE_MB 0
+
+/* In-memory LRU of decompressed items in front of the on-disk cache, so that
+ * items fetched repeatedly by a process are only read and inflated once.
+ */
+struct disk_cache_mem_entry {
+   struct list_head link;
+   cache_key key;
+   size_t size;
+   uint8_t data[];
+};
+
+static uint32_t
+disk_cache_mem_hash(const void *key)
+{
+   /* Keys are sha1s, any part of them is a good hash */
+   uint32_t hash;
+   memcpy(&hash, key, sizeof(hash));
+   return hash;
+}
+
+static bool
+disk_cache_mem_key_equal(const void *a, const void *b)
+{
+   return memcmp(a, b, CACHE_KEY_SIZE) == 0;
+}
+
+static void
+disk_cache_mem_init(struct disk_cache *cache)
+{
+   cache->mem_max_size =
+      (uint64_t)env_var_as_unsigned("MESA_DISK_CACHE_MEMORY_SIZE",
+                                    DEFAULT_MEM_CACHE_SIZE_MB) * 1024 * 1024;
+   if (!cache->mem_max_size)
+      return;
+
+   cache->mem_ht = _mesa_hash_table_create(cache, disk_cache_mem_hash,
+                                           disk_cache_mem_key_equal);
+   if (!cache->mem_ht)
+      return;
+
+   simple_mtx_init(&cache->mem_mtx, mtx_plain);
+   list_inithead(&cache->mem_lru);
+}
+
+static void
+disk_cache_mem_finish(struct disk_cache *cache)
+{
+   if (!cache->mem_ht)
+      return;
+
+   list_for_each_entry_safe(struct disk_cache_mem_entry, entry,
+                            &cache->mem_lru, link)
+      free(entry);
+
+   _mesa_hash_table_destroy(cache->mem_ht, NULL);
+   cache->mem_ht = NULL;
+   simple_mtx_destroy(&cache->mem_mtx);
+}
+
+static void
+disk_cache_mem_evict(struct disk_cache *cache,
+                     struct disk_cache_mem_entry *entry)
+{
+   _mesa_hash_table_remove_key(cache->mem_ht, entry->key);
+   list_del(&entry->link);
+   cache->stats.mem_size -= entry->size;
+   free(entry);
+}
+
+/* Return a malloc'ed copy of the item, or NULL on a miss. */
+static void *
+disk_cache_mem_get(struct disk_cache *cache, const cache_key key,
+                   size_t *size)
+{
+   void *data = NULL;
+
+   simple_mtx_lock(&cache->mem_mtx);
+
+   struct hash_entry *he = _mesa_hash_table_search(cache->mem_ht, key);
+   if (he) {
+      struct disk_cache_mem_entry *entry = he->data;
+
+      data = malloc(MAX2(entry->size, 1));
+      if (data) {
+         memcpy(data, entry->data, entry->size);
+         if (size)
+            *size = entry->size;
+
+         list_del(&entry->link);
+         list_addtail(&entry->link, &cache->mem_lru);
+
+         cache->stats.mem_hits++;
+         cache->stats.mem_hit_bytes += entry->size;
+      }
+   } else {
+      cache->stats.mem_misses++;
+   }
+
+   simple_mtx_unlock(&cache->mem_mtx);
+
+   return data;
+}
+
+static void
+disk_cache_mem_put(struct disk_cache *cache, const cache_key key,
+                   const void *data, size_t size)
+{
+   /* Don't let a single item flush everything else out */
+   if (size > cache->mem_max_size / 4)
+      return;
+
+   struct disk_cache_mem_entry *entry = malloc(sizeof(*entry) + size);
+   if (!entry)
+      return;
+
+   memcpy(entry->key, key, CACHE_KEY_SIZE);
+   entry->size = size;
+   memcpy(entry->data, data, size);
+
+   simple_mtx_lock(&cache->mem_mtx);
+
+   struct hash_entry *he = _mesa_hash_table_search(cache->mem_ht, key);
+   if (he)
+      disk_cache_mem_evict(cache, he->data);
+
+   while (cache->stats.mem_size + size > cache->mem_max_size) {
+      disk_cache_mem_evict(cache,
+                           list_first_entry(&cache->mem_lru,
+                                            struct disk_cache_mem_entry,
+                                            link));
+      cache->stats.mem_evictions++;
+   }
+
+   _mesa_hash_table_insert(cache->mem_ht, entry->key, entry);
+   list_addtail(&entry->link, &cache->mem_lru);
+   cache->stats.mem_size += size;
+
+   simple_mtx_unlock(&cache->mem_mtx);
+}
+
+static void
+disk_cache_mem_remove(struct disk_cache *cache, const cache_key key)
+{
+   simple_mtx_lock(&cache->mem_mtx);
+
+   struct hash_entry *he = _mesa_hash_table_search(cache->mem_ht, key);
+   if (he)
+      disk_cache_mem_evict(cache, he->data);
+
+   simple_mtx_unlock(&cache->mem_mtx);
+}
+
 #define DRV_KEY_CPY(_dst, _src, _src_size) \
 do {                                       \
    memcpy(_dst, _src, _src_size);          \
    _dst += _src_size;                      \
 } while (0);
 
+static void
+cache_evict(void *job, int thread_index)
+{
+   struct disk_cache *cache = (struct disk_cache *) job;
+
+   foz_evict(&cache->foz_db);
+}
+
 struct disk_cache *
 disk_cache_create(const char *gpu_name, const char *driver_id,
                   uint64_t driver_flags)
@@ -95,6 +266,8 @@ disk_cache_create(const char *gpu_name, const char *driver_id,
    /* Assume failure. */
    cache->path_init_failed = true;
 
+   disk_cache_mem_init(cache);
+
 #ifdef ANDROID
    /* Android needs the "disk cache" to be enabled for
     * EGL_ANDROID_blob_cache's callbacks to be called, but it doesn't actually
@@ -111,11 +284,6 @@ disk_cache_create(const char *gpu_name, const char *driver_id,
    if (cache->path == NULL)
       goto path_fail;
 
-   if (env_var_as_boolean("MESA_DISK_CACHE_SINGLE_FILE", false)) {
-      if (!disk_cache_load_cache_index(local, cache))
-         goto path_fail;
-   }
-
    if (!disk_cache_mmap_cache_index(local, cache, path))
       goto path_fail;
 
@@ -161,6 +329,14 @@ disk_cache_create(const char *gpu_name, const char *driver_id,
 
    cache->max_size = max_size;
 
+   /* The single file cache needs the size limit to evict on load. */
+   if (env_var_as_boolean("MESA_DISK_CACHE_SINGLE_FILE", false)) {
+      if (!disk_cache_load_cache_index(local, cache))
+         goto path_fail;
+   } else {
+      disk_cache_load_read_only_foz_dbs(cache);
+   }
+
    /* 4 threads were chosen below because just about all modern CPUs currently
     * available that run Mesa have *at least* 4 cores. For these CPUs allowing
     * more threads can result in the queue being processed faster, thus
@@ -177,6 +353,17 @@ disk_cache_create(const char *gpu_name, const char *driver_id,
                         UTIL_QUEUE_INIT_SET_FULL_THREAD_AFFINITY))
       goto fail;
 
+   /* A single file cache that is over the size limit, e.g. because the limit
+    * was lowered, is compacted in the background rather than holding up the
+    * creation of the cache.
+    */
+   if (env_var_as_boolean("MESA_DISK_CACHE_SINGLE_FILE", false) &&
+       cache->foz_db.size > cache->max_size) {
+      util_queue_fence_init(&cache->evict_fence);
+      util_queue_add_job(&cache->cache_queue, cache, &cache->evict_fence,
+                         cache_evict, NULL, 0);
+   }
+
    cache->path_init_failed = false;
 
  path_fail:
@@ -233,12 +420,16 @@ disk_cache_destroy(struct disk_cache *cache)
       util_queue_finish(&cache->cache_queue);
       util_queue_destroy(&cache->cache_queue);
 
-      if (env_var_as_boolean("MESA_DISK_CACHE_SINGLE_FILE", false))
+      if (env_var_as_boolean("MESA_DISK_CACHE_SINGLE_FILE", false) ||
+          cache->foz_db.alive)
          foz_destroy(&cache->foz_db);
 
       disk_cache_destroy_mmap(cache);
    }
 
+   if (cache)
+      disk_cache_mem_finish(cache);
+
    ralloc_free(cache);
 }
 
@@ -251,6 +442,9 @@ disk_cache_wait_for_idle(struct disk_cache *cache)
 void
 disk_cache_remove(struct disk_cache *cache, const cache_key key)
 {
+   if (cache->mem_ht)
+      disk_cache_mem_remove(cache, key);
+
    char *filename = disk_cache_get_cache_filename(cache, key);
    if (filename == NULL) {
       return;
@@ -326,6 +520,13 @@ cache_put(void *job, int thread_index)
 
    if (env_var_as_boolean("MESA_DISK_CACHE_SINGLE_FILE", false)) {
       disk_cache_write_item_to_disk_foz(dc_job);
+
+      /* Writes are batched while a backlog of puts exists, the last job to
+       * run flushes them. A racy read is fine here, any job queued after
+       * it flushes again.
+       */
+      if (p_atomic_read(&dc_job->cache->cache_queue.num_queued) == 0)
+         foz_flush(&dc_job->cache->foz_db);
    } else {
       filename = disk_cache_get_cache_filename(dc_job->cache, dc_job->key);
       if (filename == NULL)
@@ -358,6 +559,13 @@ disk_cache_put(struct disk_cache *cache, const cache_key key,
    if (cache->path_init_failed)
       return;
 
+   if (cache->mem_ht)
+      disk_cache_mem_put(cache, key, data, size);
+
+   if (p_atomic_read(&cache->cache_queue.total_jobs_size) + size >
+       CACHE_MAX_QUEUED_SIZE)
+      return;
+
    struct disk_cache_put_job *dc_job =
       create_put_job(cache, key, data, size, cache_item_metadata);
 
@@ -368,6 +576,27 @@ disk_cache_put(struct disk_cache *cache, const cache_key key,
    }
 }
 
+static void *
+disk_cache_load(struct disk_cache *cache, const cache_key key, size_t *size)
+{
+   if (env_var_as_boolean("MESA_DISK_CACHE_SINGLE_FILE", false)) {
+      return disk_cache_load_item_foz(cache, key, size);
+   } else {
+      /* Prebuilt read only dbs take precedence over the user's cache */
+      if (cache->foz_db.alive) {
+         void *item = disk_cache_load_item_foz(cache, key, size);
+         if (item)
+            return item;
+      }
+
+      char *filename = disk_cache_get_cache_filename(cache, key);
+      if (filename == NULL)
+         return NULL;
+
+      return disk_cache_load_item(cache, filename, size);
+   }
+}
+
 void *
 disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
 {
@@ -396,15 +625,32 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
       return blob;
    }
 
-   if (env_var_as_boolean("MESA_DISK_CACHE_SINGLE_FILE", false)) {
-      return disk_cache_load_item_foz(cache, key, size);
-   } else {
-      char *filename = disk_cache_get_cache_filename(cache, key);
-      if (filename == NULL)
-         return NULL;
-
-      return disk_cache_load_item(cache, filename, size);
+   if (cache->mem_ht) {
+      void *item = disk_cache_mem_get(cache, key, size);
+      if (item)
+         return item;
    }
+
+   size_t item_size = 0;
+   void *item = disk_cache_load(cache, key, &item_size);
+   if (item && cache->mem_ht)
+      disk_cache_mem_put(cache, key, item, item_size);
+
+   if (size)
+      *size = item_size;
+   return item;
+}
+
+void
+disk_cache_get_stats(struct disk_cache *cache, struct disk_cache_stats *stats)
+{
+   memset(stats, 0, sizeof(*stats));
+   if (!cache->mem_ht)
+      return;
+
+   simple_mtx_lock(&cache->mem_mtx);
+   *stats = cache->stats;
+   simple_mtx_unlock(&cache->mem_mtx);
 }
 
 void
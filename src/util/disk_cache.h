@@ -32,6 +32,7 @@
 #include <assert.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 #include <sys/stat.h>
 #include "util/mesa-sha1.h"
 
@@ -77,6 +78,17 @@ struct cache_item_metadata {
 
 struct disk_cache;
 
+/* Counters of the in-memory cache in front of the disk, see
+ * disk_cache_get_stats().
+ */
+struct disk_cache_stats {
+   uint64_t mem_hits;        /* disk_cache_get() calls served from memory */
+   uint64_t mem_hit_bytes;   /* bytes returned by those calls */
+   uint64_t mem_misses;      /* disk_cache_get() calls that went to disk */
+   uint64_t mem_evictions;   /* items dropped to stay within the size limit */
+   uint64_t mem_size;        /* bytes currently held in memory */
+};
+
 static inline char *
 disk_cache_format_hex_id(char *buf, const uint8_t *hex_id, unsigned size)
 {
@@ -259,6 +271,13 @@ void
 disk_cache_set_callbacks(struct disk_cache *cache, disk_cache_put_cb put,
                          disk_cache_get_cb get);
 
+/**
+ * Return the counters of the in-memory cache. They are all zero if it is
+ * disabled.
+ */
+void
+disk_cache_get_stats(struct disk_cache *cache, struct disk_cache_stats *stats);
+
 #else
 
 static inline struct disk_cache *
@@ -319,6 +338,12 @@ disk_cache_set_callbacks(struct disk_cache *cache, disk_cache_put_cb put,
    return;
 }
 
+static inline void
+disk_cache_get_stats(struct disk_cache *cache, struct disk_cache_stats *stats)
+{
+   memset(stats, 0, sizeof(*stats));
+}
+
 #endif /* ENABLE_SHADER_CACHE */
 
 #ifdef __cplusplus
@@ -375,8 +375,9 @@ disk_cache_evict_item(struct disk_cache *cache, char *filename)
 }
 
 static void *
-parse_and_validate_cache_item(struct disk_cache *cache, void *cache_item,
-                              size_t cache_item_size, size_t *size)
+parse_and_validate_cache_item(struct disk_cache *cache,
+                              const void *cache_item, size_t cache_item_size,
+                              size_t *size)
 {
    uint8_t *uncompressed_data = NULL;
 
@@ -793,6 +794,16 @@ disk_cache_load_item_foz(struct disk_cache *cache, const cache_key key,
                          size_t *size)
 {
    size_t cache_tem_size = 0;
+
+   /* Items of the read only dbs are parsed straight from the mapping, the
+    * cache item crc covers the payload so the db level crc can be skipped.
+    */
+   const void *mapped_item = foz_map_entry(&cache->foz_db, key,
+                                           &cache_tem_size);
+   if (mapped_item)
+      return parse_and_validate_cache_item(cache, mapped_item,
+                                           cache_tem_size, size);
+
    void *cache_item = foz_read_entry(&cache->foz_db, key, &cache_tem_size);
    if (!cache_item)
       return NULL;
@@ -824,7 +835,14 @@ bool
 disk_cache_load_cache_index(void *mem_ctx, struct disk_cache *cache)
 {
    /* Load cache index into a hash map (from fossilise files) */
-   return foz_prepare(&cache->foz_db, cache->path);
+   return foz_prepare(&cache->foz_db, cache->path, cache->max_size);
+}
+
+bool
+disk_cache_load_read_only_foz_dbs(struct disk_cache *cache)
+{
+   /* Prebuilt read only foz dbs in front of the multi file cache */
+   return foz_prepare_read_only(&cache->foz_db, cache->path);
 }
 
 bool
@@ -53,6 +53,9 @@ struct disk_cache {
 
    struct foz_db foz_db;
 
+   /* Fence of the job compacting an oversized single file cache */
+   struct util_queue_fence evict_fence;
+
    /* Seed for rand, which is used to pick a random directory */
    uint64_t seed_xorshift128plus[2];
 
@@ -75,6 +78,15 @@ struct disk_cache {
 
    disk_cache_put_cb blob_put_cb;
    disk_cache_get_cb blob_get_cb;
+
+   /* In-memory LRU of decompressed items, NULL mem_ht if disabled. The
+    * list is ordered least recently used first.
+    */
+   simple_mtx_t mem_mtx;
+   struct hash_table *mem_ht;
+   struct list_head mem_lru;
+   uint64_t mem_max_size;
+   struct disk_cache_stats stats;
 };
 
 struct disk_cache_put_job {
@@ -126,6 +138,9 @@ disk_cache_enabled(void);
 bool
 disk_cache_load_cache_index(void *mem_ctx, struct disk_cache *cache);
 
+bool
+disk_cache_load_read_only_foz_dbs(struct disk_cache *cache);
+
 bool
 disk_cache_mmap_cache_index(void *mem_ctx, struct disk_cache *cache,
                             char *path);
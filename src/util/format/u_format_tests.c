@@ -557,6 +557,68 @@ util_format_test_cases[] =
          }
       }
    },
+   {
+      PIPE_FORMAT_ETC1_RGB8,
+      PACKED_8x8(0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff),
+      PACKED_8x8(0x4a, 0x9e, 0x33, 0x96, 0x1b, 0xe4, 0x72, 0x0d),
+      {
+         {
+            {0x86/255.0, 0xd8/255.0, 0x6d/255.0, 0xff/255.0},
+            {0x5c/255.0, 0xae/255.0, 0x43/255.0, 0xff/255.0},
+            {0x42/255.0, 0x74/255.0, 0x32/255.0, 0xff/255.0},
+            {0x0a/255.0, 0x3c/255.0, 0x00/255.0, 0xff/255.0}
+         },
+         {
+            {0x5c/255.0, 0xae/255.0, 0x43/255.0, 0xff/255.0},
+            {0x38/255.0, 0x8a/255.0, 0x1f/255.0, 0xff/255.0},
+            {0x0a/255.0, 0x3c/255.0, 0x00/255.0, 0xff/255.0},
+            {0xaa/255.0, 0xdc/255.0, 0x9a/255.0, 0xff/255.0}
+         },
+         {
+            {0x0e/255.0, 0x60/255.0, 0x00/255.0, 0xff/255.0},
+            {0x38/255.0, 0x8a/255.0, 0x1f/255.0, 0xff/255.0},
+            {0x72/255.0, 0xa4/255.0, 0x62/255.0, 0xff/255.0},
+            {0xaa/255.0, 0xdc/255.0, 0x9a/255.0, 0xff/255.0}
+         },
+         {
+            {0x86/255.0, 0xd8/255.0, 0x6d/255.0, 0xff/255.0},
+            {0x38/255.0, 0x8a/255.0, 0x1f/255.0, 0xff/255.0},
+            {0x42/255.0, 0x74/255.0, 0x32/255.0, 0xff/255.0},
+            {0x72/255.0, 0xa4/255.0, 0x62/255.0, 0xff/255.0}
+         }
+      }
+   },
+   {
+      PIPE_FORMAT_ETC1_RGB8,
+      PACKED_8x8(0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff),
+      PACKED_8x8(0xe3, 0x5c, 0x8a, 0x49, 0xc6, 0x39, 0xa5, 0x5a),
+      {
+         {
+            {0xe5/255.0, 0x4c/255.0, 0x7f/255.0, 0xff/255.0},
+            {0xd1/255.0, 0x38/255.0, 0x6b/255.0, 0xff/255.0},
+            {0xff/255.0, 0x72/255.0, 0xa5/255.0, 0xff/255.0},
+            {0xf7/255.0, 0x5e/255.0, 0x91/255.0, 0xff/255.0}
+         },
+         {
+            {0xff/255.0, 0x72/255.0, 0xa5/255.0, 0xff/255.0},
+            {0xe5/255.0, 0x4c/255.0, 0x7f/255.0, 0xff/255.0},
+            {0xe5/255.0, 0x4c/255.0, 0x7f/255.0, 0xff/255.0},
+            {0xff/255.0, 0x72/255.0, 0xa5/255.0, 0xff/255.0}
+         },
+         {
+            {0x3c/255.0, 0xd5/255.0, 0xb3/255.0, 0xff/255.0},
+            {0x50/255.0, 0xe9/255.0, 0xc7/255.0, 0xff/255.0},
+            {0x16/255.0, 0xaf/255.0, 0x8d/255.0, 0xff/255.0},
+            {0x2a/255.0, 0xc3/255.0, 0xa1/255.0, 0xff/255.0}
+         },
+         {
+            {0x16/255.0, 0xaf/255.0, 0x8d/255.0, 0xff/255.0},
+            {0x3c/255.0, 0xd5/255.0, 0xb3/255.0, 0xff/255.0},
+            {0x3c/255.0, 0xd5/255.0, 0xb3/255.0, 0xff/255.0},
+            {0x16/255.0, 0xaf/255.0, 0x8d/255.0, 0xff/255.0}
+         }
+      }
+   },
 
 
    /*
@@ -37,6 +37,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -89,14 +91,20 @@ check_files_opened_successfully(FILE *file, FILE *db_idx)
    return true;
 }
 
+/* Names are relative to the cache dir, unless they are absolute paths. This
+ * lets prebuilt read only dbs be shipped outside of the user's cache.
+ */
 static bool
 create_foz_db_filenames(char *cache_path, char *name, char **filename,
                         char **idx_filename)
 {
-   if (asprintf(filename, "%s/%s.foz", cache_path, name) == -1)
+   const char *dir = name[0] == '/' ? "" : cache_path;
+   const char *sep = name[0] == '/' ? "" : "/";
+
+   if (asprintf(filename, "%s%s%s.foz", dir, sep, name) == -1)
       return false;
 
-   if (asprintf(idx_filename, "%s/%s_idx.foz", cache_path, name) == -1) {
+   if (asprintf(idx_filename, "%s%s%s_idx.foz", dir, sep, name) == -1) {
       free(*filename);
       return false;
    }
@@ -108,11 +116,15 @@ static bool
 load_foz_dbs(struct foz_db *foz_db, FILE *db_idx, uint8_t file_idx,
              bool read_only)
 {
-   int err = flock(fileno(foz_db->file[file_idx]), LOCK_EX | LOCK_NB);
+   /* Read only dbs may be shared by any number of processes, e.g. a
+    * prebuilt db shipped with an application.
+    */
+   int lock = read_only ? LOCK_SH : LOCK_EX;
+   int err = flock(fileno(foz_db->file[file_idx]), lock | LOCK_NB);
    if (err == -1)
       goto fail;
 
-   err = flock(fileno(db_idx), LOCK_EX | LOCK_NB);
+   err = flock(fileno(db_idx), lock | LOCK_NB);
    if (err == -1)
       goto fail;
 
@@ -156,7 +168,7 @@ load_foz_dbs(struct foz_db *foz_db, FILE *db_idx, uint8_t file_idx,
          /* NAME + HEADER in one read */
          if (fread(bytes_to_read, 1, sizeof(bytes_to_read), db_idx) !=
              sizeof(bytes_to_read))
-            goto fail;
+            break;
 
          offset += sizeof(bytes_to_read);
          header = (struct foz_payload_header*)&bytes_to_read[FOSSILIZE_BLOB_HASH_LENGTH];
@@ -171,8 +183,8 @@ load_foz_dbs(struct foz_db *foz_db, FILE *db_idx, uint8_t file_idx,
          char hash_str[FOSSILIZE_BLOB_HASH_LENGTH + 1] = {0};
          memcpy(hash_str, bytes_to_read, FOSSILIZE_BLOB_HASH_LENGTH);
 
-         struct foz_db_entry *entry = ralloc(foz_db->mem_ctx,
-                                             struct foz_db_entry);
+         struct foz_db_entry *entry = rzalloc(foz_db->mem_ctx,
+                                              struct foz_db_entry);
          entry->header = *header;
          entry->file_idx = file_idx;
          _mesa_sha1_hex_to_sha1(entry->key, hash_str);
@@ -181,7 +193,7 @@ load_foz_dbs(struct foz_db *foz_db, FILE *db_idx, uint8_t file_idx,
          uint64_t cache_offset;
          if (fread(&cache_offset, 1, sizeof(cache_offset), db_idx) !=
              sizeof(cache_offset))
-            return false;
+            break;
 
          entry->offset = cache_offset;
 
@@ -190,7 +202,27 @@ load_foz_dbs(struct foz_db *foz_db, FILE *db_idx, uint8_t file_idx,
           */
          hash_str[16] = '\0';
          uint64_t key = strtoull(hash_str, NULL, 16);
-         _mesa_hash_table_u64_insert(foz_db->index_db, key, entry);
+
+         if (!read_only) {
+            /* Entries are stored oldest first and every hit appends another
+             * record of the entry, see foz_touch_entry(). The position of
+             * the last record seeds the eviction order until the entry is
+             * used again.
+             */
+            struct foz_db_entry *old =
+               _mesa_hash_table_u64_search(foz_db->index_db, key);
+            if (old)
+               list_del(&old->link);
+            else
+               foz_db->num_entries++;
+            entry->last_used = ++foz_db->gen;
+            entry->record = ++foz_db->records;
+            list_addtail(&entry->link, &foz_db->entries);
+         }
+
+         _mesa_hash_table_u64_insert(read_only ? foz_db->ro_index_db :
+                                                 foz_db->index_db,
+                                     key, entry);
 
          offset += header->payload_size;
       }
@@ -200,6 +232,12 @@ load_foz_dbs(struct foz_db *foz_db, FILE *db_idx, uint8_t file_idx,
             goto fail;
       }
    } else {
+      /* A db can't be read without its index, e.g. after an interrupted
+       * compaction, so start it over rather than append to it.
+       */
+      if (!read_only && ftruncate(fileno(foz_db->file[file_idx]), 0) == -1)
+         goto fail;
+
       /* Appending to a fresh file. Make sure we have the magic. */
       if (fwrite(stream_reference_magic_and_version, 1,
                  sizeof(stream_reference_magic_and_version), foz_db->file[file_idx]) !=
@@ -216,45 +254,350 @@ load_foz_dbs(struct foz_db *foz_db, FILE *db_idx, uint8_t file_idx,
    return true;
 
 fail:
-   foz_destroy(foz_db);
+   /* A bad read only db is skipped by the caller, it mustn't take down the
+    * writable db or the read only dbs loaded before it.
+    */
+   if (!read_only)
+      foz_destroy(foz_db);
    return false;
 }
 
-/* Here we open mesa cache foz dbs files. If the files exist we load the index
- * db into a hash table. The index db contains the offsets needed to later
- * read cache entries from the foz db containing the actual cache entries.
+/* Compaction shrinks the writable db to this size, so that it isn't
+ * rewritten again for the next few writes.
  */
-bool
-foz_prepare(struct foz_db *foz_db, char *cache_path)
+#define FOZ_COMPACT_TARGET(max_size) ((max_size) - (max_size) / 4)
+
+#define FOZ_IDX_RECORD_SIZE \
+   (FOSSILIZE_BLOB_HASH_LENGTH + sizeof(struct foz_payload_header) + \
+    sizeof(uint64_t))
+
+/* Writes are flushed to disk once this much is pending, or when the writer
+ * runs out of work, see foz_flush().
+ */
+#define FOZ_WRITE_BATCH_SIZE (256 * 1024)
+
+/* Size of the db and idx records of an entry with the given payload size. */
+#define FOZ_RECORD_SIZE(payload_size) \
+   (2 * (FOSSILIZE_BLOB_HASH_LENGTH + sizeof(struct foz_payload_header)) + \
+    sizeof(uint64_t) + (payload_size))
+
+static uint64_t
+foz_file_size(FILE *file)
 {
-   char *filename = NULL;
-   char *idx_filename = NULL;
-   if (!create_foz_db_filenames(cache_path, "foz_cache", &filename, &idx_filename))
+   struct stat sb;
+   if (fstat(fileno(file), &sb) == -1)
+      return 0;
+
+   return sb.st_size;
+}
+
+/* Queue an index record pointing at the entry header at offset. */
+static bool
+foz_queue_idx_record(struct util_dynarray *idx_batch, const char *hash_str,
+                     uint64_t offset)
+{
+   struct foz_payload_header idx_header;
+   idx_header.uncompressed_size = sizeof(uint64_t);
+   idx_header.format = FOSSILIZE_COMPRESSION_NONE;
+   idx_header.payload_size = sizeof(uint64_t);
+   idx_header.crc = 0;
+
+   uint8_t *rec = util_dynarray_grow_bytes(idx_batch, 1, FOZ_IDX_RECORD_SIZE);
+   if (!rec)
       return false;
 
-   /* Open the default foz dbs for read/write. If the files didn't already exist
-    * create them.
+   memcpy(rec, hash_str, FOSSILIZE_BLOB_HASH_LENGTH);
+   rec += FOSSILIZE_BLOB_HASH_LENGTH;
+   memcpy(rec, &idx_header, sizeof(idx_header));
+   rec += sizeof(idx_header);
+   memcpy(rec, &offset, sizeof(uint64_t));
+
+   return true;
+}
+
+/* Append an entry to a db, returning the offset of the entry header in the
+ * db. The matching index record is queued in idx_batch, the index must only
+ * reference data that already reached the db, see foz_flush_batch().
+ */
+static bool
+foz_write_record(FILE *file, struct util_dynarray *idx_batch,
+                 const char *hash_str, const struct foz_payload_header *header,
+                 const void *blob, uint64_t *offset)
+{
+   /* Write hash header to db */
+   if (fwrite(hash_str, 1, FOSSILIZE_BLOB_HASH_LENGTH, file) !=
+       FOSSILIZE_BLOB_HASH_LENGTH)
+      return false;
+
+   *offset = ftell(file);
+
+   /* Write db entry header */
+   if (fwrite(header, 1, sizeof(*header), file) != sizeof(*header))
+      return false;
+
+   /* Now write the db entry blob */
+   if (fwrite(blob, 1, header->payload_size, file) != header->payload_size)
+      return false;
+
+   return foz_queue_idx_record(idx_batch, hash_str, *offset);
+}
+
+/* Flush the db before appending the queued index records, so that an
+ * interrupted write never leaves the index pointing past the end of the db.
+ */
+static bool
+foz_flush_batch(FILE *file, FILE *db_idx, struct util_dynarray *idx_batch)
+{
+   bool ok = fflush(file) == 0;
+
+   if (ok && idx_batch->size) {
+      ok = fwrite(idx_batch->data, 1, idx_batch->size, db_idx) ==
+           idx_batch->size;
+      ok = fflush(db_idx) == 0 && ok;
+   }
+
+   util_dynarray_clear(idx_batch);
+   return ok;
+}
+
+struct foz_compact_entry {
+   struct foz_db_entry *entry;
+   struct foz_payload_header header;
+   uint64_t last_used;
+   uint64_t offset;
+   bool valid;
+};
+
+static int
+compare_last_used(const void *a, const void *b)
+{
+   const struct foz_compact_entry *ea = a;
+   const struct foz_compact_entry *eb = b;
+
+   /* Unreadable entries last, then most recently used first */
+   if (ea->valid != eb->valid)
+      return ea->valid ? -1 : 1;
+   if (ea->last_used != eb->last_used)
+      return ea->last_used < eb->last_used ? 1 : -1;
+   return 0;
+}
+
+/* Rewrite the writable db keeping only the most recently used entries that
+ * fit in target_size. The survivors are written least recently used first,
+ * so that the order survives reloading the db. The new files replace the
+ * old ones through rename, if anything fails before that the db is left
+ * untouched.
+ *
+ * Must be called with foz_db->write_mtx held and foz_db->mtx not held. Only
+ * the snapshot of the entries and the swap of the files take foz_db->mtx,
+ * so lookups carry on while the survivors are copied.
+ */
+static bool
+foz_compact(struct foz_db *foz_db, uint64_t target_size)
+{
+   bool ok = false;
+   char *filename = NULL, *idx_filename = NULL;
+   char *tmp_filename = NULL, *tmp_idx_filename = NULL;
+   FILE *file = NULL, *db_idx = NULL;
+   void *blob = NULL;
+   struct util_dynarray idx_batch;
+   util_dynarray_init(&idx_batch, NULL);
+
+   simple_mtx_lock(&foz_db->mtx);
+
+   unsigned n = list_length(&foz_db->entries);
+   struct foz_compact_entry *entries = malloc(MAX2(n, 1) * sizeof(*entries));
+   if (!entries) {
+      simple_mtx_unlock(&foz_db->mtx);
+      return false;
+   }
+
+   /* Entries of the pending batch are read back from the db below */
+   fflush(foz_db->file[0]);
+
+   unsigned i = 0;
+   list_for_each_entry(struct foz_db_entry, entry, &foz_db->entries, link) {
+      entries[i].entry = entry;
+      entries[i].last_used = entry->last_used;
+      i++;
+   }
+
+   simple_mtx_unlock(&foz_db->mtx);
+
+   /* Writers are held off by write_mtx and only compaction removes entries
+    * or replaces file[0], so the snapshot stays valid without the mutex.
+    * Gather the payload headers, they tell us how much each entry takes.
     */
-   foz_db->file[0] = fopen(filename, "a+b");
-   foz_db->db_idx = fopen(idx_filename, "a+b");
+   int fd = fileno(foz_db->file[0]);
+   for (i = 0; i < n; i++) {
+      struct foz_compact_entry *e = &entries[i];
+      e->valid = pread(fd, &e->header, sizeof(e->header), e->entry->offset) ==
+                 sizeof(e->header);
+   }
+
+   qsort(entries, n, sizeof(*entries), compare_last_used);
+
+   uint64_t size = 2 * FOZ_REF_MAGIC_SIZE;
+   unsigned keep = 0;
+   while (keep < n && entries[keep].valid &&
+          size + FOZ_RECORD_SIZE(entries[keep].header.payload_size) <=
+          target_size) {
+      size += FOZ_RECORD_SIZE(entries[keep].header.payload_size);
+      keep++;
+   }
+
+   if (!create_foz_db_filenames(foz_db->cache_path, "foz_cache", &filename,
+                                &idx_filename))
+      goto out;
+
+   if (asprintf(&tmp_filename, "%s.tmp", filename) == -1) {
+      tmp_filename = NULL;
+      goto out;
+   }
+   if (asprintf(&tmp_idx_filename, "%s.tmp", idx_filename) == -1) {
+      tmp_idx_filename = NULL;
+      goto out;
+   }
+
+   file = fopen(tmp_filename, "w+b");
+   db_idx = fopen(tmp_idx_filename, "w+b");
+   if (!check_files_opened_successfully(file, db_idx)) {
+      file = db_idx = NULL;
+      goto out;
+   }
+
+   if (flock(fileno(file), LOCK_EX | LOCK_NB) == -1 ||
+       flock(fileno(db_idx), LOCK_EX | LOCK_NB) == -1)
+      goto out;
+
+   if (fwrite(stream_reference_magic_and_version, 1,
+              sizeof(stream_reference_magic_and_version), file) !=
+       sizeof(stream_reference_magic_and_version) ||
+       fwrite(stream_reference_magic_and_version, 1,
+              sizeof(stream_reference_magic_and_version), db_idx) !=
+       sizeof(stream_reference_magic_and_version))
+      goto out;
+
+   for (i = keep; i-- > 0;) {
+      struct foz_compact_entry *e = &entries[i];
+      uint32_t data_sz = e->header.payload_size;
+
+      void *tmp = realloc(blob, MAX2(data_sz, 1));
+      if (!tmp)
+         goto out;
+      blob = tmp;
+
+      if (pread(fd, blob, data_sz, e->entry->offset + sizeof(e->header)) !=
+          data_sz)
+         goto out;
+
+      char hash_str[FOSSILIZE_BLOB_HASH_LENGTH + 1];
+      _mesa_sha1_format(hash_str, e->entry->key);
+      if (!foz_write_record(file, &idx_batch, hash_str, &e->header, blob,
+                            &e->offset))
+         goto out;
+   }
+
+   if (!foz_flush_batch(file, db_idx, &idx_batch))
+      goto out;
+
+   if (rename(tmp_filename, filename) == -1)
+      goto out;
+   if (rename(tmp_idx_filename, idx_filename) == -1) {
+      /* The new db is in place but the old idx doesn't describe it. Drop
+       * the idx, the db is started over when it is next loaded without
+       * one, and carry on with the new files so this process stays
+       * consistent.
+       */
+      unlink(idx_filename);
+      unlink(tmp_idx_filename);
+   }
+
+   simple_mtx_lock(&foz_db->mtx);
 
+   /* The new files carry our locks, swap them in */
+   fclose(foz_db->file[0]);
+   fclose(foz_db->db_idx);
+   foz_db->file[0] = file;
+   foz_db->db_idx = db_idx;
+   file = db_idx = NULL;
+
+   /* Pending index records are covered by the new index, apart from the
+    * touch records of hits since the snapshot, which are dropped.
+    */
+   util_dynarray_clear(&foz_db->idx_batch);
+   foz_db->batch_size = 0;
+
+   /* Survivors were written in reverse order */
+   for (i = keep; i-- > 0;) {
+      entries[i].entry->offset = entries[i].offset;
+      entries[i].entry->record = ++foz_db->records;
+   }
+
+   for (i = keep; i < n; i++) {
+      struct foz_db_entry *entry = entries[i].entry;
+      _mesa_hash_table_u64_remove(foz_db->index_db,
+                                  truncate_hash_to_64bits(entry->key));
+      list_del(&entry->link);
+      ralloc_free(entry);
+   }
+   foz_db->num_entries = keep;
+
+   foz_db->size = foz_file_size(foz_db->file[0]) +
+                  foz_file_size(foz_db->db_idx);
+
+   simple_mtx_unlock(&foz_db->mtx);
+   ok = true;
+
+out:
+   if (file) {
+      fclose(file);
+      fclose(db_idx);
+      unlink(tmp_filename);
+      unlink(tmp_idx_filename);
+   }
+   util_dynarray_fini(&idx_batch);
+   free(blob);
+   free(tmp_filename);
+   free(tmp_idx_filename);
    free(filename);
    free(idx_filename);
+   free(entries);
+   return ok;
+}
 
-   if (!check_files_opened_successfully(foz_db->file[0], foz_db->db_idx))
-      return false;
+/* Read only dbs never change after they are loaded, so map them once and let
+ * readers access entries without seeking a shared FILE.
+ */
+static void
+map_foz_db(struct foz_db *foz_db, uint8_t file_idx)
+{
+   struct stat sb;
+   int fd = fileno(foz_db->file[file_idx]);
+   if (fstat(fd, &sb) == -1 || sb.st_size == 0)
+      return;
 
-   simple_mtx_init(&foz_db->mtx, mtx_plain);
-   foz_db->mem_ctx = ralloc_context(NULL);
-   foz_db->index_db = _mesa_hash_table_u64_create(NULL);
+   void *map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   if (map == MAP_FAILED)
+      return;
 
-   if (!load_foz_dbs(foz_db, foz_db->db_idx, 0, false))
-      return false;
+   foz_db->map[file_idx] = map;
+   foz_db->map_size[file_idx] = sb.st_size;
+}
+
+/* Load the read only dbs listed in MESA_DISK_CACHE_READ_ONLY_FOZ_DBS. Dbs that
+ * can't be opened or loaded are skipped.
+ */
+static void
+load_read_only_foz_dbs(struct foz_db *foz_db, char *cache_path)
+{
+   char *filename = NULL;
+   char *idx_filename = NULL;
 
    uint8_t file_idx = 1;
    char *foz_dbs = getenv("MESA_DISK_CACHE_READ_ONLY_FOZ_DBS");
    if (!foz_dbs)
-      return true;
+      return;
 
    for (unsigned n; n = strcspn(foz_dbs, ","), *foz_dbs;
         foz_dbs += MAX2(1, n)) {
@@ -276,20 +619,109 @@ foz_prepare(struct foz_db *foz_db, char *cache_path)
       free(filename);
       free(idx_filename);
 
-      if (!check_files_opened_successfully(foz_db->file[file_idx], db_idx))
+      if (!check_files_opened_successfully(foz_db->file[file_idx], db_idx)) {
+         foz_db->file[file_idx] = NULL;
          continue; /* Ignore invalid user provided filename and continue */
+      }
 
       if (!load_foz_dbs(foz_db, db_idx, file_idx, true)) {
          fclose(db_idx);
-         return false;
+         fclose(foz_db->file[file_idx]);
+         foz_db->file[file_idx] = NULL;
+         continue; /* Ignore a corrupt, newer or locked db and continue */
       }
 
       fclose(db_idx);
+      map_foz_db(foz_db, file_idx);
       file_idx++;
 
       if (file_idx >= FOZ_MAX_DBS)
          break;
    }
+}
+
+static void
+foz_init(struct foz_db *foz_db, char *cache_path, uint64_t max_size)
+{
+   simple_mtx_init(&foz_db->mtx, mtx_plain);
+   simple_mtx_init(&foz_db->write_mtx, mtx_plain);
+   foz_db->mem_ctx = ralloc_context(NULL);
+   foz_db->index_db = _mesa_hash_table_u64_create(NULL);
+   foz_db->ro_index_db = _mesa_hash_table_u64_create(NULL);
+   foz_db->cache_path = ralloc_strdup(foz_db->mem_ctx, cache_path);
+   foz_db->max_size = max_size;
+   list_inithead(&foz_db->entries);
+   util_dynarray_init(&foz_db->idx_batch, foz_db->mem_ctx);
+}
+
+/* Open the writable db in cache_path, creating it if needed. */
+static bool
+open_writable_foz_db(struct foz_db *foz_db, char *cache_path,
+                     uint64_t max_size)
+{
+   char *filename = NULL;
+   char *idx_filename = NULL;
+   if (!create_foz_db_filenames(cache_path, "foz_cache", &filename, &idx_filename))
+      return false;
+
+   /* Open the default foz dbs for read/write. If the files didn't already exist
+    * create them.
+    */
+   foz_db->file[0] = fopen(filename, "a+b");
+   foz_db->db_idx = fopen(idx_filename, "a+b");
+
+   free(filename);
+   free(idx_filename);
+
+   if (!check_files_opened_successfully(foz_db->file[0], foz_db->db_idx))
+      return false;
+
+   foz_init(foz_db, cache_path, max_size);
+
+   if (!load_foz_dbs(foz_db, foz_db->db_idx, 0, false))
+      return false;
+
+   fflush(foz_db->file[0]);
+   fflush(foz_db->db_idx);
+   foz_db->size = foz_file_size(foz_db->file[0]) +
+                  foz_file_size(foz_db->db_idx);
+
+   return true;
+}
+
+/* Here we open mesa cache foz dbs files. If the files exist we load the index
+ * db into a hash table. The index db contains the offsets needed to later
+ * read cache entries from the foz db containing the actual cache entries.
+ *
+ * A db that is already over max_size is left as is, see foz_evict().
+ */
+bool
+foz_prepare(struct foz_db *foz_db, char *cache_path, uint64_t max_size)
+{
+   if (!open_writable_foz_db(foz_db, cache_path, max_size))
+      return false;
+
+   load_read_only_foz_dbs(foz_db, cache_path);
+   return true;
+}
+
+/* Load only the read only dbs, for use in front of a cache that isn't a foz
+ * db itself. Fails if there are none.
+ */
+bool
+foz_prepare_read_only(struct foz_db *foz_db, char *cache_path)
+{
+   if (!getenv("MESA_DISK_CACHE_READ_ONLY_FOZ_DBS"))
+      return false;
+
+   foz_init(foz_db, cache_path, 0);
+
+   load_read_only_foz_dbs(foz_db, cache_path);
+
+   if (!foz_db->file[1]) {
+      foz_destroy(foz_db);
+      return false;
+   }
 
    return true;
 }
@@ -297,92 +729,218 @@ foz_prepare(struct foz_db *foz_db, char *cache_path)
 void
 foz_destroy(struct foz_db *foz_db)
 {
-   fclose(foz_db->db_idx);
+   if (foz_db->db_idx) {
+      foz_flush_batch(foz_db->file[0], foz_db->db_idx, &foz_db->idx_batch);
+      fclose(foz_db->db_idx);
+   }
+   foz_db->db_idx = NULL;
+
    for (unsigned i = 0; i < FOZ_MAX_DBS; i++) {
+      if (foz_db->map[i])
+         munmap((void *)foz_db->map[i], foz_db->map_size[i]);
       if (foz_db->file[i])
          fclose(foz_db->file[i]);
+      foz_db->map[i] = NULL;
+      foz_db->file[i] = NULL;
    }
 
    if (foz_db->mem_ctx) {
+      _mesa_hash_table_u64_destroy(foz_db->ro_index_db, NULL);
       _mesa_hash_table_u64_destroy(foz_db->index_db, NULL);
       ralloc_free(foz_db->mem_ctx);
+      simple_mtx_destroy(&foz_db->write_mtx);
       simple_mtx_destroy(&foz_db->mtx);
+      foz_db->mem_ctx = NULL;
+   }
+
+   foz_db->alive = false;
+}
+
+/* Check for collision using full 160bit hash for increased assurance
+ * against potential collisions.
+ */
+static struct foz_db_entry *
+foz_search_entry(struct hash_table_u64 *index_db,
+                 const uint8_t *cache_key_160bit)
+{
+   struct foz_db_entry *entry =
+      _mesa_hash_table_u64_search(index_db,
+                                  truncate_hash_to_64bits(cache_key_160bit));
+   if (entry && memcmp(cache_key_160bit, entry->key, sizeof(entry->key)) != 0)
+      return NULL;
+
+   return entry;
+}
+
+/* Return a pointer to the payload of an entry in a mapped read only db, or
+ * NULL if the db isn't mapped or the entry runs past the end of the file.
+ */
+static const uint8_t *
+foz_mapped_payload(struct foz_db *foz_db, const struct foz_db_entry *entry,
+                   struct foz_payload_header *header)
+{
+   const uint8_t *map = foz_db->map[entry->file_idx];
+   size_t map_size = foz_db->map_size[entry->file_idx];
+   if (!map)
+      return NULL;
+
+   if (entry->offset > map_size ||
+       map_size - entry->offset < sizeof(*header))
+      return NULL;
+
+   memcpy(header, map + entry->offset, sizeof(*header));
+   if (map_size - entry->offset - sizeof(*header) < header->payload_size)
+      return NULL;
+
+   return map + entry->offset + sizeof(*header);
+}
+
+/* pread doesn't touch the FILE offset, so readers don't need to serialize
+ * with each other or with the appending writer.
+ */
+static void *
+foz_pread_payload(FILE *file, const struct foz_db_entry *entry,
+                  struct foz_payload_header *header)
+{
+   int fd = fileno(file);
+   if (pread(fd, header, sizeof(*header), entry->offset) != sizeof(*header))
+      return NULL;
+
+   void *data = malloc(header->payload_size);
+   if (!data)
+      return NULL;
+
+   if (pread(fd, data, header->payload_size,
+             entry->offset + sizeof(*header)) != header->payload_size) {
+      free(data);
+      return NULL;
+   }
+
+   return data;
+}
+
+/* Append another index record of a writable db entry that was hit, so that
+ * the eviction order outlives the process. Only entries whose last record is
+ * in the older half of the index are recorded again, which keeps hits on
+ * recent entries free and bounds the growth of the index. Compaction drops
+ * the stale records.
+ *
+ * Must be called with foz_db->mtx held.
+ */
+static void
+foz_touch_entry(struct foz_db *foz_db, struct foz_db_entry *entry)
+{
+   if (foz_db->records - entry->record <= foz_db->num_entries / 2)
+      return;
+
+   char hash_str[FOSSILIZE_BLOB_HASH_LENGTH + 1];
+   _mesa_sha1_format(hash_str, entry->key);
+
+   if (!foz_queue_idx_record(&foz_db->idx_batch, hash_str, entry->offset))
+      return;
+
+   entry->record = ++foz_db->records;
+   foz_db->size += FOZ_IDX_RECORD_SIZE;
+   foz_db->batch_size += FOZ_IDX_RECORD_SIZE;
+
+   if (foz_db->batch_size >= FOZ_WRITE_BATCH_SIZE) {
+      foz_flush_batch(foz_db->file[0], foz_db->db_idx, &foz_db->idx_batch);
+      foz_db->batch_size = 0;
    }
 }
 
 /* Here we lookup a cache entry in the index hash table. If an entry is found
  * we use the retrieved offset to read the cache entry from disk.
+ *
+ * The read only dbs are never modified once loaded so they are read without
+ * locking. The writable db may be swapped out by a concurrent compaction, so
+ * it is read with the mutex held.
  */
 void *
 foz_read_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
                size_t *size)
 {
-   uint64_t hash = truncate_hash_to_64bits(cache_key_160bit);
-
-   void *data = NULL;
-
    if (!foz_db->alive)
       return NULL;
 
-   simple_mtx_lock(&foz_db->mtx);
+   struct foz_payload_header header;
+   void *data = NULL;
 
    struct foz_db_entry *entry =
-      _mesa_hash_table_u64_search(foz_db->index_db, hash);
-   if (!entry) {
+      foz_search_entry(foz_db->ro_index_db, cache_key_160bit);
+   if (entry) {
+      const uint8_t *payload = foz_mapped_payload(foz_db, entry, &header);
+      if (payload) {
+         data = malloc(header.payload_size);
+         if (data)
+            memcpy(data, payload, header.payload_size);
+      } else {
+         data = foz_pread_payload(foz_db->file[entry->file_idx], entry,
+                                  &header);
+      }
+   } else {
+      simple_mtx_lock(&foz_db->mtx);
+      entry = foz_search_entry(foz_db->index_db, cache_key_160bit);
+      if (entry) {
+         /* The entry may still sit in the stdio buffer */
+         if (foz_db->batch_size)
+            fflush(foz_db->file[0]);
+         data = foz_pread_payload(foz_db->file[0], entry, &header);
+         entry->last_used = ++foz_db->gen;
+         if (data)
+            foz_touch_entry(foz_db, entry);
+      }
       simple_mtx_unlock(&foz_db->mtx);
-      return NULL;
    }
 
-   uint8_t file_idx = entry->file_idx;
-   off_t offset = ftell(foz_db->file[file_idx]);
-   if (fseek(foz_db->file[file_idx], entry->offset, SEEK_SET) < 0)
-      goto fail;
-
-   uint32_t header_size = sizeof(struct foz_payload_header);
-   if (fread(&entry->header, 1, header_size, foz_db->file[file_idx]) !=
-       header_size)
-      goto fail;
-
-   /* Check for collision using full 160bit hash for increased assurance
-    * against potential collisions.
-    */
-   for (int i = 0; i < 20; i++) {
-      if (cache_key_160bit[i] != entry->key[i])
-         goto fail;
-   }
-
-   uint32_t data_sz = entry->header.payload_size;
-   data = malloc(data_sz);
-   if (fread(data, 1, data_sz, foz_db->file[file_idx]) != data_sz)
-      goto fail;
+   if (!data)
+      return NULL;
 
    /* verify checksum */
-   if (entry->header.crc != 0) {
-      if (util_hash_crc32(data, data_sz) != entry->header.crc)
-         goto fail;
+   if (header.crc != 0) {
+      if (util_hash_crc32(data, header.payload_size) != header.crc) {
+         free(data);
+         return NULL;
+      }
    }
 
-   simple_mtx_unlock(&foz_db->mtx);
-
    if (size)
-      *size = data_sz;
-
-   /* Reset file offset to the end of the file ready for writing */
-   fseek(foz_db->file[file_idx], offset, SEEK_SET);
+      *size = header.payload_size;
 
    return data;
+}
 
-fail:
-   free(data);
+/* Zero-copy variant of foz_read_entry() for entries of the read only dbs.
+ * The returned pointer stays valid until foz_destroy(). The payload crc is
+ * not checked here, callers are expected to validate the data themselves.
+ * Returns NULL if the entry is missing or not in a mapped db, in which case
+ * foz_read_entry() should be used.
+ */
+const void *
+foz_map_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
+              size_t *size)
+{
+   if (!foz_db->alive)
+      return NULL;
 
-   /* reading db entry failed. reset the file offset */
-   fseek(foz_db->file[file_idx], offset, SEEK_SET);
-   simple_mtx_unlock(&foz_db->mtx);
+   struct foz_db_entry *entry =
+      foz_search_entry(foz_db->ro_index_db, cache_key_160bit);
+   if (!entry)
+      return NULL;
 
-   return NULL;
+   struct foz_payload_header header;
+   const uint8_t *payload = foz_mapped_payload(foz_db, entry, &header);
+   if (!payload)
+      return NULL;
+
+   if (size)
+      *size = header.payload_size;
+
+   return payload;
 }
 
 /* Here we write the cache entry to disk and store its offset in the index db.
+ * Writes are batched, foz_flush() forces them out.
  */
 bool
 foz_write_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
@@ -390,18 +948,37 @@ foz_write_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
 {
    uint64_t hash = truncate_hash_to_64bits(cache_key_160bit);
 
-   if (!foz_db->alive)
+   if (!foz_db->alive || !foz_db->file[0])
       return false;
 
+   if (_mesa_hash_table_u64_search(foz_db->ro_index_db, hash))
+      return false;
+
+   simple_mtx_lock(&foz_db->write_mtx);
    simple_mtx_lock(&foz_db->mtx);
 
    struct foz_db_entry *entry =
       _mesa_hash_table_u64_search(foz_db->index_db, hash);
-   if (entry) {
-      simple_mtx_unlock(&foz_db->mtx);
-      return NULL;
+   bool full = foz_db->max_size &&
+               foz_db->size + FOZ_RECORD_SIZE(blob_size) > foz_db->max_size;
+
+   simple_mtx_unlock(&foz_db->mtx);
+
+   if (entry)
+      goto fail;
+
+   /* Make room by dropping the least recently used entries. An entry that
+    * doesn't fit even after compaction isn't cached at all.
+    */
+   if (full) {
+      uint64_t target = FOZ_COMPACT_TARGET(foz_db->max_size);
+      if (FOZ_RECORD_SIZE(blob_size) > target)
+         goto fail;
+      foz_compact(foz_db, target - FOZ_RECORD_SIZE(blob_size));
    }
 
+   simple_mtx_lock(&foz_db->mtx);
+
    /* Prepare db entry header and blob ready for writing */
    struct foz_payload_header header;
    header.uncompressed_size = blob_size;
@@ -409,66 +986,111 @@ foz_write_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
    header.payload_size = blob_size;
    header.crc = util_hash_crc32(blob, blob_size);
 
-   /* Write hash header to db */
    char hash_str[FOSSILIZE_BLOB_HASH_LENGTH + 1]; /* 40 digits + null */
    _mesa_sha1_format(hash_str, cache_key_160bit);
-   if (fwrite(hash_str, 1, FOSSILIZE_BLOB_HASH_LENGTH, foz_db->file[0]) !=
-       FOSSILIZE_BLOB_HASH_LENGTH)
-      goto fail;
-
-   off_t offset = ftell(foz_db->file[0]);
 
-   /* Write db entry header */
-   if (fwrite(&header, 1, sizeof(header), foz_db->file[0]) != sizeof(header))
-      goto fail;
-
-   /* Now write the db entry blob */
-   if (fwrite(blob, 1, blob_size, foz_db->file[0]) != blob_size)
+   uint64_t offset;
+   if (!foz_write_record(foz_db->file[0], &foz_db->idx_batch, hash_str,
+                         &header, blob, &offset)) {
+      simple_mtx_unlock(&foz_db->mtx);
       goto fail;
+   }
 
-   /* Flush everything to file to reduce chance of cache corruption */
-   fflush(foz_db->file[0]);
-
-   /* Write hash header to index db */
-   if (fwrite(hash_str, 1, FOSSILIZE_BLOB_HASH_LENGTH, foz_db->db_idx) !=
-       FOSSILIZE_BLOB_HASH_LENGTH)
-      goto fail;
+   foz_db->size += FOZ_RECORD_SIZE(blob_size);
+   foz_db->batch_size += FOZ_RECORD_SIZE(blob_size);
 
    header.uncompressed_size = sizeof(uint64_t);
    header.format = FOSSILIZE_COMPRESSION_NONE;
    header.payload_size = sizeof(uint64_t);
    header.crc = 0;
 
-   if (fwrite(&header, 1, sizeof(header), foz_db->db_idx) !=
-       sizeof(header))
-      goto fail;
-
-   if (fwrite(&offset, 1, sizeof(uint64_t), foz_db->db_idx) !=
-       sizeof(uint64_t))
-      goto fail;
-
-   /* Flush everything to file to reduce chance of cache corruption */
-   fflush(foz_db->db_idx);
-
    entry = ralloc(foz_db->mem_ctx, struct foz_db_entry);
    entry->header = header;
    entry->offset = offset;
    entry->file_idx = 0;
+   entry->last_used = ++foz_db->gen;
+   entry->record = ++foz_db->records;
    _mesa_sha1_hex_to_sha1(entry->key, hash_str);
+   list_addtail(&entry->link, &foz_db->entries);
+   foz_db->num_entries++;
    _mesa_hash_table_u64_insert(foz_db->index_db, hash, entry);
 
+   if (foz_db->batch_size >= FOZ_WRITE_BATCH_SIZE) {
+      foz_flush_batch(foz_db->file[0], foz_db->db_idx, &foz_db->idx_batch);
+      foz_db->batch_size = 0;
+   }
+
    simple_mtx_unlock(&foz_db->mtx);
+   simple_mtx_unlock(&foz_db->write_mtx);
 
    return true;
 
 fail:
-   simple_mtx_unlock(&foz_db->mtx);
+   simple_mtx_unlock(&foz_db->write_mtx);
    return false;
 }
+
+/* Write out any batched entries. */
+void
+foz_flush(struct foz_db *foz_db)
+{
+   if (!foz_db->alive || !foz_db->file[0])
+      return;
+
+   simple_mtx_lock(&foz_db->mtx);
+   if (foz_db->batch_size) {
+      foz_flush_batch(foz_db->file[0], foz_db->db_idx, &foz_db->idx_batch);
+      foz_db->batch_size = 0;
+   }
+   simple_mtx_unlock(&foz_db->mtx);
+}
+
+/* Compact the writable db if it is over its size limit, e.g. because it
+ * outgrew the limit in a previous run or the limit was lowered since. This
+ * copies up to the whole db, so it is meant to run off the application's
+ * threads.
+ */
+void
+foz_evict(struct foz_db *foz_db)
+{
+   if (!foz_db->alive || !foz_db->file[0] || !foz_db->max_size)
+      return;
+
+   simple_mtx_lock(&foz_db->write_mtx);
+
+   simple_mtx_lock(&foz_db->mtx);
+   bool full = foz_db->size > foz_db->max_size;
+   simple_mtx_unlock(&foz_db->mtx);
+
+   if (full)
+      foz_compact(foz_db, FOZ_COMPACT_TARGET(foz_db->max_size));
+
+   simple_mtx_unlock(&foz_db->write_mtx);
+}
+
+/* Offline compaction of the writable db in cache_path down to max_size,
+ * e.g. for maintenance jobs between runs. Fails if another process has the
+ * db open.
+ */
+bool
+foz_compact_db(char *cache_path, uint64_t max_size)
+{
+   struct foz_db foz_db = {0};
+
+   if (!open_writable_foz_db(&foz_db, cache_path, max_size))
+      return false;
+
+   simple_mtx_lock(&foz_db.write_mtx);
+   bool ok = foz_compact(&foz_db, max_size);
+   simple_mtx_unlock(&foz_db.write_mtx);
+
+   foz_destroy(&foz_db);
+   return ok;
+}
 #else
 
 bool
-foz_prepare(struct foz_db *foz_db, char *filename)
+foz_prepare(struct foz_db *foz_db, char *filename, uint64_t max_size)
 {
    fprintf(stderr, "Warning: Mesa single file cache selected but Mesa wasn't "
            "built with single cache file support. Shader cache will be disabled"
@@ -476,6 +1098,12 @@ foz_prepare(struct foz_db *foz_db, char *filename)
    return false;
 }
 
+bool
+foz_prepare_read_only(struct foz_db *foz_db, char *cache_path)
+{
+   return false;
+}
+
 void
 foz_destroy(struct foz_db *foz_db)
 {
@@ -488,6 +1116,13 @@ foz_read_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
    return false;
 }
 
+const void *
+foz_map_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
+              size_t *size)
+{
+   return NULL;
+}
+
 bool
 foz_write_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
                 const void *blob, size_t size)
@@ -495,4 +1130,20 @@ foz_write_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
    return false;
 }
 
+void
+foz_flush(struct foz_db *foz_db)
+{
+}
+
+void
+foz_evict(struct foz_db *foz_db)
+{
+}
+
+bool
+foz_compact_db(char *cache_path, uint64_t max_size)
+{
+   return false;
+}
+
 #endif
@@ -41,7 +41,9 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include "list.h"
 #include "simple_mtx.h"
+#include "u_dynarray.h"
 
 /* Max number of DBs our implementation can read from at once */
 #define FOZ_MAX_DBS 9 /* Default DB + 8 Read only DBs */
@@ -70,19 +72,40 @@ struct foz_db_entry {
    uint8_t key[20];
    uint64_t offset;
    struct foz_payload_header header;
+   struct list_head link;            /* In foz_db::entries if writable */
+   uint64_t last_used;               /* foz_db::gen of the last read or write */
+   uint64_t record;                  /* foz_db::records at the last index
+                                      * record of the entry */
 };
 
 struct foz_db {
    FILE *file[FOZ_MAX_DBS];          /* An array of all foz dbs */
    FILE *db_idx;                     /* The default writable foz db idx */
-   simple_mtx_t mtx;                 /* Mutex for file/hash table read/writes */
+   simple_mtx_t mtx;                 /* Mutex for writable db/index_db access */
+   simple_mtx_t write_mtx;           /* Serializes writes and compaction */
    void *mem_ctx;
-   struct hash_table_u64 *index_db;  /* Hash table of all foz db entries */
+   struct hash_table_u64 *index_db;  /* Hash table of writable db entries */
+   struct hash_table_u64 *ro_index_db; /* Read only db entries, immutable
+                                        * once foz_prepare() returns */
+   const uint8_t *map[FOZ_MAX_DBS];  /* Mappings of the read only dbs */
+   size_t map_size[FOZ_MAX_DBS];
+   struct list_head entries;         /* Entries of the writable db */
+   char *cache_path;
+   uint64_t size;                    /* Size of the writable db and its idx */
+   uint64_t max_size;                /* 0 means unbounded */
+   uint64_t gen;                     /* Access counter for eviction */
+   uint64_t records;                 /* Index records of the writable db */
+   unsigned num_entries;             /* Length of foz_db::entries */
+   struct util_dynarray idx_batch;   /* Index records of unflushed writes */
+   uint64_t batch_size;              /* Bytes written since the last flush */
    bool alive;
 };
 
 bool
-foz_prepare(struct foz_db *foz_db, char *cache_path);
+foz_prepare(struct foz_db *foz_db, char *cache_path, uint64_t max_size);
+
+bool
+foz_prepare_read_only(struct foz_db *foz_db, char *cache_path);
 
 void
 foz_destroy(struct foz_db *foz_db);
@@ -91,8 +114,21 @@ void *
 foz_read_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
                size_t *size);
 
+const void *
+foz_map_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
+              size_t *size);
+
 bool
 foz_write_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
                 const void *blob, size_t size);
 
+void
+foz_flush(struct foz_db *foz_db);
+
+void
+foz_evict(struct foz_db *foz_db);
+
+bool
+foz_compact_db(char *cache_path, uint64_t max_size);
+
 #endif /* FOSSILIZE_DB_H */
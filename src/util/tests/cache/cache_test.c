@@ -37,6 +37,7 @@
 
 #include "util/mesa-sha1.h"
 #include "util/disk_cache.h"
+#include "util/fossilize_db.h"
 
 bool error = false;
 
@@ -516,6 +517,305 @@ test_put_key_and_get_key(void)
 
    disk_cache_destroy(cache);
 }
+
+static void
+test_memory_cache(void)
+{
+   struct disk_cache *cache;
+   struct disk_cache_stats stats;
+   char blob[] = "This is a blob of thirty-seven bytes";
+   uint8_t blob_key[20], big_keys[6][20];
+   char *result;
+   size_t size;
+
+#ifdef SHADER_CACHE_DISABLE_BY_DEFAULT
+   setenv("MESA_GLSL_CACHE_DISABLE", "false", 1);
+#endif /* SHADER_CACHE_DISABLE_BY_DEFAULT */
+
+   setenv("MESA_DISK_CACHE_MEMORY_SIZE", "1", 1);
+   cache = disk_cache_create("test", "make_check", 0);
+
+   disk_cache_compute_key(cache, blob, sizeof(blob), blob_key);
+   disk_cache_put(cache, blob_key, blob, sizeof(blob), NULL);
+   disk_cache_wait_for_idle(cache);
+
+   result = disk_cache_get(cache, blob_key, &size);
+   expect_equal_str(blob, result, "disk_cache_get from memory (pointer)");
+   expect_equal(size, sizeof(blob), "disk_cache_get from memory (size)");
+   free(result);
+
+   disk_cache_get_stats(cache, &stats);
+   expect_equal(stats.mem_hits, 1, "memory cache hit after put");
+   expect_equal(stats.mem_hit_bytes, sizeof(blob), "memory cache hit bytes");
+   expect_equal(stats.mem_misses, 0, "no memory cache miss after put");
+
+   /* Overflow the 1MB limit with 200KB items to force evictions. */
+   char *big = calloc(1, 200 * 1024);
+   for (unsigned i = 0; i < 6; i++) {
+      big[0] = i;
+      disk_cache_compute_key(cache, big, 200 * 1024, big_keys[i]);
+      disk_cache_put(cache, big_keys[i], big, 200 * 1024, NULL);
+   }
+   free(big);
+   disk_cache_wait_for_idle(cache);
+
+   disk_cache_get_stats(cache, &stats);
+   expect_true(stats.mem_evictions > 0, "memory cache evicts when full");
+   expect_true(stats.mem_size <= 1024 * 1024,
+               "memory cache stays within MESA_DISK_CACHE_MEMORY_SIZE");
+
+   result = disk_cache_get(cache, big_keys[5], &size);
+   expect_non_null(result, "most recent item still in memory");
+   free(result);
+
+   /* Removing an item drops it from memory as well. */
+   uint64_t mem_size = stats.mem_size;
+   disk_cache_remove(cache, big_keys[5]);
+   disk_cache_get_stats(cache, &stats);
+   expect_equal(stats.mem_size, mem_size - 200 * 1024,
+                "disk_cache_remove drops the item from memory");
+
+   disk_cache_destroy(cache);
+
+   unsetenv("MESA_DISK_CACHE_MEMORY_SIZE");
+}
+
+#define FOZ_TEST_EVICT CACHE_TEST_TMP "/foz-evict"
+#define FOZ_TEST_EVICT_DB \
+   FOZ_TEST_EVICT "/" CACHE_DIR_NAME_SF "/make_check/test"
+#define FOZ_TEST_ITEM_SIZE (4 * 1024)
+
+static uint64_t
+foz_test_db_size(void)
+{
+   struct stat sb;
+   uint64_t size = 0;
+
+   if (stat(FOZ_TEST_EVICT_DB "/foz_cache.foz", &sb) == 0)
+      size += sb.st_size;
+   if (stat(FOZ_TEST_EVICT_DB "/foz_cache_idx.foz", &sb) == 0)
+      size += sb.st_size;
+
+   return size;
+}
+
+/* Put an item that doesn't compress, so that it takes a known amount of
+ * space in the db.
+ */
+static void
+foz_test_put(struct disk_cache *cache, unsigned seed, uint8_t *key)
+{
+   uint32_t *data = malloc(FOZ_TEST_ITEM_SIZE);
+   uint32_t x = seed * 2654435761u + 1;
+
+   for (unsigned i = 0; i < FOZ_TEST_ITEM_SIZE / 4; i++) {
+      x ^= x << 13;
+      x ^= x >> 17;
+      x ^= x << 5;
+      data[i] = x;
+   }
+
+   disk_cache_compute_key(cache, data, FOZ_TEST_ITEM_SIZE, key);
+   disk_cache_put(cache, key, data, FOZ_TEST_ITEM_SIZE, NULL);
+   free(data);
+}
+
+static void
+test_single_file_eviction(void)
+{
+   struct disk_cache *cache;
+   uint8_t keys[4][20];
+   char *result;
+
+#ifdef SHADER_CACHE_DISABLE_BY_DEFAULT
+   setenv("MESA_GLSL_CACHE_DISABLE", "false", 1);
+#endif /* SHADER_CACHE_DISABLE_BY_DEFAULT */
+
+   setenv("MESA_DISK_CACHE_SINGLE_FILE", "true", 1);
+   setenv("MESA_GLSL_CACHE_DIR", FOZ_TEST_EVICT, 1);
+   setenv("MESA_GLSL_CACHE_MAX_SIZE", "16K", 1);
+
+   /* Three items fit in 16K. Reading the first one makes it the most
+    * recently used, which has to outlive the process.
+    */
+   cache = disk_cache_create("test", "make_check", 0);
+   for (unsigned i = 0; i < 3; i++)
+      foz_test_put(cache, i, keys[i]);
+   disk_cache_wait_for_idle(cache);
+   expect_true(does_cache_contain(cache, keys[0]),
+               "single file cache get before eviction");
+   disk_cache_destroy(cache);
+
+   expect_true(foz_test_db_size() <= 16 * 1024,
+               "single file cache within MAX_SIZE=16K before eviction");
+
+   /* A new process overflows the limit, which compacts the db down to 3/4
+    * of it, keeping the most recently used items.
+    */
+   cache = disk_cache_create("test", "make_check", 0);
+   foz_test_put(cache, 3, keys[3]);
+   disk_cache_wait_for_idle(cache);
+
+   expect_true(does_cache_contain(cache, keys[3]),
+               "single file cache keeps the new item");
+   expect_true(does_cache_contain(cache, keys[0]),
+               "single file cache keeps the item read by an earlier process");
+   expect_false(does_cache_contain(cache, keys[1]),
+                "single file cache evicts the least recently used item");
+   expect_false(does_cache_contain(cache, keys[2]),
+                "single file cache evicts the 2nd least recently used item");
+   disk_cache_destroy(cache);
+
+   expect_true(foz_test_db_size() <= 16 * 1024,
+               "single file cache within MAX_SIZE=16K after eviction");
+
+   /* A db over a lowered limit is compacted in the background. The item
+    * read above was recent enough not to be recorded again, so the newest
+    * write is the most recently used one on disk.
+    */
+   setenv("MESA_GLSL_CACHE_MAX_SIZE", "8K", 1);
+   cache = disk_cache_create("test", "make_check", 0);
+   disk_cache_wait_for_idle(cache);
+   expect_true(foz_test_db_size() <= 8 * 1024,
+               "single file cache compacted after lowering MAX_SIZE to 8K");
+   expect_true(does_cache_contain(cache, keys[3]),
+               "single file cache compaction keeps the most recent item");
+   expect_false(does_cache_contain(cache, keys[0]),
+                "single file cache compaction evicts older items");
+
+   /* Offline compaction fails while the db is in use. */
+   expect_false(foz_compact_db(FOZ_TEST_EVICT_DB, 0),
+                "offline compaction of a db in use");
+   disk_cache_destroy(cache);
+
+   expect_true(foz_compact_db(FOZ_TEST_EVICT_DB, 6 * 1024),
+               "offline compaction");
+   expect_true(foz_test_db_size() <= 6 * 1024,
+               "offline compaction within the given size");
+
+   setenv("MESA_GLSL_CACHE_MAX_SIZE", "1M", 1);
+   cache = disk_cache_create("test", "make_check", 0);
+   result = disk_cache_get(cache, keys[3], NULL);
+   expect_non_null(result, "offline compaction keeps the most recent item");
+   free(result);
+   disk_cache_destroy(cache);
+
+   expect_true(foz_compact_db(FOZ_TEST_EVICT_DB, 1024),
+               "offline compaction below the size of an item");
+
+   cache = disk_cache_create("test", "make_check", 0);
+   expect_false(does_cache_contain(cache, keys[3]),
+                "offline compaction evicts what doesn't fit");
+   disk_cache_destroy(cache);
+
+   unsetenv("MESA_GLSL_CACHE_MAX_SIZE");
+   unsetenv("MESA_DISK_CACHE_SINGLE_FILE");
+   unsetenv("MESA_GLSL_CACHE_DIR");
+}
+
+#define FOZ_TEST_SRC CACHE_TEST_TMP "/foz-ro-src"
+#define FOZ_TEST_SRC_DB FOZ_TEST_SRC "/" CACHE_DIR_NAME_SF "/make_check/test"
+#define FOZ_TEST_RO CACHE_TEST_TMP "/foz-ro"
+
+static void
+write_bad_foz_db(const char *path)
+{
+   static const char garbage[] = "not a fossilize db, not at all";
+
+   FILE *f = fopen(path, "wb");
+   if (f) {
+      fwrite(garbage, 1, sizeof(garbage), f);
+      fclose(f);
+   }
+}
+
+static void
+test_read_only_foz_dbs(void)
+{
+   struct disk_cache *cache;
+   char blob[] = "This is a blob of thirty-seven bytes";
+   uint8_t blob_key[20];
+   char string[] = "While this string has thirty-four";
+   uint8_t string_key[20];
+   char cwd[PATH_MAX], *ro_dbs;
+   char *result;
+   size_t size;
+
+#ifdef SHADER_CACHE_DISABLE_BY_DEFAULT
+   setenv("MESA_GLSL_CACHE_DISABLE", "false", 1);
+#endif /* SHADER_CACHE_DISABLE_BY_DEFAULT */
+
+   /* Build a db with the single file cache and move it out of the way to
+    * serve as a prebuilt read only db.
+    */
+   setenv("MESA_DISK_CACHE_SINGLE_FILE", "true", 1);
+   setenv("MESA_GLSL_CACHE_DIR", FOZ_TEST_SRC, 1);
+   cache = disk_cache_create("test", "make_check", 0);
+   disk_cache_compute_key(cache, blob, sizeof(blob), blob_key);
+   disk_cache_put(cache, blob_key, blob, sizeof(blob), NULL);
+   disk_cache_wait_for_idle(cache);
+   disk_cache_destroy(cache);
+
+   mkdir(FOZ_TEST_RO, 0755);
+   expect_equal(rename(FOZ_TEST_SRC_DB "/foz_cache.foz",
+                       FOZ_TEST_RO "/prebuilt.foz"), 0,
+                "move the prebuilt read only db in place");
+   expect_equal(rename(FOZ_TEST_SRC_DB "/foz_cache_idx.foz",
+                       FOZ_TEST_RO "/prebuilt_idx.foz"), 0,
+                "move the prebuilt read only db index in place");
+
+   /* A db that fails to load must not take the others down with it. */
+   write_bad_foz_db(FOZ_TEST_RO "/bad.foz");
+   write_bad_foz_db(FOZ_TEST_RO "/bad_idx.foz");
+
+   if (!getcwd(cwd, sizeof(cwd)))
+      cwd[0] = '\0';
+   if (asprintf(&ro_dbs, "%s/%s/bad,%s/%s/prebuilt", cwd, FOZ_TEST_RO,
+                cwd, FOZ_TEST_RO) == -1)
+      ro_dbs = NULL;
+   expect_non_null(ro_dbs, "absolute read only db paths");
+   setenv("MESA_DISK_CACHE_READ_ONLY_FOZ_DBS", ro_dbs, 1);
+   free(ro_dbs);
+
+   /* Single file mode, with an empty writable db. */
+   setenv("MESA_GLSL_CACHE_DIR", CACHE_TEST_TMP "/foz-ro-sf", 1);
+   cache = disk_cache_create("test", "make_check", 0);
+   result = disk_cache_get(cache, blob_key, &size);
+   expect_equal_str(blob, result,
+                    "single file cache reads the read only db (pointer)");
+   expect_equal(size, sizeof(blob),
+                "single file cache reads the read only db (size)");
+   free(result);
+
+   disk_cache_compute_key(cache, string, sizeof(string), string_key);
+   disk_cache_put(cache, string_key, string, sizeof(string), NULL);
+   disk_cache_wait_for_idle(cache);
+   result = disk_cache_get(cache, string_key, &size);
+   expect_equal_str(string, result,
+                    "writable db survives a bad read only db (pointer)");
+   free(result);
+   disk_cache_destroy(cache);
+
+   /* Multi file mode. */
+   unsetenv("MESA_DISK_CACHE_SINGLE_FILE");
+   setenv("MESA_GLSL_CACHE_DIR", CACHE_TEST_TMP "/foz-ro-mf", 1);
+   cache = disk_cache_create("test", "make_check", 0);
+   result = disk_cache_get(cache, blob_key, &size);
+   expect_equal_str(blob, result,
+                    "multi file cache reads the read only db (pointer)");
+   expect_equal(size, sizeof(blob),
+                "multi file cache reads the read only db (size)");
+   free(result);
+
+   disk_cache_put(cache, string_key, string, sizeof(string), NULL);
+   disk_cache_wait_for_idle(cache);
+   expect_true(does_cache_contain(cache, string_key),
+               "multi file cache still writes next to a read only db");
+   disk_cache_destroy(cache);
+
+   unsetenv("MESA_DISK_CACHE_READ_ONLY_FOZ_DBS");
+   unsetenv("MESA_GLSL_CACHE_DIR");
+}
 #endif /* ENABLE_SHADER_CACHE */
 
 int
@@ -530,6 +830,12 @@ main(void)
 
    test_put_key_and_get_key();
 
+   test_memory_cache();
+
+   test_single_file_eviction();
+
+   test_read_only_foz_dbs();
+
    err = rmrf_local(CACHE_TEST_TMP);
    expect_equal(err, 0, "Removing " CACHE_TEST_TMP " again");
 #endif /* ENABLE_SHADER_CACHE */
@@ -296,6 +296,11 @@ test_format_pack_rgba_float(const struct util_format_description *format_desc,
       return TRUE;
    }
 
+   if (test->format == PIPE_FORMAT_ETC1_RGB8) {
+      /* There is no etc1 encoder. */
+      return TRUE;
+   }
+
    memset(packed, 0, sizeof packed);
    for (i = 0; i < format_desc->block.height; ++i) {
       for (j = 0; j < format_desc->block.width; ++j) {
@@ -421,6 +426,11 @@ test_format_pack_rgba_8unorm(const struct util_format_description *format_desc,
       return TRUE;
    }
 
+   if (test->format == PIPE_FORMAT_ETC1_RGB8) {
+      /* There is no etc1 encoder. */
+      return TRUE;
+   }
+
    if (!convert_float_to_8unorm(&unpacked[0][0][0], &test->unpacked[0][0][0])) {
       /*
        * Skip test cases which cannot be represented by four unorm bytes.
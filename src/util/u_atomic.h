@@ -52,6 +52,9 @@
 #define p_atomic_add_return(v, i) __atomic_add_fetch((v), (i), __ATOMIC_ACQ_REL)
 #define p_atomic_xchg(v, i) __atomic_exchange_n((v), (i), __ATOMIC_ACQ_REL)
 #define PIPE_NATIVE_ATOMIC_XCHG
+#define p_atomic_set_release(_v, _i) __atomic_store_n((_v), (_i), __ATOMIC_RELEASE)
+#define p_atomic_read_acquire(_v) __atomic_load_n((_v), __ATOMIC_ACQUIRE)
+#define PIPE_NATIVE_ATOMIC_ACQ_REL
 
 #else
 
@@ -269,4 +272,18 @@ static inline uint64_t p_atomic_xchg_64(uint64_t *v, uint64_t i)
                                       (assert(!"should not get here"), 0))
 #endif
 
+/* p_atomic_set() and p_atomic_read() only order memory accesses with the GCC
+ * atomic builtins.  Elsewhere fall back to compare and exchange, which is a
+ * full barrier.
+ */
+#ifndef PIPE_NATIVE_ATOMIC_ACQ_REL
+#define p_atomic_set_release(_v, _i) do { \
+   __typeof(*(_v)) _old; \
+   do { \
+      _old = p_atomic_read(_v); \
+   } while (p_atomic_cmpxchg((_v), _old, (_i)) != _old); \
+} while (0)
+#define p_atomic_read_acquire(_v) p_atomic_cmpxchg((_v), 0, 0)
+#endif
+
 #endif /* U_ATOMIC_H */
@@ -127,6 +127,27 @@
    }
 
 
+/* Test release stores and acquire loads */
+#define test_atomic_acq_rel(type, ones) \
+   static void test_atomic_acq_rel_##type (void) { \
+      type v, r; \
+      \
+      p_atomic_set_release(&v, ones); \
+      assert(v == ones && "p_atomic_set_release"); \
+      \
+      r = p_atomic_read_acquire(&v); \
+      assert(r == ones && "p_atomic_read_acquire"); \
+      assert(v == ones && "p_atomic_read_acquire"); \
+      \
+      v = 0; \
+      r = p_atomic_read_acquire(&v); \
+      assert(r == 0 && "p_atomic_read_acquire"); \
+      assert(v == 0 && "p_atomic_read_acquire"); \
+      \
+      (void) r; \
+   }
+
+
 test_atomic(int, -1)
 test_atomic(unsigned, ~0U)
 
@@ -141,6 +162,11 @@ test_atomic_8bits(int8_t, INT8_C(-1))
 test_atomic_8bits(uint8_t, UINT8_C(0xff))
 test_atomic_assign(bool, true)
 
+test_atomic_acq_rel(int32_t, INT32_C(-1))
+test_atomic_acq_rel(uint32_t, UINT32_C(0xffffffff))
+test_atomic_acq_rel(int64_t, INT64_C(-1))
+test_atomic_acq_rel(uint64_t, UINT64_C(0xffffffffffffffff))
+
 int
 main()
 {
@@ -158,5 +184,10 @@ main()
    test_atomic_8bits_uint8_t();
    test_atomic_assign_bool();
 
+   test_atomic_acq_rel_int32_t();
+   test_atomic_acq_rel_uint32_t();
+   test_atomic_acq_rel_int64_t();
+   test_atomic_acq_rel_uint64_t();
+
    return 0;
 }